@@ -0,0 +1,492 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "AssetLoader.h"
+#include "Trace.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define PI_GAME_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef PIGAME_ASSET_DIR
+#define PIGAME_ASSET_DIR "../"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Asset
+///////////////////////////////////////////////////////////////////////////////
+bool Asset::wait() const
+{
+    if (getState() == State::Pending)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return getState() != State::Pending; });
+    }
+    return getState() == State::Ready;
+}
+
+void Asset::complete(State result)
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    if (result == State::Failed)
+        fprintf(stderr, "Failed to read asset %s: %s\n", path.c_str(), strerror(error));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        state.store(result, std::memory_order_release);
+    }
+    done.notify_all();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Minimal io_uring wrapper, raw syscalls so there is no liburing dependency
+///////////////////////////////////////////////////////////////////////////////
+#ifdef PI_GAME_HAVE_IO_URING
+struct AssetLoader::Ring
+{
+    static std::unique_ptr<Ring> create(unsigned entries)
+    {
+        std::unique_ptr<Ring> r(new Ring());
+
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        r->fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (r->fd < 0)
+            return nullptr;
+
+        r->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        r->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap)
+            r->sqMapSize = r->cqMapSize = std::max(r->sqMapSize, r->cqMapSize);
+
+        r->sqMap = mmap(nullptr, r->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                        IORING_OFF_SQ_RING);
+        if (r->sqMap == MAP_FAILED)
+            return nullptr;
+
+        if (singleMap)
+            r->cqMap = r->sqMap;
+        else
+        {
+            r->cqMap = mmap(nullptr, r->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                            IORING_OFF_CQ_RING);
+            if (r->cqMap == MAP_FAILED)
+                return nullptr;
+        }
+
+        r->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                          IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return nullptr;
+        r->sqes = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(r->sqMap);
+        r->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        r->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        r->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        r->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        r->sqEntries = params.sq_entries;
+
+        char* cq = static_cast<char*>(r->cqMap);
+        r->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        r->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        r->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        r->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        return r;
+    }
+
+    ~Ring()
+    {
+        if (sqes)
+            munmap(sqes, sqesSize);
+        if (cqMap && cqMap != MAP_FAILED && cqMap != sqMap)
+            munmap(cqMap, cqMapSize);
+        if (sqMap && sqMap != MAP_FAILED)
+            munmap(sqMap, sqMapSize);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    // queue a read, nothing reaches the kernel before submit()
+    bool pushRead(int file, char* dst, size_t len, uint64_t offset, void* userData)
+    {
+        unsigned tail = *sqTail;
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= sqEntries)
+            return false;
+
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uintptr_t>(dst);
+        sqe.len = static_cast<uint32_t>(std::min<size_t>(len, 1u << 30));
+        sqe.off = offset;
+        sqe.user_data = reinterpret_cast<uintptr_t>(userData);
+
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+        return true;
+    }
+
+    // submits everything queued, blocks until at least waitFor completions
+    // exist. Returns 0 or the errno of io_uring_enter, EINTR is retried.
+    int submit(unsigned waitFor)
+    {
+        unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+        if (queued == 0 && waitFor == 0)
+            return 0;
+
+        long ret;
+        do
+        {
+            ret = syscall(__NR_io_uring_enter, fd, queued, waitFor, flags, nullptr, 0);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0)
+            return errno;
+        queued -= std::min(queued, static_cast<unsigned>(ret));
+        return 0;
+    }
+
+    // Takes back the reads the kernel has not picked up yet and calls
+    // onRemoved(userData) for each, returns how many. Without SQPOLL only
+    // io_uring_enter reads the submission queue, so moving the tail back is safe.
+    template<typename F>
+    unsigned unqueue(F&& onRemoved)
+    {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        unsigned tail = *sqTail;
+        for (unsigned i = head; i != tail; i++)
+            onRemoved(reinterpret_cast<void*>(static_cast<uintptr_t>(sqes[sqArray[i & sqMask]].user_data)));
+
+        __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+        queued = 0;
+        return tail - head;
+    }
+
+    template<typename F>
+    void reap(F&& onComplete)
+    {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            onComplete(reinterpret_cast<void*>(static_cast<uintptr_t>(cqe.user_data)), cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    int fd = -1;
+    unsigned queued = 0;
+
+    void* sqMap = nullptr;
+    size_t sqMapSize = 0;
+    void* cqMap = nullptr;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+#else
+struct AssetLoader::Ring
+{
+    static std::unique_ptr<Ring> create(unsigned)
+    {
+        return nullptr;
+    }
+
+    bool pushRead(int, char*, size_t, uint64_t, void*)
+    {
+        return false;
+    }
+
+    int submit(unsigned)
+    {
+        return 0;
+    }
+
+    template<typename F>
+    unsigned unqueue(F&&)
+    {
+        return 0;
+    }
+
+    template<typename F>
+    void reap(F&&)
+    {
+    }
+};
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// AssetLoader
+///////////////////////////////////////////////////////////////////////////////
+AssetLoader::AssetLoader(std::string rootDirectory, unsigned fallbackThreads)
+    : root(std::move(rootDirectory))
+{
+    if (!root.empty() && root.back() != '/')
+        root += '/';
+
+    ring = Ring::create(64);
+    if (ring)
+    {
+        threads.emplace_back(&AssetLoader::ringThreadMain, this);
+        return;
+    }
+
+    for (unsigned i = 0; i < std::max(fallbackThreads, 1u); i++)
+        threads.emplace_back(&AssetLoader::fallbackThreadMain, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+std::string AssetLoader::defaultRoot()
+{
+    const char* env = getenv("PIGAME_ASSET_DIR");
+    return env ? std::string(env) : std::string(PIGAME_ASSET_DIR);
+}
+
+AssetHandle AssetLoader::load(const std::string& path)
+{
+    auto asset = std::make_shared<Asset>();
+    asset->path = (!path.empty() && path[0] == '/') ? path : root + path;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.push_back(asset);
+    }
+    queueChanged.notify_one();
+    return asset;
+}
+
+bool AssetLoader::openAsset(Asset& asset)
+{
+    asset.fd = open(asset.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (asset.fd < 0)
+    {
+        asset.error = errno;
+        asset.complete(Asset::State::Failed);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(asset.fd, &info) != 0)
+    {
+        asset.error = errno;
+        asset.complete(Asset::State::Failed);
+        return false;
+    }
+
+    // the one and only destination buffer, +1 for the terminator
+    asset.bytes = static_cast<size_t>(info.st_size);
+    asset.buffer.reset(new char[asset.bytes + 1]);
+    asset.buffer[asset.bytes] = '\0';
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(asset.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+bool AssetLoader::queueRead(Asset* asset)
+{
+    if (ring->pushRead(asset->fd, asset->buffer.get() + asset->bytesRead, asset->bytes - asset->bytesRead,
+                       asset->bytesRead, asset))
+        return true;
+
+    // no room in the submission queue, nothing would ever complete it
+    readRemaining(*asset);
+    return false;
+}
+
+void AssetLoader::ringThreadMain()
+{
+    TRACE_THREAD_NAME("asset ring");
+
+    std::vector<AssetHandle> inFlight;
+    std::vector<Asset*> resubmit;
+    bool reportedFailure = false;
+
+    for (;;)
+    {
+        std::deque<AssetHandle> batch;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            if (inFlight.empty())
+                queueChanged.wait(lock, [this]() { return stopping || !pending.empty(); });
+
+            if (stopping && pending.empty() && inFlight.empty())
+                return;
+
+            // only take what fits in the submission queue, the rest waits a round
+            size_t room = 64 - inFlight.size();
+            while (!pending.empty() && batch.size() < room)
+            {
+                batch.push_back(std::move(pending.front()));
+                pending.pop_front();
+            }
+        }
+
+        // everything that queued up goes to the kernel in one io_uring_enter
+        for (auto& asset : batch)
+        {
+            if (!openAsset(*asset))
+                continue;
+
+            if (asset->bytes == 0)
+            {
+                asset->complete(Asset::State::Ready);
+                continue;
+            }
+
+            if (queueRead(asset.get()))
+                inFlight.push_back(std::move(asset));
+        }
+
+        if (inFlight.empty())
+            continue;
+
+        if (const int error = ring->submit(1))
+        {
+            // EAGAIN, EBUSY and the like tend to stick, read whatever the
+            // kernel has not taken with pread instead of retrying it. What it
+            // has taken owns its buffer until it shows up in reap() below.
+            unsigned taken = ring->unqueue([](void* userData) {
+                readRemaining(*static_cast<Asset*>(userData));
+            });
+            if (!reportedFailure)
+                fprintf(stderr, "io_uring_enter failed: %s, reading with pread when it does\n", strerror(error));
+            reportedFailure = true;
+
+            // only the wait failed, the kernel holds every buffer, back off rather than spin
+            if (taken == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        ring->reap([&](void* userData, int result) {
+            Asset* asset = static_cast<Asset*>(userData);
+
+            if (result == -EINVAL || result == -EOPNOTSUPP)
+            {
+                // kernel without IORING_OP_READ, do this one synchronously
+                ssize_t n = pread(asset->fd, asset->buffer.get() + asset->bytesRead,
+                                  asset->bytes - asset->bytesRead, static_cast<off_t>(asset->bytesRead));
+                result = n < 0 ? -errno : static_cast<int>(n);
+            }
+
+            if (result < 0)
+                asset->error = -result;
+            else if (result == 0)
+                asset->error = EIO;     // file shrunk under us
+            else
+            {
+                asset->bytesRead += static_cast<size_t>(result);
+                if (asset->bytesRead < asset->bytes)
+                {
+                    resubmit.push_back(asset);
+                    return;
+                }
+            }
+
+            asset->complete(asset->error ? Asset::State::Failed : Asset::State::Ready);
+        });
+
+        // short reads continue where they stopped, the ones that don't fit
+        // are finished here and dropped from inFlight below
+        for (Asset* asset : resubmit)
+            queueRead(asset);
+        resubmit.clear();
+
+        inFlight.erase(std::remove_if(inFlight.begin(), inFlight.end(), [](const AssetHandle& a) {
+            return a->getState() != Asset::State::Pending;
+        }), inFlight.end());
+    }
+}
+
+void AssetLoader::fallbackThreadMain()
+{
+    TRACE_THREAD_NAME("asset read");
+
+    for (;;)
+    {
+        AssetHandle asset;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty())
+                return;
+
+            asset = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        if (openAsset(*asset))
+            readRemaining(*asset);
+    }
+}
+
+void AssetLoader::readRemaining(Asset& asset)
+{
+    while (asset.bytesRead < asset.bytes)
+    {
+        ssize_t n = pread(asset.fd, asset.buffer.get() + asset.bytesRead,
+                          asset.bytes - asset.bytesRead, static_cast<off_t>(asset.bytesRead));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            asset.error = n < 0 ? errno : EIO;
+            break;
+        }
+        asset.bytesRead += static_cast<size_t>(n);
+    }
+
+    asset.complete(asset.error ? Asset::State::Failed : Asset::State::Ready);
+}
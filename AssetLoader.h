@@ -0,0 +1,120 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_ASSETLOADER_H
+#define PI_GAME_ASSETLOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AssetLoader;
+
+// A file read into a single buffer that was sized up front from fstat().
+// The kernel writes straight into it and consumers (glShaderSource, mesh
+// loaders, ...) read from it in place, there are no intermediate copies.
+// The buffer is always null terminated, size() does not count the terminator.
+class Asset {
+public:
+    enum class State { Pending, Ready, Failed };
+
+    const char* data() const
+    {
+        return buffer.get();
+    }
+
+    size_t size() const
+    {
+        return bytes;
+    }
+
+    const std::string& getPath() const
+    {
+        return path;
+    }
+
+    State getState() const
+    {
+        return state.load(std::memory_order_acquire);
+    }
+
+    // blocks until the read finished, returns true if the data is usable
+    bool wait() const;
+
+private:
+    friend class AssetLoader;
+
+    void complete(State result);
+
+    std::string path;
+    std::unique_ptr<char[]> buffer;
+    size_t bytes = 0;
+    size_t bytesRead = 0;
+    int fd = -1;
+    int error = 0;
+
+    std::atomic<State> state{State::Pending};
+    mutable std::mutex mutex;
+    mutable std::condition_variable done;
+};
+
+using AssetHandle = std::shared_ptr<Asset>;
+
+// Background asset reader. Requests are queued without blocking and the I/O
+// thread pushes everything that piled up as one io_uring submission. When
+// io_uring is not available (old kernel, seccomp, missing headers) a small
+// pool of threads doing pread() takes over, the API does not change.
+// Request assets as early as possible, e.g. before the DRM/EGL setup, and
+// wait() on them only when they are needed.
+class AssetLoader {
+public:
+    explicit AssetLoader(std::string rootDirectory = defaultRoot(), unsigned fallbackThreads = 2);
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // path is relative to the asset root unless it is absolute
+    AssetHandle load(const std::string& path);
+
+    bool usesIoUring() const
+    {
+        return ring != nullptr;
+    }
+
+    // $PIGAME_ASSET_DIR if set, otherwise the directory baked in at build time
+    static std::string defaultRoot();
+
+private:
+    struct Ring;
+
+    void ringThreadMain();
+    void fallbackThreadMain();
+    bool openAsset(Asset& asset);
+    // false if the submission queue was full, the asset was then read and
+    // completed right away with readRemaining()
+    bool queueRead(Asset* asset);
+
+    // pread() from where the asset stopped to its end, then completes it
+    static void readRemaining(Asset& asset);
+
+    std::string root;
+
+    std::unique_ptr<Ring> ring;
+    std::vector<std::thread> threads;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<AssetHandle> pending;
+    bool stopping = false;
+};
+
+
+#endif //PI_GAME_ASSETLOADER_H
@@ -0,0 +1,184 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <cstring>
+#include <stdexcept>
+#include <GLES3/gl3.h>
+#include "CommandBuffer.h"
+#include "Trace.h"
+
+namespace {
+    uint32_t toWord(float f)
+    {
+        uint32_t w;
+        std::memcpy(&w, &f, sizeof(w));
+        return w;
+    }
+
+    // the state submit() last set, zero is never a valid name here
+    struct BoundState
+    {
+        uint32_t program = 0;
+        uint32_t vao = 0;
+        uint32_t textures[8] = {};
+    };
+}
+
+void CommandBuffer::setProgram(uint32_t program)
+{
+    append(Type::Program, 1)[0] = program;
+}
+
+void CommandBuffer::setVertexArray(uint32_t vao)
+{
+    append(Type::VertexArray, 1)[0] = vao;
+}
+
+void CommandBuffer::setMatrix(int32_t location, const float* values)
+{
+    uint32_t* p = append(Type::Matrix, 17);
+    p[0] = static_cast<uint32_t>(location);
+    std::memcpy(p + 1, values, 16 * sizeof(float));
+}
+
+void CommandBuffer::setVector(int32_t location, float x, float y, float z, float w)
+{
+    uint32_t* p = append(Type::Vector, 5);
+    p[0] = static_cast<uint32_t>(location);
+    p[1] = toWord(x);
+    p[2] = toWord(y);
+    p[3] = toWord(z);
+    p[4] = toWord(w);
+}
+
+void CommandBuffer::setTexture(uint32_t unit, uint32_t texture)
+{
+    uint32_t* p = append(Type::Texture, 2);
+    p[0] = unit;
+    p[1] = texture;
+}
+
+void CommandBuffer::drawIndexed(uint32_t firstIndex, uint32_t indexCount, IndexType type, uint32_t instances)
+{
+    if (indexCount == 0 || instances == 0)
+        return;
+
+    uint32_t* p = append(Type::Draw, 4);
+    p[0] = firstIndex;
+    p[1] = indexCount;
+    p[2] = instances;
+    p[3] = static_cast<uint32_t>(type);
+}
+
+CommandQueue::CommandQueue(JobSystem& jobSystem)
+    : jobs(jobSystem)
+{
+    for (unsigned i = 0; i < jobs.getNumWorkers(); i++)
+        buffers.emplace_back(new CommandBuffer());
+}
+
+CommandBuffer& CommandQueue::local()
+{
+    int index = jobs.getWorkerIndex();
+    if (index < 0)
+        throw std::runtime_error("Commands can only be recorded from a JobSystem worker thread");
+    return *buffers[static_cast<size_t>(index)];
+}
+
+void CommandQueue::reset()
+{
+    for (auto& buffer : buffers)
+        buffer->reset();
+}
+
+void CommandQueue::submit()
+{
+    TRACE_SCOPE("submitCommands");
+    BoundState bound;
+    draws = 0;
+    skipped = 0;
+
+    for (auto& buffer : buffers)
+    {
+        const std::vector<uint32_t>& words = buffer->getWords();
+        const uint32_t* p = words.data();
+        const uint32_t* end = p + words.size();
+        while (p < end)
+        {
+            const auto type = static_cast<CommandBuffer::Type>(*p & 0xFFu);
+            const uint32_t length = *p >> 8;
+            const uint32_t* args = p + 1;
+            p = args + length;
+
+            switch (type)
+            {
+                case CommandBuffer::Type::Program:
+                    if (bound.program == args[0])
+                    {
+                        skipped++;
+                        break;
+                    }
+                    bound.program = args[0];
+                    glUseProgram(args[0]);
+                    break;
+
+                case CommandBuffer::Type::VertexArray:
+                    if (bound.vao == args[0])
+                    {
+                        skipped++;
+                        break;
+                    }
+                    bound.vao = args[0];
+                    glBindVertexArray(args[0]);
+                    break;
+
+                case CommandBuffer::Type::Matrix:
+                {
+                    float m[16];
+                    std::memcpy(m, args + 1, sizeof(m));
+                    glUniformMatrix4fv(static_cast<GLint>(args[0]), 1, GL_FALSE, m);
+                    break;
+                }
+
+                case CommandBuffer::Type::Vector:
+                {
+                    float v[4];
+                    std::memcpy(v, args + 1, sizeof(v));
+                    glUniform4f(static_cast<GLint>(args[0]), v[0], v[1], v[2], v[3]);
+                    break;
+                }
+
+                case CommandBuffer::Type::Texture:
+                {
+                    const uint32_t unit = args[0];
+                    if (unit < 8 && bound.textures[unit] == args[1])
+                    {
+                        skipped++;
+                        break;
+                    }
+                    if (unit < 8)
+                        bound.textures[unit] = args[1];
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(GL_TEXTURE_2D, args[1]);
+                    break;
+                }
+
+                case CommandBuffer::Type::Draw:
+                {
+                    const bool shortIndices = static_cast<IndexType>(args[3]) == IndexType::UInt16;
+                    const GLenum indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+                    const uintptr_t offset = static_cast<uintptr_t>(args[0]) * (shortIndices ? 2u : 4u);
+                    const auto count = static_cast<GLsizei>(args[1]);
+                    if (args[2] == 1)
+                        glDrawElements(GL_TRIANGLES, count, indexType, reinterpret_cast<const GLvoid*>(offset));
+                    else
+                        glDrawElementsInstanced(GL_TRIANGLES, count, indexType, reinterpret_cast<const GLvoid*>(offset),
+                                                static_cast<GLsizei>(args[2]));
+                    draws++;
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,134 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_COMMANDBUFFER_H
+#define PI_GAME_COMMANDBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "JobSystem.h"
+
+enum class IndexType : uint8_t
+{
+    UInt16,
+    UInt32
+};
+
+// A stream of compact draw packets. Recording touches no GL, so any thread
+// can fill a buffer, only CommandQueue::submit() turns it into GL calls.
+// Handles (programs, vertex arrays, textures) and uniform locations are the
+// plain GL names, draws are indexed triangle lists. The storage is kept
+// across reset(), a buffer that has seen a typical frame records without
+// allocating.
+class alignas(64) CommandBuffer {
+public:
+    enum class Type : uint8_t
+    {
+        Program,        // program
+        VertexArray,    // vao
+        Matrix,         // location, 16 floats
+        Vector,         // location, 4 floats
+        Texture,        // unit, texture (2D)
+        Draw,           // firstIndex, indexCount, instances, indexType
+    };
+
+    void reset()
+    {
+        words.clear();
+        commands = 0;
+    }
+
+    void setProgram(uint32_t program);
+    void setVertexArray(uint32_t vao);
+    void setMatrix(int32_t location, const float* values);
+    void setVector(int32_t location, float x, float y, float z, float w);
+    void setTexture(uint32_t unit, uint32_t texture);
+
+    // instances == 1 is a plain draw, more an instanced one
+    void drawIndexed(uint32_t firstIndex, uint32_t indexCount, IndexType type, uint32_t instances = 1);
+
+    bool empty() const
+    {
+        return commands == 0;
+    }
+
+    size_t getCommandCount() const
+    {
+        return commands;
+    }
+
+    const std::vector<uint32_t>& getWords() const
+    {
+        return words;
+    }
+
+private:
+    // every packet starts with a header word, type in the low byte and the
+    // payload length in words above it
+    uint32_t* append(Type type, uint32_t payloadWords)
+    {
+        size_t at = words.size();
+        words.resize(at + 1 + payloadWords);
+        words[at] = static_cast<uint32_t>(type) | (payloadWords << 8);
+        commands++;
+        return &words[at + 1];
+    }
+
+    std::vector<uint32_t> words;
+    size_t commands = 0;
+};
+
+// One CommandBuffer per JobSystem worker, so recording jobs never share
+// one. submit() replays all of them on the GL thread in worker order and
+// drops state changes that would not change anything. Buffers are replayed
+// back to back without a defined order between workers, so each recorded
+// batch sets the state its draws need.
+class CommandQueue {
+public:
+    explicit CommandQueue(JobSystem& jobSystem);
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // the calling worker's buffer, throws for threads outside the JobSystem
+    CommandBuffer& local();
+
+    // Calls func(buffer, begin, end) over [0, count) in parallel, each range
+    // recording into the buffer of the worker that runs it. Blocks until done.
+    template<typename F>
+    void record(size_t count, size_t grainSize, const F& func)
+    {
+        jobs.parallelFor(0, count, grainSize, [this, &func](size_t begin, size_t end) {
+            func(local(), begin, end);
+        });
+    }
+
+    // clears every buffer, call once per frame before recording
+    void reset();
+
+    // GL thread only
+    void submit();
+
+    // of the last submit()
+    size_t getDrawCount() const
+    {
+        return draws;
+    }
+
+    size_t getSkippedStateChanges() const
+    {
+        return skipped;
+    }
+
+private:
+    JobSystem& jobs;
+    std::vector<std::unique_ptr<CommandBuffer>> buffers;
+    size_t draws = 0;
+    size_t skipped = 0;
+};
+
+
+#endif //PI_GAME_COMMANDBUFFER_H
@@ -3,6 +3,7 @@
 //
 
 #include "DispmanCapture.h"
+#include "Trace.h"
 
 DispmanCapture::DispmanCapture() {
     initDispman();
@@ -10,6 +11,7 @@ DispmanCapture::DispmanCapture() {
 
 
 void DispmanCapture::initDispman() {
+    TRACE_SCOPE("initDispman");
     bcm_host_init();
     displayHandle = vc_dispmanx_display_open(defDisplay);
 
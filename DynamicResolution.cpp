@@ -0,0 +1,284 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "DynamicResolution.h"
+#include "MemoryTracker.h"
+
+// EXT_disjoint_timer_query, on ES 3 the core query entry points take these
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+namespace {
+    // EMA weight of a new sample, about a quarter second at 60 Hz
+    constexpr float smoothing = 0.15f;
+
+    // how long the CPU fallback stays on budget before trying a step up, in
+    // settle periods, and how far failed probes can push that out
+    constexpr uint32_t probeMultiplier = 6;
+    constexpr uint32_t maxProbeMultiplier = 48;
+
+    // a smoothed frame time this far over the refresh interval means frames are being dropped
+    constexpr float lateFrameRatio = 1.25f;
+
+    bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (ext && strcmp(ext, name) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+DynamicResolution::DynamicResolution(uint32_t width, uint32_t height, const DynamicResolutionSettings& dynamicSettings)
+    : settings(dynamicSettings), outputWidth(width), outputHeight(height)
+{
+    if (settings.minScale <= 0.0f || settings.minScale > settings.maxScale)
+        throw std::runtime_error("Invalid dynamic resolution scale bounds");
+
+    createTarget();
+    scaleLimit = settings.maxScale;
+    applyScale(settings.maxScale);
+    probeInterval = settings.settleFrames * probeMultiplier;
+
+    timerQueries = hasExtension("GL_EXT_disjoint_timer_query");
+    if (timerQueries)
+        glGenQueries(queryCount, queries);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    MemoryTracker& memory = MemoryTracker::instance();
+    memory.untrackRenderbuffer(colorBuffer);
+    memory.untrackRenderbuffer(depthBuffer);
+
+    if (timerQueries)
+        glDeleteQueries(queryCount, queries);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+}
+
+void DynamicResolution::createTarget()
+{
+    targetWidth = static_cast<uint32_t>(std::ceil(static_cast<float>(outputWidth) * settings.maxScale));
+    targetHeight = static_cast<uint32_t>(std::ceil(static_cast<float>(outputHeight) * settings.maxScale));
+    const GLsizei w = static_cast<GLsizei>(targetWidth);
+    const GLsizei h = static_cast<GLsizei>(targetHeight);
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Dynamic resolution target is incomplete");
+
+    // both renderbuffers are 4 bytes per pixel, depth is padded to 32 bits
+    const size_t bytes = size_t(targetWidth) * targetHeight * 4;
+    MemoryTracker& memory = MemoryTracker::instance();
+    memory.trackRenderbuffer(colorBuffer, bytes);
+    memory.trackRenderbuffer(depthBuffer, bytes);
+}
+
+void DynamicResolution::beginFrame()
+{
+    if (timerQueries)
+    {
+        // skip timing this frame rather than stall if every query is still in flight
+        if (queryWrite - queryRead < queryCount)
+            glBeginQuery(GL_TIME_ELAPSED_EXT, queries[queryWrite % queryCount]);
+    }
+    else
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (haveLastFrame)
+            addSample(std::chrono::duration<float, std::milli>(now - lastFrame).count());
+        lastFrame = now;
+        haveLastFrame = true;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, static_cast<GLsizei>(renderWidth), static_cast<GLsizei>(renderHeight));
+}
+
+void DynamicResolution::endFrame()
+{
+    // depth never leaves the tile buffer, tell the driver not to write it back
+    const GLenum depthAttachment = GL_DEPTH_ATTACHMENT;
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, &depthAttachment);
+
+    const bool native = renderWidth == outputWidth && renderHeight == outputHeight;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, static_cast<GLint>(renderWidth), static_cast<GLint>(renderHeight),
+                      0, 0, static_cast<GLint>(outputWidth), static_cast<GLint>(outputHeight),
+                      GL_COLOR_BUFFER_BIT, native ? GL_NEAREST : GL_LINEAR);
+
+    const GLenum colorAttachment = GL_COLOR_ATTACHMENT0;
+    glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 1, &colorAttachment);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, static_cast<GLsizei>(outputWidth), static_cast<GLsizei>(outputHeight));
+
+    if (timerQueries)
+    {
+        if (queryWrite - queryRead < queryCount)
+        {
+            glEndQuery(GL_TIME_ELAPSED_EXT);
+            queryWrite++;
+        }
+        readTimers();
+    }
+}
+
+void DynamicResolution::readTimers()
+{
+    // a disjoint event (clock change, power state) makes everything in flight useless
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint)
+    {
+        queryRead = queryWrite;
+        return;
+    }
+
+    while (queryRead != queryWrite)
+    {
+        GLuint query = queries[queryRead % queryCount];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        // nanoseconds, 32 bits are enough for anything under four seconds
+        GLuint elapsed = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &elapsed);
+        queryRead++;
+        addSample(static_cast<float>(elapsed) * 1e-6f);
+    }
+}
+
+void DynamicResolution::addSample(float ms)
+{
+    smoothedMs = samples++ ? smoothedMs + smoothing * (ms - smoothedMs) : ms;
+
+    // results still in flight were rendered at the old scale
+    if (++framesSinceChange < settings.settleFrames)
+        return;
+
+    const float high = settings.targetMs * settings.upperBand;
+    const float low = settings.targetMs * settings.lowerBand;
+    // cost goes with the pixel count, the square of the scale, so aim for the
+    // middle of the dead band with the square root of the ratio
+    const float aim = 0.5f * (high + low);
+
+    if (!timerQueries)
+    {
+        // Frame times are held at the refresh interval by vsync, dropped
+        // frames are the only thing that shows up. Back off on those,
+        // otherwise try a step up now and then. A step up that drops frames
+        // is undone and the next attempt waits twice as long.
+        if (smoothedMs > settings.refreshMs * lateFrameRatio)
+        {
+            framesOnBudget = 0;
+            if (++framesOver < settings.settleFrames)
+                return;
+
+            if (probing)
+            {
+                probeInterval = std::min(probeInterval * 2, settings.settleFrames * maxProbeMultiplier);
+                probing = false;
+                applyScale(scale - settings.step);
+            }
+            else
+            {
+                // the real GPU time is hidden somewhere below the missed interval
+                applyScale(scale * std::sqrt(settings.targetMs / smoothedMs));
+            }
+        }
+        else
+        {
+            framesOver = 0;
+            // lasted a full settle period after the step, keep it
+            probing = false;
+            if (++framesOnBudget >= probeInterval && scale < scaleLimit)
+            {
+                applyScale(scale + settings.step);
+                probing = true;
+            }
+        }
+        return;
+    }
+
+    if (smoothedMs > high)
+    {
+        framesUnder = 0;
+        if (++framesOver >= settings.settleFrames)
+            applyScale(scale * std::sqrt(aim / smoothedMs));
+    }
+    else if (smoothedMs < low)
+    {
+        framesOver = 0;
+        // grow at most a few steps at a time, undershooting is cheaper than a dropped frame
+        if (++framesUnder >= settings.settleFrames)
+            applyScale(std::min(scale * std::sqrt(aim / smoothedMs), scale + 4.0f * settings.step));
+    }
+    else
+    {
+        framesOver = 0;
+        framesUnder = 0;
+    }
+}
+
+void DynamicResolution::setScaleLimit(float limit)
+{
+    scaleLimit = std::min(std::max(limit, settings.minScale), settings.maxScale);
+    if (scale > scaleLimit)
+        applyScale(scaleLimit);
+}
+
+void DynamicResolution::applyScale(float newScale)
+{
+    newScale = std::floor(newScale / settings.step) * settings.step;
+
+    // the floor can swallow a small request, move at least one step
+    if (newScale < scale && newScale > scale - settings.step)
+        newScale = scale - settings.step;
+    else if (newScale > scale && newScale < scale + settings.step)
+        newScale = scale + settings.step;
+    newScale = std::min(std::max(newScale, settings.minScale), scaleLimit);
+
+    framesOver = 0;
+    framesUnder = 0;
+    framesOnBudget = 0;
+    if (newScale == scale && renderWidth)
+        return;
+
+    scale = newScale;
+    framesSinceChange = 0;
+    renderWidth = std::min(targetWidth, std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(outputWidth) * scale))));
+    renderHeight = std::min(targetHeight, std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(outputHeight) * scale))));
+}
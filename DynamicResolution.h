@@ -0,0 +1,130 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_DYNAMICRESOLUTION_H
+#define PI_GAME_DYNAMICRESOLUTION_H
+
+#include <chrono>
+#include <cstdint>
+#include <GLES3/gl3.h>
+
+struct DynamicResolutionSettings
+{
+    float targetMs = 15.0f;             // GPU budget, a bit under the 16.7 ms of 60 Hz
+    float refreshMs = 1000.0f / 60.0f;  // display interval, the budget without a GPU timer
+    float minScale = 0.5f;              // per axis, 0.5 is a quarter of the pixels
+    float maxScale = 1.0f;
+    float lowerBand = 0.8f;             // grow only below targetMs * lowerBand
+    float upperBand = 1.0f;             // shrink only above targetMs * upperBand
+    float step = 1.0f / 32.0f;          // scales are rounded to multiples of this
+    uint32_t settleFrames = 20;         // frames the measurement has to agree before and after a change
+};
+
+// Renders the scene into an offscreen target whose size follows the GPU
+// frame time and blits it up to the scanout surface at the end of the frame.
+// The target is allocated once at maxScale, a lower scale only shrinks the
+// viewport and the blit source rectangle so nothing is reallocated when the
+// scale moves.
+// GPU time comes from EXT_disjoint_timer_query when the driver has it.
+// Otherwise the CPU time between frames is used, which only shows the GPU
+// cost once the frame rate drops, so in that mode the scale is probed upwards
+// after a longer stretch of frames on budget.
+class DynamicResolution {
+public:
+    DynamicResolution(uint32_t outputWidth, uint32_t outputHeight,
+                      const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+    ~DynamicResolution();
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    // binds the offscreen target with the viewport at the current scale
+    void beginFrame();
+
+    // blits to the default framebuffer and picks the scale for the next
+    // frame, call before swapBuffers()
+    void endFrame();
+
+    float getScale() const
+    {
+        return scale;
+    }
+
+    // Caps the scale below settings.maxScale without reallocating, for the
+    // quality governor. A lower cap applies right away, a higher one is
+    // grown into by the usual measurement.
+    void setScaleLimit(float limit);
+
+    float getScaleLimit() const
+    {
+        return scaleLimit;
+    }
+
+    uint32_t getRenderWidth() const
+    {
+        return renderWidth;
+    }
+
+    uint32_t getRenderHeight() const
+    {
+        return renderHeight;
+    }
+
+    // smoothed frame time the scale is following, in milliseconds
+    float getFrameTimeMs() const
+    {
+        return smoothedMs;
+    }
+
+    bool hasGpuTimer() const
+    {
+        return timerQueries;
+    }
+
+private:
+    static constexpr uint32_t queryCount = 4;
+
+    void createTarget();
+    void readTimers();
+    void addSample(float ms);
+    void applyScale(float newScale);
+
+    DynamicResolutionSettings settings;
+
+    uint32_t outputWidth;
+    uint32_t outputHeight;
+    uint32_t targetWidth = 0;
+    uint32_t targetHeight = 0;
+    uint32_t renderWidth = 0;
+    uint32_t renderHeight = 0;
+    float scale = 1.0f;
+    float scaleLimit = 1.0f;
+
+    GLuint framebuffer = 0;
+    GLuint colorBuffer = 0;
+    GLuint depthBuffer = 0;
+
+    bool timerQueries = false;
+    GLuint queries[queryCount] = {};
+    uint32_t queryWrite = 0;
+    uint32_t queryRead = 0;
+
+    std::chrono::steady_clock::time_point lastFrame;
+    bool haveLastFrame = false;
+
+    float smoothedMs = 0.0f;
+    uint32_t samples = 0;
+    uint32_t framesOver = 0;
+    uint32_t framesUnder = 0;
+    uint32_t framesOnBudget = 0;
+    uint32_t framesSinceChange = 0;
+
+    // CPU fallback only: frames on budget before the next step up, doubled
+    // every time a step up turns out to drop frames
+    uint32_t probeInterval = 0;
+    bool probing = false;
+};
+
+
+#endif //PI_GAME_DYNAMICRESOLUTION_H
@@ -0,0 +1,110 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include "FrameArena.h"
+
+FrameArena::FrameArena(size_t bytes)
+    : buffer(new unsigned char[bytes]), capacity(bytes)
+{
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    const uintptr_t base = reinterpret_cast<uintptr_t>(buffer.get());
+
+    size_t current = offset.load(std::memory_order_relaxed);
+    size_t start;
+    size_t end;
+    do
+    {
+        // align the address, not the offset, the buffer itself is only new[] aligned
+        start = ((base + current + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+        end = start + bytes;
+        if (end > capacity)
+            throw std::bad_alloc();
+    } while (!offset.compare_exchange_weak(current, end, std::memory_order_relaxed));
+
+    return buffer.get() + start;
+}
+
+void FrameArena::reset()
+{
+    highWater = std::max(highWater, offset.load(std::memory_order_relaxed));
+    offset.store(0, std::memory_order_relaxed);
+}
+
+#ifdef PIGAME_COUNT_ALLOCATIONS
+
+namespace {
+    std::atomic<uint64_t> heapAllocations { 0 };
+}
+
+// libstdc++ forwards the array and nothrow forms of new and delete to the
+// single object ones below. Over-aligned types (Job, CommandBuffer) use the
+// std::align_val_t forms, which go straight to aligned_alloc instead, so
+// those are replaced as well.
+void* operator new(size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    // aligned_alloc wants a multiple of the alignment
+    const size_t align = static_cast<size_t>(alignment);
+    const size_t rounded = ((size ? size : 1) + align - 1) & ~(align - 1);
+    if (void* p = std::aligned_alloc(align, rounded))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+bool HeapCounter::isEnabled()
+{
+    return true;
+}
+
+uint64_t HeapCounter::getAllocations()
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool HeapCounter::isEnabled()
+{
+    return false;
+}
+
+uint64_t HeapCounter::getAllocations()
+{
+    return 0;
+}
+
+#endif
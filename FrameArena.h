@@ -0,0 +1,159 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_FRAMEARENA_H
+#define PI_GAME_FRAMEARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Bump allocator for data that lives for one frame. allocate() is a single
+// atomic add so jobs can use it too, nothing is ever freed individually and
+// reset() at the end of the frame drops everything at once. Running out
+// throws std::bad_alloc, size the arena from getHighWater().
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacity = size_t(4) << 20);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template<typename T>
+    T* allocateArray(size_t count)
+    {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // everything handed out so far becomes invalid
+    void reset();
+
+    size_t getUsed() const
+    {
+        return offset.load(std::memory_order_relaxed);
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    // most ever used in one frame
+    size_t getHighWater() const
+    {
+        return highWater;
+    }
+
+private:
+    std::unique_ptr<unsigned char[]> buffer;
+    size_t capacity;
+    std::atomic<size_t> offset { 0 };
+    size_t highWater = 0;
+};
+
+// Two arenas that take turns, for data that has to be read one frame after
+// it was written (GPU uploads in flight, last frame's culling results).
+// swap() at frame end recycles the older arena and keeps the newer one.
+class DoubleFrameArena {
+public:
+    explicit DoubleFrameArena(size_t capacity = size_t(4) << 20)
+        : arenas { FrameArena(capacity), FrameArena(capacity) }
+    {
+    }
+
+    FrameArena& current()
+    {
+        return arenas[index];
+    }
+
+    // what was allocated during the previous frame, still valid
+    FrameArena& previous()
+    {
+        return arenas[index ^ 1u];
+    }
+
+    void swap()
+    {
+        index ^= 1u;
+        arenas[index].reset();
+    }
+
+private:
+    FrameArena arenas[2];
+    unsigned index = 0;
+};
+
+// STL allocator on top of a FrameArena, deallocate is a no-op. A null arena
+// falls back to the heap so the same container type works both ways.
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+
+    explicit ArenaAllocator(FrameArena* frameArena) noexcept
+        : arena(frameArena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+        : arena(other.getArena())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (arena)
+            return arena->allocateArray<T>(n);
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) noexcept
+    {
+        if (!arena)
+            ::operator delete(p);
+    }
+
+    FrameArena* getArena() const noexcept
+    {
+        return arena;
+    }
+
+private:
+    FrameArena* arena = nullptr;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept
+{
+    return a.getArena() == b.getArena();
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept
+{
+    return !(a == b);
+}
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Counts global operator new calls when built with PIGAME_COUNT_ALLOCATIONS,
+// so a frame loop can assert it stays off the heap in steady state.
+namespace HeapCounter {
+    bool isEnabled();
+
+    // operator new calls since startup, from any thread
+    uint64_t getAllocations();
+}
+
+
+#endif //PI_GAME_FRAMEARENA_H
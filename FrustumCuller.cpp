@@ -0,0 +1,141 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <cmath>
+#include <limits>
+#include "FrustumCuller.h"
+#include "Simd.h"
+
+namespace {
+    constexpr size_t batchSize = 8;
+
+    // padding entries sit infinitely far behind every plane
+    const float padRadius = -std::numeric_limits<float>::infinity();
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& m)
+{
+    // glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+    glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+    Frustum f;
+    f.planes[Left] = r3 + r0;
+    f.planes[Right] = r3 - r0;
+    f.planes[Bottom] = r3 + r1;
+    f.planes[Top] = r3 - r1;
+    f.planes[Near] = r3 + r2;
+    f.planes[Far] = r3 - r2;
+
+    for (auto& p : f.planes)
+    {
+        float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (len > 0.0f)
+            p = p / len;
+    }
+    return f;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+    for (const auto& p : planes)
+    {
+        if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+uint32_t FrustumCuller::add(const glm::vec3& center, float r)
+{
+    uint32_t index = static_cast<uint32_t>(count);
+    resizeArrays(count + 1);
+    set(index, center, r);
+    return index;
+}
+
+void FrustumCuller::set(uint32_t index, const glm::vec3& center, float r)
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    radius[index] = r;
+}
+
+void FrustumCuller::clear()
+{
+    resizeArrays(0);
+}
+
+void FrustumCuller::resizeArrays(size_t newCount)
+{
+    size_t padded = (newCount + batchSize - 1) / batchSize * batchSize;
+    centerX.resize(padded, 0.0f);
+    centerY.resize(padded, 0.0f);
+    centerZ.resize(padded, 0.0f);
+    radius.resize(padded, padRadius);
+    count = newCount;
+}
+
+const std::vector<uint32_t>& FrustumCuller::cull(const glm::mat4& viewProjection)
+{
+    return cull(Frustum::fromMatrix(viewProjection));
+}
+
+const std::vector<uint32_t>& FrustumCuller::cull(const Frustum& frustum)
+{
+    // the compaction below writes a full batch unconditionally
+    size_t padded = centerX.size();
+    visible.resize(padded);
+
+    simd::Float4 nx[Frustum::Count], ny[Frustum::Count], nz[Frustum::Count], nw[Frustum::Count];
+    for (int p = 0; p < Frustum::Count; p++)
+    {
+        nx[p] = simd::set1(frustum.planes[p].x);
+        ny[p] = simd::set1(frustum.planes[p].y);
+        nz[p] = simd::set1(frustum.planes[p].z);
+        nw[p] = simd::set1(frustum.planes[p].w);
+    }
+
+    const float* cx = centerX.data();
+    const float* cy = centerY.data();
+    const float* cz = centerZ.data();
+    const float* cr = radius.data();
+    uint32_t* out = visible.data();
+    uint32_t visibleCount = 0;
+
+    // two independent groups of 4 per iteration to hide the multiply-add latency
+    for (size_t i = 0; i < padded; i += batchSize)
+    {
+        simd::Float4 xa = simd::load(cx + i), xb = simd::load(cx + i + 4);
+        simd::Float4 ya = simd::load(cy + i), yb = simd::load(cy + i + 4);
+        simd::Float4 za = simd::load(cz + i), zb = simd::load(cz + i + 4);
+        simd::Float4 negRa = simd::sub(simd::set1(0.0f), simd::load(cr + i));
+        simd::Float4 negRb = simd::sub(simd::set1(0.0f), simd::load(cr + i + 4));
+
+        simd::Float4 inA = simd::set1(0.0f), inB = simd::set1(0.0f);
+        for (int p = 0; p < Frustum::Count; p++)
+        {
+            simd::Float4 da = simd::madd(xa, nx[p], simd::madd(ya, ny[p], simd::madd(za, nz[p], nw[p])));
+            simd::Float4 db = simd::madd(xb, nx[p], simd::madd(yb, ny[p], simd::madd(zb, nz[p], nw[p])));
+
+            // lanes collect a sign bit for every plane the sphere is fully behind
+            inA = simd::bitOr(inA, simd::cmplt(da, negRa));
+            inB = simd::bitOr(inB, simd::cmplt(db, negRb));
+        }
+
+        uint32_t culled = simd::movemask(inA) | (simd::movemask(inB) << 4);
+        uint32_t pass = ~culled & 0xffu;
+
+        // branchless compaction, always store and only advance on a visible bit
+        for (uint32_t lane = 0; lane < batchSize; lane++)
+        {
+            out[visibleCount] = static_cast<uint32_t>(i) + lane;
+            visibleCount += (pass >> lane) & 1u;
+        }
+    }
+
+    visible.resize(visibleCount);
+    return visible;
+}
@@ -0,0 +1,63 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_FRUSTUMCULLER_H
+#define PI_GAME_FRUSTUMCULLER_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Six normalized planes (xyz = inward normal, w = distance) pulled straight
+// out of a Projection * View matrix (Gribb/Hartmann).
+struct Frustum
+{
+    enum Plane { Left, Right, Bottom, Top, Near, Far, Count };
+
+    glm::vec4 planes[Count];
+
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+// Bounding spheres kept as structure of arrays so four objects are tested
+// against a plane with a single SIMD multiply-add chain. cull() returns the
+// indices of the visible objects packed together, ready for the draw path.
+class FrustumCuller {
+public:
+    uint32_t add(const glm::vec3& center, float radius);
+    void set(uint32_t index, const glm::vec3& center, float radius);
+    void clear();
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const std::vector<uint32_t>& cull(const glm::mat4& viewProjection);
+    const std::vector<uint32_t>& cull(const Frustum& frustum);
+
+    const std::vector<uint32_t>& getVisible() const
+    {
+        return visible;
+    }
+
+private:
+    void resizeArrays(size_t newCount);
+
+    // arrays are padded to a multiple of 8 with spheres that never pass
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+    size_t count = 0;
+
+    std::vector<uint32_t> visible;
+};
+
+
+#endif //PI_GAME_FRUSTUMCULLER_H
@@ -0,0 +1,876 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include "GLRecorder.h"
+
+#ifdef PIGAME_GL_RECORDER
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <EGL/egl.h>
+#include "GLTrace.h"
+
+using GLTrace::Op;
+
+namespace {
+    constexpr size_t flushThreshold = size_t(1) << 20;
+
+    struct Mapping
+    {
+        void* pointer;
+        GLsizeiptr length;
+        GLbitfield access;
+    };
+
+    FILE* file = nullptr;
+    std::vector<uint8_t> pending;
+    uint32_t framesLeft = 0;
+    bool limited = false;
+
+    GLint unpackAlignment = 4;
+    std::unordered_map<GLenum, Mapping> mappings;
+
+    void flush()
+    {
+        if (!pending.empty())
+            fwrite(pending.data(), 1, pending.size(), file);
+        pending.clear();
+    }
+
+    template<typename T>
+    void put(T value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        pending.insert(pending.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putData(const void* data, size_t size)
+    {
+        put(static_cast<uint32_t>(size));
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        pending.insert(pending.end(), bytes, bytes + size);
+    }
+
+    void putString(const char* s)
+    {
+        putData(s, strlen(s));
+    }
+
+    void op(Op code)
+    {
+        if (pending.size() >= flushThreshold)
+            flush();
+        put(static_cast<uint8_t>(code));
+    }
+
+    void putNames(Op code, GLsizei n, const GLuint* names)
+    {
+        op(code);
+        put(static_cast<uint32_t>(n));
+        for (GLsizei i = 0; i < n; i++)
+            put(names[i]);
+    }
+
+    uint64_t offsetOf(const void* pointer)
+    {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pointer));
+    }
+}
+
+bool GLRecorder::isAvailable()
+{
+    return true;
+}
+
+bool GLRecorder::isRecording()
+{
+    return file != nullptr;
+}
+
+bool GLRecorder::start(const std::string& path, uint32_t width, uint32_t height, uint32_t maxFrames)
+{
+    if (file)
+        return false;
+
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    GLTrace::Header header { GLTrace::magic, GLTrace::version, width, height };
+    fwrite(&header, sizeof(header), 1, file);
+
+    pending.reserve(flushThreshold + (size_t(64) << 10));
+    framesLeft = maxFrames;
+    limited = maxFrames > 0;
+    return true;
+}
+
+void GLRecorder::stop()
+{
+    if (!file)
+        return;
+
+    flush();
+    fclose(file);
+    file = nullptr;
+    mappings.clear();
+}
+
+// The wrappers. Each one calls through to the driver first, so results the
+// trace needs (generated names, locations) are already known, and records
+// only while a recording is running. The list of wrapped functions has to
+// match PIGAME_GL_WRAPPED in CMakeLists.txt.
+extern "C" {
+
+#define GL_WRAP(ret, name, params) \
+    ret __real_##name params; \
+    ret __wrap_##name params
+
+GL_WRAP(EGLBoolean, eglSwapBuffers, (EGLDisplay display, EGLSurface surface))
+{
+    if (file)
+    {
+        op(Op::Frame);
+        if (limited && --framesLeft == 0)
+            GLRecorder::stop();
+    }
+    return __real_eglSwapBuffers(display, surface);
+}
+
+GL_WRAP(void, glGenBuffers, (GLsizei n, GLuint* buffers))
+{
+    __real_glGenBuffers(n, buffers);
+    if (file)
+        putNames(Op::GenBuffers, n, buffers);
+}
+
+GL_WRAP(void, glDeleteBuffers, (GLsizei n, const GLuint* buffers))
+{
+    __real_glDeleteBuffers(n, buffers);
+    if (file)
+        putNames(Op::DeleteBuffers, n, buffers);
+}
+
+GL_WRAP(void, glBindBuffer, (GLenum target, GLuint buffer))
+{
+    __real_glBindBuffer(target, buffer);
+    if (!file)
+        return;
+    op(Op::BindBuffer);
+    put(target);
+    put(buffer);
+}
+
+GL_WRAP(void, glBindBufferBase, (GLenum target, GLuint index, GLuint buffer))
+{
+    __real_glBindBufferBase(target, index, buffer);
+    if (!file)
+        return;
+    op(Op::BindBufferBase);
+    put(target);
+    put(index);
+    put(buffer);
+}
+
+GL_WRAP(void, glBufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage))
+{
+    __real_glBufferData(target, size, data, usage);
+    if (!file)
+        return;
+    op(Op::BufferData);
+    put(target);
+    put(usage);
+    put(static_cast<uint64_t>(size));
+    put(static_cast<uint8_t>(data != nullptr));
+    if (data)
+        putData(data, static_cast<size_t>(size));
+}
+
+GL_WRAP(void, glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data))
+{
+    __real_glBufferSubData(target, offset, size, data);
+    if (!file)
+        return;
+    op(Op::BufferSubData);
+    put(target);
+    put(static_cast<uint64_t>(offset));
+    putData(data, static_cast<size_t>(size));
+}
+
+GL_WRAP(void*, glMapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access))
+{
+    void* pointer = __real_glMapBufferRange(target, offset, length, access);
+    if (!file || !pointer)
+        return pointer;
+    mappings[target] = { pointer, length, access };
+    op(Op::MapBufferRange);
+    put(target);
+    put(static_cast<uint64_t>(offset));
+    put(static_cast<uint64_t>(length));
+    put(access);
+    return pointer;
+}
+
+GL_WRAP(GLboolean, glUnmapBuffer, (GLenum target))
+{
+    // the contents have to be taken while the mapping is still valid
+    if (file)
+    {
+        auto it = mappings.find(target);
+        if (it != mappings.end())
+        {
+            op(Op::UnmapBuffer);
+            put(target);
+            if (it->second.access & GL_MAP_WRITE_BIT)
+                putData(it->second.pointer, static_cast<size_t>(it->second.length));
+            else
+                putData(nullptr, 0);
+            mappings.erase(it);
+        }
+    }
+    return __real_glUnmapBuffer(target);
+}
+
+GL_WRAP(void, glGenVertexArrays, (GLsizei n, GLuint* arrays))
+{
+    __real_glGenVertexArrays(n, arrays);
+    if (file)
+        putNames(Op::GenVertexArrays, n, arrays);
+}
+
+GL_WRAP(void, glDeleteVertexArrays, (GLsizei n, const GLuint* arrays))
+{
+    __real_glDeleteVertexArrays(n, arrays);
+    if (file)
+        putNames(Op::DeleteVertexArrays, n, arrays);
+}
+
+GL_WRAP(void, glBindVertexArray, (GLuint array))
+{
+    __real_glBindVertexArray(array);
+    if (!file)
+        return;
+    op(Op::BindVertexArray);
+    put(array);
+}
+
+GL_WRAP(void, glEnableVertexAttribArray, (GLuint index))
+{
+    __real_glEnableVertexAttribArray(index);
+    if (!file)
+        return;
+    op(Op::EnableVertexAttribArray);
+    put(index);
+}
+
+GL_WRAP(void, glDisableVertexAttribArray, (GLuint index))
+{
+    __real_glDisableVertexAttribArray(index);
+    if (!file)
+        return;
+    op(Op::DisableVertexAttribArray);
+    put(index);
+}
+
+GL_WRAP(void, glVertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                      const void* pointer))
+{
+    __real_glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    if (!file)
+        return;
+    // always an offset into the bound GL_ARRAY_BUFFER, client arrays are not used
+    op(Op::VertexAttribPointer);
+    put(index);
+    put(size);
+    put(type);
+    put(static_cast<uint8_t>(normalized));
+    put(stride);
+    put(offsetOf(pointer));
+}
+
+GL_WRAP(void, glVertexAttribDivisor, (GLuint index, GLuint divisor))
+{
+    __real_glVertexAttribDivisor(index, divisor);
+    if (!file)
+        return;
+    op(Op::VertexAttribDivisor);
+    put(index);
+    put(divisor);
+}
+
+GL_WRAP(GLuint, glCreateShader, (GLenum type))
+{
+    GLuint shader = __real_glCreateShader(type);
+    if (!file)
+        return shader;
+    op(Op::CreateShader);
+    put(type);
+    put(shader);
+    return shader;
+}
+
+GL_WRAP(void, glDeleteShader, (GLuint shader))
+{
+    __real_glDeleteShader(shader);
+    if (!file)
+        return;
+    op(Op::DeleteShader);
+    put(shader);
+}
+
+GL_WRAP(void, glShaderSource, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length))
+{
+    __real_glShaderSource(shader, count, string, length);
+    if (!file)
+        return;
+
+    // stored as one string, the replayer passes it as a single source
+    std::string source;
+    for (GLsizei i = 0; i < count; i++)
+    {
+        if (length && length[i] >= 0)
+            source.append(string[i], static_cast<size_t>(length[i]));
+        else
+            source.append(string[i]);
+    }
+    op(Op::ShaderSource);
+    put(shader);
+    putData(source.data(), source.size());
+}
+
+GL_WRAP(void, glCompileShader, (GLuint shader))
+{
+    __real_glCompileShader(shader);
+    if (!file)
+        return;
+    op(Op::CompileShader);
+    put(shader);
+}
+
+GL_WRAP(GLuint, glCreateProgram, (void))
+{
+    GLuint program = __real_glCreateProgram();
+    if (!file)
+        return program;
+    op(Op::CreateProgram);
+    put(program);
+    return program;
+}
+
+GL_WRAP(void, glDeleteProgram, (GLuint program))
+{
+    __real_glDeleteProgram(program);
+    if (!file)
+        return;
+    op(Op::DeleteProgram);
+    put(program);
+}
+
+GL_WRAP(void, glAttachShader, (GLuint program, GLuint shader))
+{
+    __real_glAttachShader(program, shader);
+    if (!file)
+        return;
+    op(Op::AttachShader);
+    put(program);
+    put(shader);
+}
+
+GL_WRAP(void, glDetachShader, (GLuint program, GLuint shader))
+{
+    __real_glDetachShader(program, shader);
+    if (!file)
+        return;
+    op(Op::DetachShader);
+    put(program);
+    put(shader);
+}
+
+GL_WRAP(void, glBindAttribLocation, (GLuint program, GLuint index, const GLchar* name))
+{
+    __real_glBindAttribLocation(program, index, name);
+    if (!file)
+        return;
+    op(Op::BindAttribLocation);
+    put(program);
+    put(index);
+    putString(name);
+}
+
+GL_WRAP(void, glLinkProgram, (GLuint program))
+{
+    __real_glLinkProgram(program);
+    if (!file)
+        return;
+    op(Op::LinkProgram);
+    put(program);
+}
+
+GL_WRAP(void, glUseProgram, (GLuint program))
+{
+    __real_glUseProgram(program);
+    if (!file)
+        return;
+    op(Op::UseProgram);
+    put(program);
+}
+
+GL_WRAP(GLint, glGetUniformLocation, (GLuint program, const GLchar* name))
+{
+    GLint location = __real_glGetUniformLocation(program, name);
+    if (!file)
+        return location;
+    op(Op::GetUniformLocation);
+    put(program);
+    putString(name);
+    put(location);
+    return location;
+}
+
+GL_WRAP(GLuint, glGetUniformBlockIndex, (GLuint program, const GLchar* uniformBlockName))
+{
+    GLuint index = __real_glGetUniformBlockIndex(program, uniformBlockName);
+    if (!file)
+        return index;
+    op(Op::GetUniformBlockIndex);
+    put(program);
+    putString(uniformBlockName);
+    put(index);
+    return index;
+}
+
+GL_WRAP(void, glUniformBlockBinding, (GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding))
+{
+    __real_glUniformBlockBinding(program, uniformBlockIndex, uniformBlockBinding);
+    if (!file)
+        return;
+    op(Op::UniformBlockBinding);
+    put(program);
+    put(uniformBlockIndex);
+    put(uniformBlockBinding);
+}
+
+GL_WRAP(void, glUniform1i, (GLint location, GLint v0))
+{
+    __real_glUniform1i(location, v0);
+    if (!file)
+        return;
+    op(Op::Uniform1i);
+    put(location);
+    put(v0);
+}
+
+GL_WRAP(void, glUniform2f, (GLint location, GLfloat v0, GLfloat v1))
+{
+    __real_glUniform2f(location, v0, v1);
+    if (!file)
+        return;
+    op(Op::Uniform2f);
+    put(location);
+    put(v0);
+    put(v1);
+}
+
+GL_WRAP(void, glUniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2))
+{
+    __real_glUniform3f(location, v0, v1, v2);
+    if (!file)
+        return;
+    op(Op::Uniform3f);
+    put(location);
+    put(v0);
+    put(v1);
+    put(v2);
+}
+
+GL_WRAP(void, glUniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3))
+{
+    __real_glUniform4f(location, v0, v1, v2, v3);
+    if (!file)
+        return;
+    op(Op::Uniform4f);
+    put(location);
+    put(v0);
+    put(v1);
+    put(v2);
+    put(v3);
+}
+
+GL_WRAP(void, glUniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value))
+{
+    __real_glUniformMatrix4fv(location, count, transpose, value);
+    if (!file)
+        return;
+    op(Op::UniformMatrix4fv);
+    put(location);
+    put(count);
+    put(static_cast<uint8_t>(transpose));
+    putData(value, static_cast<size_t>(count) * 16 * sizeof(GLfloat));
+}
+
+GL_WRAP(void, glGenTextures, (GLsizei n, GLuint* textures))
+{
+    __real_glGenTextures(n, textures);
+    if (file)
+        putNames(Op::GenTextures, n, textures);
+}
+
+GL_WRAP(void, glDeleteTextures, (GLsizei n, const GLuint* textures))
+{
+    __real_glDeleteTextures(n, textures);
+    if (file)
+        putNames(Op::DeleteTextures, n, textures);
+}
+
+GL_WRAP(void, glActiveTexture, (GLenum texture))
+{
+    __real_glActiveTexture(texture);
+    if (!file)
+        return;
+    op(Op::ActiveTexture);
+    put(texture);
+}
+
+GL_WRAP(void, glBindTexture, (GLenum target, GLuint texture))
+{
+    __real_glBindTexture(target, texture);
+    if (!file)
+        return;
+    op(Op::BindTexture);
+    put(target);
+    put(texture);
+}
+
+GL_WRAP(void, glTexParameteri, (GLenum target, GLenum pname, GLint param))
+{
+    __real_glTexParameteri(target, pname, param);
+    if (!file)
+        return;
+    op(Op::TexParameteri);
+    put(target);
+    put(pname);
+    put(param);
+}
+
+GL_WRAP(void, glTexStorage2D, (GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height))
+{
+    __real_glTexStorage2D(target, levels, internalformat, width, height);
+    if (!file)
+        return;
+    op(Op::TexStorage2D);
+    put(target);
+    put(levels);
+    put(internalformat);
+    put(width);
+    put(height);
+}
+
+GL_WRAP(void, glTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
+                                GLsizei height, GLenum format, GLenum type, const void* pixels))
+{
+    __real_glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+    if (!file)
+        return;
+    op(Op::TexSubImage2D);
+    put(target);
+    put(level);
+    put(xoffset);
+    put(yoffset);
+    put(width);
+    put(height);
+    put(format);
+    put(type);
+    putData(pixels, pixels ? GLTrace::imageSize(width, height, format, type, unpackAlignment) : 0);
+}
+
+GL_WRAP(void, glCompressedTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
+                                          GLsizei height, GLenum format, GLsizei imageSize, const void* data))
+{
+    __real_glCompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, imageSize, data);
+    if (!file)
+        return;
+    op(Op::CompressedTexSubImage2D);
+    put(target);
+    put(level);
+    put(xoffset);
+    put(yoffset);
+    put(width);
+    put(height);
+    put(format);
+    putData(data, static_cast<size_t>(imageSize));
+}
+
+GL_WRAP(void, glPixelStorei, (GLenum pname, GLint param))
+{
+    __real_glPixelStorei(pname, param);
+    if (pname == GL_UNPACK_ALIGNMENT)
+        unpackAlignment = param;
+    if (!file)
+        return;
+    op(Op::PixelStorei);
+    put(pname);
+    put(param);
+}
+
+GL_WRAP(void, glGenFramebuffers, (GLsizei n, GLuint* framebuffers))
+{
+    __real_glGenFramebuffers(n, framebuffers);
+    if (file)
+        putNames(Op::GenFramebuffers, n, framebuffers);
+}
+
+GL_WRAP(void, glDeleteFramebuffers, (GLsizei n, const GLuint* framebuffers))
+{
+    __real_glDeleteFramebuffers(n, framebuffers);
+    if (file)
+        putNames(Op::DeleteFramebuffers, n, framebuffers);
+}
+
+GL_WRAP(void, glBindFramebuffer, (GLenum target, GLuint framebuffer))
+{
+    __real_glBindFramebuffer(target, framebuffer);
+    if (!file)
+        return;
+    op(Op::BindFramebuffer);
+    put(target);
+    put(framebuffer);
+}
+
+GL_WRAP(void, glGenRenderbuffers, (GLsizei n, GLuint* renderbuffers))
+{
+    __real_glGenRenderbuffers(n, renderbuffers);
+    if (file)
+        putNames(Op::GenRenderbuffers, n, renderbuffers);
+}
+
+GL_WRAP(void, glDeleteRenderbuffers, (GLsizei n, const GLuint* renderbuffers))
+{
+    __real_glDeleteRenderbuffers(n, renderbuffers);
+    if (file)
+        putNames(Op::DeleteRenderbuffers, n, renderbuffers);
+}
+
+GL_WRAP(void, glBindRenderbuffer, (GLenum target, GLuint renderbuffer))
+{
+    __real_glBindRenderbuffer(target, renderbuffer);
+    if (!file)
+        return;
+    op(Op::BindRenderbuffer);
+    put(target);
+    put(renderbuffer);
+}
+
+GL_WRAP(void, glRenderbufferStorage, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height))
+{
+    __real_glRenderbufferStorage(target, internalformat, width, height);
+    if (!file)
+        return;
+    op(Op::RenderbufferStorage);
+    put(target);
+    put(internalformat);
+    put(width);
+    put(height);
+}
+
+GL_WRAP(void, glFramebufferRenderbuffer, (GLenum target, GLenum attachment, GLenum renderbuffertarget,
+                                          GLuint renderbuffer))
+{
+    __real_glFramebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer);
+    if (!file)
+        return;
+    op(Op::FramebufferRenderbuffer);
+    put(target);
+    put(attachment);
+    put(renderbuffertarget);
+    put(renderbuffer);
+}
+
+GL_WRAP(void, glInvalidateFramebuffer, (GLenum target, GLsizei numAttachments, const GLenum* attachments))
+{
+    __real_glInvalidateFramebuffer(target, numAttachments, attachments);
+    if (!file)
+        return;
+    op(Op::InvalidateFramebuffer);
+    put(target);
+    putData(attachments, static_cast<size_t>(numAttachments) * sizeof(GLenum));
+}
+
+GL_WRAP(void, glBlitFramebuffer, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0,
+                                  GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter))
+{
+    __real_glBlitFramebuffer(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+    if (!file)
+        return;
+    op(Op::BlitFramebuffer);
+    put(srcX0);
+    put(srcY0);
+    put(srcX1);
+    put(srcY1);
+    put(dstX0);
+    put(dstY0);
+    put(dstX1);
+    put(dstY1);
+    put(mask);
+    put(filter);
+}
+
+GL_WRAP(void, glViewport, (GLint x, GLint y, GLsizei width, GLsizei height))
+{
+    __real_glViewport(x, y, width, height);
+    if (!file)
+        return;
+    op(Op::Viewport);
+    put(x);
+    put(y);
+    put(width);
+    put(height);
+}
+
+GL_WRAP(void, glClearColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha))
+{
+    __real_glClearColor(red, green, blue, alpha);
+    if (!file)
+        return;
+    op(Op::ClearColor);
+    put(red);
+    put(green);
+    put(blue);
+    put(alpha);
+}
+
+GL_WRAP(void, glClear, (GLbitfield mask))
+{
+    __real_glClear(mask);
+    if (!file)
+        return;
+    op(Op::Clear);
+    put(mask);
+}
+
+GL_WRAP(void, glDrawElements, (GLenum mode, GLsizei count, GLenum type, const void* indices))
+{
+    __real_glDrawElements(mode, count, type, indices);
+    if (!file)
+        return;
+    op(Op::DrawElements);
+    put(mode);
+    put(count);
+    put(type);
+    put(offsetOf(indices));
+}
+
+GL_WRAP(void, glDrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                        GLsizei instancecount))
+{
+    __real_glDrawElementsInstanced(mode, count, type, indices, instancecount);
+    if (!file)
+        return;
+    op(Op::DrawElementsInstanced);
+    put(mode);
+    put(count);
+    put(type);
+    put(offsetOf(indices));
+    put(instancecount);
+}
+
+GL_WRAP(void, glEnable, (GLenum cap))
+{
+    __real_glEnable(cap);
+    if (!file)
+        return;
+    op(Op::Enable);
+    put(cap);
+}
+
+GL_WRAP(void, glDisable, (GLenum cap))
+{
+    __real_glDisable(cap);
+    if (!file)
+        return;
+    op(Op::Disable);
+    put(cap);
+}
+
+GL_WRAP(void, glColorMask, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha))
+{
+    __real_glColorMask(red, green, blue, alpha);
+    if (!file)
+        return;
+    op(Op::ColorMask);
+    put(static_cast<uint8_t>(red));
+    put(static_cast<uint8_t>(green));
+    put(static_cast<uint8_t>(blue));
+    put(static_cast<uint8_t>(alpha));
+}
+
+GL_WRAP(void, glDepthMask, (GLboolean flag))
+{
+    __real_glDepthMask(flag);
+    if (!file)
+        return;
+    op(Op::DepthMask);
+    put(static_cast<uint8_t>(flag));
+}
+
+GL_WRAP(void, glGenQueries, (GLsizei n, GLuint* ids))
+{
+    __real_glGenQueries(n, ids);
+    if (file)
+        putNames(Op::GenQueries, n, ids);
+}
+
+GL_WRAP(void, glDeleteQueries, (GLsizei n, const GLuint* ids))
+{
+    __real_glDeleteQueries(n, ids);
+    if (file)
+        putNames(Op::DeleteQueries, n, ids);
+}
+
+GL_WRAP(void, glBeginQuery, (GLenum target, GLuint id))
+{
+    __real_glBeginQuery(target, id);
+    if (!file)
+        return;
+    op(Op::BeginQuery);
+    put(target);
+    put(id);
+}
+
+GL_WRAP(void, glEndQuery, (GLenum target))
+{
+    __real_glEndQuery(target);
+    if (!file)
+        return;
+    op(Op::EndQuery);
+    put(target);
+}
+
+#undef GL_WRAP
+
+}
+
+#else
+
+bool GLRecorder::isAvailable()
+{
+    return false;
+}
+
+bool GLRecorder::isRecording()
+{
+    return false;
+}
+
+bool GLRecorder::start(const std::string&, uint32_t, uint32_t, uint32_t)
+{
+    return false;
+}
+
+void GLRecorder::stop()
+{
+}
+
+#endif
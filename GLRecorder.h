@@ -0,0 +1,28 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_GLRECORDER_H
+#define PI_GAME_GLRECORDER_H
+
+#include <cstdint>
+#include <string>
+
+// Records the GL command stream with all buffer and texture data into a
+// GLTrace file for pigame_replay. Built with PIGAME_GL_RECORDER the GL entry
+// points the engine uses are wrapped at link time (-Wl,--wrap), so call sites
+// stay plain GL. Without it start() just returns false.
+// Replay starts from a fresh context, so start() has to come before the
+// first GL object is created. GL thread only.
+namespace GLRecorder {
+    bool isAvailable();
+
+    // maxFrames > 0 stops by itself after that many eglSwapBuffers
+    bool start(const std::string& path, uint32_t width, uint32_t height, uint32_t maxFrames = 0);
+    void stop();
+
+    bool isRecording();
+}
+
+
+#endif //PI_GAME_GLRECORDER_H
@@ -0,0 +1,780 @@
+//
+// Created by APel on 19/10/26.
+//
+
+// pigame_replay: plays a GLRecorder trace on a headless EGL context as fast
+// as the driver goes and reports how long every frame took, so driver and
+// engine changes can be compared on the same captured workload without a
+// display attached.
+//
+//   pigame_replay trace.bin [--device /dev/dri/renderD128] [--skip N] [--csv frames.csv]
+//
+// Each frame is timed from its first command to the end of a glFinish()
+// after its last one. The default framebuffer of the recording becomes an
+// offscreen target of the same size.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gbm.h>
+#include <EGL/egl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "GLTrace.h"
+
+using GLTrace::Op;
+using GLTrace::Reader;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using NameMap = std::unordered_map<GLuint, GLuint>;
+
+    struct FrameTiming
+    {
+        double submitMs;    // issuing the commands
+        double totalMs;     // until the GPU was done with them
+    };
+
+    double toMs(Clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    // read only view of the trace file
+    class MappedFile {
+    public:
+        explicit MappedFile(const char* path)
+        {
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error(std::string("Failed to open ") + path);
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(GLTrace::Header)))
+            {
+                close(fd);
+                throw std::runtime_error(std::string(path) + " is not a GL trace");
+            }
+
+            size = static_cast<size_t>(st.st_size);
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED)
+                throw std::runtime_error(std::string("Failed to map ") + path);
+
+            data = static_cast<const uint8_t*>(p);
+            madvise(p, size, MADV_SEQUENTIAL);
+        }
+
+        ~MappedFile()
+        {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    // GLES 3 context on a DRM render node, no surface at all
+    class HeadlessContext {
+    public:
+        explicit HeadlessContext(const char* device)
+        {
+            fd = open(device, O_RDWR | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error(std::string("Failed to open ") + device);
+
+            gbmDevice = gbm_create_device(fd);
+            if (gbmDevice == nullptr)
+                throw std::runtime_error("Failed creating the GBM device");
+
+            display = eglGetDisplay(gbmDevice);
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+                throw std::runtime_error("Failed creating the EGL display");
+
+            const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+            if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+                throw std::runtime_error("EGL_KHR_surfaceless_context is not supported");
+
+            eglBindAPI(EGL_OPENGL_ES_API);
+            const EGLint attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE };
+            EGLConfig config;
+            EGLint numConfig = 0;
+            if (!eglChooseConfig(display, attributes, &config, 1, &numConfig) || numConfig == 0)
+                throw std::runtime_error("Failed getting a matching EGL config");
+
+            const EGLint contextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+            if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+                throw std::runtime_error("Failed creating a surfaceless GLES 3 context");
+
+            printf("%s \n", glGetString(GL_RENDERER));
+            printf("%s \n", glGetString(GL_VERSION));
+        }
+
+        ~HeadlessContext()
+        {
+            if (display != EGL_NO_DISPLAY)
+            {
+                eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                if (context != EGL_NO_CONTEXT)
+                    eglDestroyContext(display, context);
+                eglTerminate(display);
+            }
+            if (gbmDevice)
+                gbm_device_destroy(gbmDevice);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        HeadlessContext(const HeadlessContext&) = delete;
+        HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    private:
+        int fd = -1;
+        struct gbm_device* gbmDevice = nullptr;
+        EGLDisplay display = EGL_NO_DISPLAY;
+        EGLContext context = EGL_NO_CONTEXT;
+    };
+
+    // Turns the recorded commands back into GL calls, with every object name
+    // and uniform location translated to what this driver handed out.
+    class Replayer {
+    public:
+        Replayer(uint32_t width, uint32_t height)
+        {
+            const GLsizei w = static_cast<GLsizei>(width);
+            const GLsizei h = static_cast<GLsizei>(height);
+
+            glGenRenderbuffers(1, &screenColor);
+            glBindRenderbuffer(GL_RENDERBUFFER, screenColor);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+            glGenRenderbuffers(1, &screenDepth);
+            glBindRenderbuffer(GL_RENDERBUFFER, screenDepth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            glGenFramebuffers(1, &screen);
+            glBindFramebuffer(GL_FRAMEBUFFER, screen);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, screenColor);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, screenDepth);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                throw std::runtime_error("Replay screen framebuffer is incomplete");
+            glViewport(0, 0, w, h);
+        }
+
+        ~Replayer()
+        {
+            glDeleteFramebuffers(1, &screen);
+            glDeleteRenderbuffers(1, &screenColor);
+            glDeleteRenderbuffers(1, &screenDepth);
+        }
+
+        Replayer(const Replayer&) = delete;
+        Replayer& operator=(const Replayer&) = delete;
+
+        // returns true when the command ended a frame
+        bool execute(Op op, Reader& in);
+
+    private:
+        static GLuint lookup(const NameMap& names, GLuint recorded)
+        {
+            if (recorded == 0)
+                return 0;
+            auto it = names.find(recorded);
+            return it != names.end() ? it->second : 0;
+        }
+
+        static void generate(NameMap& names, Reader& in, void (*gen)(GLsizei, GLuint*))
+        {
+            const uint32_t n = in.get<uint32_t>();
+            for (uint32_t i = 0; i < n; i++)
+            {
+                GLuint name = 0;
+                gen(1, &name);
+                names[in.get<GLuint>()] = name;
+            }
+        }
+
+        static void remove(NameMap& names, Reader& in, void (*del)(GLsizei, const GLuint*))
+        {
+            const uint32_t n = in.get<uint32_t>();
+            for (uint32_t i = 0; i < n; i++)
+            {
+                auto it = names.find(in.get<GLuint>());
+                if (it == names.end())
+                    continue;
+                del(1, &it->second);
+                names.erase(it);
+            }
+        }
+
+        static uint64_t key(GLuint program, uint32_t value)
+        {
+            return (static_cast<uint64_t>(program) << 32) | value;
+        }
+
+        GLint location(GLint recorded) const
+        {
+            if (recorded < 0)
+                return -1;
+            auto it = uniformLocations.find(key(currentProgram, static_cast<uint32_t>(recorded)));
+            return it != uniformLocations.end() ? it->second : -1;
+        }
+
+        GLuint framebuffer(GLuint recorded) const
+        {
+            return recorded == 0 ? screen : lookup(framebuffers, recorded);
+        }
+
+        static const void* offset(uint64_t value)
+        {
+            return reinterpret_cast<const void*>(static_cast<uintptr_t>(value));
+        }
+
+        NameMap buffers;
+        NameMap vertexArrays;
+        NameMap textures;
+        NameMap framebuffers;
+        NameMap renderbuffers;
+        NameMap shaders;
+        NameMap programs;
+        NameMap queries;
+
+        // keyed by recorded program and recorded location / block index
+        std::unordered_map<uint64_t, GLint> uniformLocations;
+        std::unordered_map<uint64_t, GLuint> blockIndices;
+        GLuint currentProgram = 0;
+
+        std::unordered_map<GLenum, void*> mapped;
+
+        GLuint screen = 0;
+        GLuint screenColor = 0;
+        GLuint screenDepth = 0;
+    };
+
+    bool Replayer::execute(Op op, Reader& in)
+    {
+        uint32_t size = 0;
+        switch (op)
+        {
+            case Op::Frame:
+                return true;
+
+            case Op::GenBuffers: generate(buffers, in, glGenBuffers); break;
+            case Op::DeleteBuffers: remove(buffers, in, glDeleteBuffers); break;
+            case Op::BindBuffer:
+            {
+                GLenum target = in.get<GLenum>();
+                glBindBuffer(target, lookup(buffers, in.get<GLuint>()));
+                break;
+            }
+            case Op::BindBufferBase:
+            {
+                GLenum target = in.get<GLenum>();
+                GLuint index = in.get<GLuint>();
+                glBindBufferBase(target, index, lookup(buffers, in.get<GLuint>()));
+                break;
+            }
+            case Op::BufferData:
+            {
+                GLenum target = in.get<GLenum>();
+                GLenum usage = in.get<GLenum>();
+                GLsizeiptr bytes = static_cast<GLsizeiptr>(in.get<uint64_t>());
+                const uint8_t* data = in.get<uint8_t>() ? in.data(size) : nullptr;
+                glBufferData(target, bytes, data, usage);
+                break;
+            }
+            case Op::BufferSubData:
+            {
+                GLenum target = in.get<GLenum>();
+                GLintptr at = static_cast<GLintptr>(in.get<uint64_t>());
+                const uint8_t* data = in.data(size);
+                glBufferSubData(target, at, static_cast<GLsizeiptr>(size), data);
+                break;
+            }
+            case Op::MapBufferRange:
+            {
+                GLenum target = in.get<GLenum>();
+                GLintptr at = static_cast<GLintptr>(in.get<uint64_t>());
+                GLsizeiptr length = static_cast<GLsizeiptr>(in.get<uint64_t>());
+                GLbitfield access = in.get<GLbitfield>();
+                mapped[target] = glMapBufferRange(target, at, length, access);
+                break;
+            }
+            case Op::UnmapBuffer:
+            {
+                GLenum target = in.get<GLenum>();
+                const uint8_t* data = in.data(size);
+                void* pointer = mapped[target];
+                if (pointer && size)
+                    memcpy(pointer, data, size);
+                glUnmapBuffer(target);
+                mapped.erase(target);
+                break;
+            }
+
+            case Op::GenVertexArrays: generate(vertexArrays, in, glGenVertexArrays); break;
+            case Op::DeleteVertexArrays: remove(vertexArrays, in, glDeleteVertexArrays); break;
+            case Op::BindVertexArray: glBindVertexArray(lookup(vertexArrays, in.get<GLuint>())); break;
+            case Op::EnableVertexAttribArray: glEnableVertexAttribArray(in.get<GLuint>()); break;
+            case Op::DisableVertexAttribArray: glDisableVertexAttribArray(in.get<GLuint>()); break;
+            case Op::VertexAttribPointer:
+            {
+                GLuint index = in.get<GLuint>();
+                GLint components = in.get<GLint>();
+                GLenum type = in.get<GLenum>();
+                GLboolean normalized = in.get<uint8_t>();
+                GLsizei stride = in.get<GLsizei>();
+                glVertexAttribPointer(index, components, type, normalized, stride, offset(in.get<uint64_t>()));
+                break;
+            }
+            case Op::VertexAttribDivisor:
+            {
+                GLuint index = in.get<GLuint>();
+                glVertexAttribDivisor(index, in.get<GLuint>());
+                break;
+            }
+
+            case Op::CreateShader:
+            {
+                GLenum type = in.get<GLenum>();
+                shaders[in.get<GLuint>()] = glCreateShader(type);
+                break;
+            }
+            case Op::DeleteShader:
+            {
+                GLuint recorded = in.get<GLuint>();
+                glDeleteShader(lookup(shaders, recorded));
+                shaders.erase(recorded);
+                break;
+            }
+            case Op::ShaderSource:
+            {
+                GLuint shader = lookup(shaders, in.get<GLuint>());
+                const GLchar* source = reinterpret_cast<const GLchar*>(in.data(size));
+                const GLint length = static_cast<GLint>(size);
+                glShaderSource(shader, 1, &source, &length);
+                break;
+            }
+            case Op::CompileShader: glCompileShader(lookup(shaders, in.get<GLuint>())); break;
+            case Op::CreateProgram: programs[in.get<GLuint>()] = glCreateProgram(); break;
+            case Op::DeleteProgram:
+            {
+                GLuint recorded = in.get<GLuint>();
+                glDeleteProgram(lookup(programs, recorded));
+                programs.erase(recorded);
+                break;
+            }
+            case Op::AttachShader:
+            case Op::DetachShader:
+            {
+                GLuint program = lookup(programs, in.get<GLuint>());
+                GLuint shader = lookup(shaders, in.get<GLuint>());
+                if (op == Op::AttachShader)
+                    glAttachShader(program, shader);
+                else
+                    glDetachShader(program, shader);
+                break;
+            }
+            case Op::BindAttribLocation:
+            {
+                GLuint program = lookup(programs, in.get<GLuint>());
+                GLuint index = in.get<GLuint>();
+                const uint8_t* name = in.data(size);
+                glBindAttribLocation(program, index, std::string(reinterpret_cast<const char*>(name), size).c_str());
+                break;
+            }
+            case Op::LinkProgram: glLinkProgram(lookup(programs, in.get<GLuint>())); break;
+            case Op::UseProgram:
+                currentProgram = in.get<GLuint>();
+                glUseProgram(lookup(programs, currentProgram));
+                break;
+            case Op::GetUniformLocation:
+            case Op::GetUniformBlockIndex:
+            {
+                GLuint recordedProgram = in.get<GLuint>();
+                const uint8_t* name = in.data(size);
+                std::string uniform(reinterpret_cast<const char*>(name), size);
+                GLuint program = lookup(programs, recordedProgram);
+                if (op == Op::GetUniformLocation)
+                {
+                    GLint recorded = in.get<GLint>();
+                    if (recorded >= 0)
+                        uniformLocations[key(recordedProgram, static_cast<uint32_t>(recorded))] =
+                                glGetUniformLocation(program, uniform.c_str());
+                }
+                else
+                {
+                    GLuint recorded = in.get<GLuint>();
+                    blockIndices[key(recordedProgram, recorded)] = glGetUniformBlockIndex(program, uniform.c_str());
+                }
+                break;
+            }
+            case Op::UniformBlockBinding:
+            {
+                GLuint recordedProgram = in.get<GLuint>();
+                GLuint recordedIndex = in.get<GLuint>();
+                GLuint binding = in.get<GLuint>();
+                auto it = blockIndices.find(key(recordedProgram, recordedIndex));
+                if (it != blockIndices.end() && it->second != GL_INVALID_INDEX)
+                    glUniformBlockBinding(lookup(programs, recordedProgram), it->second, binding);
+                break;
+            }
+            case Op::Uniform1i:
+            {
+                GLint loc = location(in.get<GLint>());
+                glUniform1i(loc, in.get<GLint>());
+                break;
+            }
+            case Op::Uniform2f:
+            {
+                GLint loc = location(in.get<GLint>());
+                GLfloat x = in.get<GLfloat>();
+                GLfloat y = in.get<GLfloat>();
+                glUniform2f(loc, x, y);
+                break;
+            }
+            case Op::Uniform3f:
+            {
+                GLint loc = location(in.get<GLint>());
+                GLfloat x = in.get<GLfloat>();
+                GLfloat y = in.get<GLfloat>();
+                GLfloat z = in.get<GLfloat>();
+                glUniform3f(loc, x, y, z);
+                break;
+            }
+            case Op::Uniform4f:
+            {
+                GLint loc = location(in.get<GLint>());
+                GLfloat x = in.get<GLfloat>();
+                GLfloat y = in.get<GLfloat>();
+                GLfloat z = in.get<GLfloat>();
+                GLfloat w = in.get<GLfloat>();
+                glUniform4f(loc, x, y, z, w);
+                break;
+            }
+            case Op::UniformMatrix4fv:
+            {
+                GLint loc = location(in.get<GLint>());
+                GLsizei count = in.get<GLsizei>();
+                GLboolean transpose = in.get<uint8_t>();
+                const uint8_t* values = in.data(size);
+                // the trace is not aligned, copy before handing it over as floats
+                GLfloat matrices[16 * 8];
+                if (size > sizeof(matrices))
+                    throw std::runtime_error("UniformMatrix4fv array too large to replay");
+                memcpy(matrices, values, size);
+                glUniformMatrix4fv(loc, count, transpose, matrices);
+                break;
+            }
+
+            case Op::GenTextures: generate(textures, in, glGenTextures); break;
+            case Op::DeleteTextures: remove(textures, in, glDeleteTextures); break;
+            case Op::ActiveTexture: glActiveTexture(in.get<GLenum>()); break;
+            case Op::BindTexture:
+            {
+                GLenum target = in.get<GLenum>();
+                glBindTexture(target, lookup(textures, in.get<GLuint>()));
+                break;
+            }
+            case Op::TexParameteri:
+            {
+                GLenum target = in.get<GLenum>();
+                GLenum pname = in.get<GLenum>();
+                glTexParameteri(target, pname, in.get<GLint>());
+                break;
+            }
+            case Op::TexStorage2D:
+            {
+                GLenum target = in.get<GLenum>();
+                GLsizei levels = in.get<GLsizei>();
+                GLenum format = in.get<GLenum>();
+                GLsizei w = in.get<GLsizei>();
+                GLsizei h = in.get<GLsizei>();
+                glTexStorage2D(target, levels, format, w, h);
+                break;
+            }
+            case Op::TexSubImage2D:
+            case Op::CompressedTexSubImage2D:
+            {
+                GLenum target = in.get<GLenum>();
+                GLint level = in.get<GLint>();
+                GLint x = in.get<GLint>();
+                GLint y = in.get<GLint>();
+                GLsizei w = in.get<GLsizei>();
+                GLsizei h = in.get<GLsizei>();
+                GLenum format = in.get<GLenum>();
+                if (op == Op::TexSubImage2D)
+                {
+                    GLenum type = in.get<GLenum>();
+                    const uint8_t* pixels = in.data(size);
+                    glTexSubImage2D(target, level, x, y, w, h, format, type, size ? pixels : nullptr);
+                }
+                else
+                {
+                    const uint8_t* data = in.data(size);
+                    glCompressedTexSubImage2D(target, level, x, y, w, h, format, static_cast<GLsizei>(size), data);
+                }
+                break;
+            }
+            case Op::PixelStorei:
+            {
+                GLenum pname = in.get<GLenum>();
+                glPixelStorei(pname, in.get<GLint>());
+                break;
+            }
+
+            case Op::GenFramebuffers: generate(framebuffers, in, glGenFramebuffers); break;
+            case Op::DeleteFramebuffers: remove(framebuffers, in, glDeleteFramebuffers); break;
+            case Op::BindFramebuffer:
+            {
+                GLenum target = in.get<GLenum>();
+                glBindFramebuffer(target, framebuffer(in.get<GLuint>()));
+                break;
+            }
+            case Op::GenRenderbuffers: generate(renderbuffers, in, glGenRenderbuffers); break;
+            case Op::DeleteRenderbuffers: remove(renderbuffers, in, glDeleteRenderbuffers); break;
+            case Op::BindRenderbuffer:
+            {
+                GLenum target = in.get<GLenum>();
+                glBindRenderbuffer(target, lookup(renderbuffers, in.get<GLuint>()));
+                break;
+            }
+            case Op::RenderbufferStorage:
+            {
+                GLenum target = in.get<GLenum>();
+                GLenum format = in.get<GLenum>();
+                GLsizei w = in.get<GLsizei>();
+                GLsizei h = in.get<GLsizei>();
+                glRenderbufferStorage(target, format, w, h);
+                break;
+            }
+            case Op::FramebufferRenderbuffer:
+            {
+                GLenum target = in.get<GLenum>();
+                GLenum attachment = in.get<GLenum>();
+                GLenum renderbufferTarget = in.get<GLenum>();
+                glFramebufferRenderbuffer(target, attachment, renderbufferTarget,
+                                          lookup(renderbuffers, in.get<GLuint>()));
+                break;
+            }
+            case Op::InvalidateFramebuffer:
+            {
+                GLenum target = in.get<GLenum>();
+                const uint8_t* data = in.data(size);
+                GLenum attachments[8];
+                GLsizei count = static_cast<GLsizei>(std::min<size_t>(size / sizeof(GLenum), 8));
+                memcpy(attachments, data, static_cast<size_t>(count) * sizeof(GLenum));
+                // the default framebuffer names its buffers differently from an FBO
+                for (GLsizei i = 0; i < count; i++)
+                {
+                    if (attachments[i] == GL_COLOR)
+                        attachments[i] = GL_COLOR_ATTACHMENT0;
+                    else if (attachments[i] == GL_DEPTH)
+                        attachments[i] = GL_DEPTH_ATTACHMENT;
+                    else if (attachments[i] == GL_STENCIL)
+                        attachments[i] = GL_STENCIL_ATTACHMENT;
+                }
+                glInvalidateFramebuffer(target, count, attachments);
+                break;
+            }
+            case Op::BlitFramebuffer:
+            {
+                GLint c[8];
+                for (GLint& v : c)
+                    v = in.get<GLint>();
+                GLbitfield mask = in.get<GLbitfield>();
+                GLenum filter = in.get<GLenum>();
+                glBlitFramebuffer(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], mask, filter);
+                break;
+            }
+
+            case Op::Viewport:
+            {
+                GLint x = in.get<GLint>();
+                GLint y = in.get<GLint>();
+                GLsizei w = in.get<GLsizei>();
+                GLsizei h = in.get<GLsizei>();
+                glViewport(x, y, w, h);
+                break;
+            }
+            case Op::ClearColor:
+            {
+                GLfloat r = in.get<GLfloat>();
+                GLfloat g = in.get<GLfloat>();
+                GLfloat b = in.get<GLfloat>();
+                GLfloat a = in.get<GLfloat>();
+                glClearColor(r, g, b, a);
+                break;
+            }
+            case Op::Clear: glClear(in.get<GLbitfield>()); break;
+            case Op::DrawElements:
+            case Op::DrawElementsInstanced:
+            {
+                GLenum mode = in.get<GLenum>();
+                GLsizei count = in.get<GLsizei>();
+                GLenum type = in.get<GLenum>();
+                const void* indices = offset(in.get<uint64_t>());
+                if (op == Op::DrawElements)
+                    glDrawElements(mode, count, type, indices);
+                else
+                    glDrawElementsInstanced(mode, count, type, indices, in.get<GLsizei>());
+                break;
+            }
+
+            case Op::Enable: glEnable(in.get<GLenum>()); break;
+            case Op::Disable: glDisable(in.get<GLenum>()); break;
+            case Op::ColorMask:
+            {
+                GLboolean r = in.get<uint8_t>();
+                GLboolean g = in.get<uint8_t>();
+                GLboolean b = in.get<uint8_t>();
+                GLboolean a = in.get<uint8_t>();
+                glColorMask(r, g, b, a);
+                break;
+            }
+            case Op::DepthMask: glDepthMask(in.get<uint8_t>()); break;
+            case Op::GenQueries: generate(queries, in, glGenQueries); break;
+            case Op::DeleteQueries: remove(queries, in, glDeleteQueries); break;
+            case Op::BeginQuery:
+            {
+                GLenum target = in.get<GLenum>();
+                glBeginQuery(target, lookup(queries, in.get<GLuint>()));
+                break;
+            }
+            case Op::EndQuery: glEndQuery(in.get<GLenum>()); break;
+
+            default:
+                throw std::runtime_error("Unknown op " + std::to_string(static_cast<unsigned>(op)) + " in GL trace");
+        }
+        return false;
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        std::sort(values.begin(), values.end());
+        size_t index = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+        return values[index];
+    }
+
+    void usage()
+    {
+        fprintf(stderr, "usage: pigame_replay trace.bin [--device /dev/dri/renderD128] [--skip N] [--csv frames.csv]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* tracePath = nullptr;
+    const char* device = "/dev/dri/renderD128";
+    const char* csvPath = nullptr;
+    size_t skip = 1;    // the first frame creates every resource
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--device" && i + 1 < argc)
+            device = argv[++i];
+        else if (arg == "--skip" && i + 1 < argc)
+            skip = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--csv" && i + 1 < argc)
+            csvPath = argv[++i];
+        else if (!tracePath && arg[0] != '-')
+            tracePath = argv[i];
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!tracePath)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        MappedFile trace(tracePath);
+        GLTrace::Header header;
+        memcpy(&header, trace.data, sizeof(header));
+        if (header.magic != GLTrace::magic || header.version != GLTrace::version)
+            throw std::runtime_error(std::string(tracePath) + " is not a version " +
+                                     std::to_string(GLTrace::version) + " GL trace");
+
+        HeadlessContext context(device);
+        Replayer replayer(header.width, header.height);
+        Reader in(trace.data + sizeof(header), trace.size - sizeof(header));
+
+        std::vector<FrameTiming> frames;
+        size_t errorFrames = 0;
+        Clock::time_point frameStart = Clock::now();
+        while (!in.atEnd())
+        {
+            Op op = static_cast<Op>(in.get<uint8_t>());
+            if (!replayer.execute(op, in))
+                continue;
+
+            Clock::time_point submitted = Clock::now();
+            glFinish();
+            Clock::time_point finished = Clock::now();
+            frames.push_back({ toMs(submitted - frameStart), toMs(finished - frameStart) });
+            if (glGetError() != GL_NO_ERROR)
+                errorFrames++;
+            frameStart = Clock::now();
+        }
+
+        if (csvPath)
+        {
+            FILE* csv = fopen(csvPath, "w");
+            if (!csv)
+                throw std::runtime_error(std::string("Failed to create ") + csvPath);
+            fprintf(csv, "frame,submit_ms,total_ms\n");
+            for (size_t i = 0; i < frames.size(); i++)
+                fprintf(csv, "%zu,%.3f,%.3f\n", i, frames[i].submitMs, frames[i].totalMs);
+            fclose(csv);
+        }
+
+        if (frames.size() <= skip)
+        {
+            printf("%zu frames in the trace, nothing left after skipping %zu\n", frames.size(), skip);
+            return EXIT_SUCCESS;
+        }
+
+        std::vector<double> total;
+        double submitSum = 0.0;
+        for (size_t i = skip; i < frames.size(); i++)
+        {
+            total.push_back(frames[i].totalMs);
+            submitSum += frames[i].submitMs;
+        }
+        double totalSum = 0.0;
+        for (double t : total)
+            totalSum += t;
+
+        const double count = static_cast<double>(total.size());
+        printf("replayed %zu frames at %ux%u, first %zu skipped\n", frames.size(), header.width, header.height, skip);
+        printf("frame ms: avg %.3f  median %.3f  p95 %.3f  p99 %.3f  max %.3f  (%.1f fps)\n",
+               totalSum / count, percentile(total, 0.5), percentile(total, 0.95), percentile(total, 0.99),
+               percentile(total, 1.0), 1000.0 * count / totalSum);
+        printf("submit ms: avg %.3f\n", submitSum / count);
+        if (errorFrames)
+            printf("%zu frames raised GL errors\n", errorFrames);
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
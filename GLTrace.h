@@ -0,0 +1,194 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_GLTRACE_H
+#define PI_GAME_GLTRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <GLES3/gl3.h>
+
+// Binary GL command stream written by GLRecorder and played by pigame_replay.
+// A trace is a Header followed by commands, each one an Op byte and its
+// arguments: 32-bit words for enums, names and numbers, 64-bit for sizes and
+// buffer offsets, data as a 32-bit byte count and the bytes. Everything is in
+// native byte order, replay on a machine of the same endianness. Object names
+// and uniform locations are the ones the recording driver handed out, the
+// replayer maps them onto its own.
+namespace GLTrace {
+    constexpr uint32_t magic = 0x4C474950;     // "PIGL"
+    constexpr uint32_t version = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;         // default framebuffer size at record time
+        uint32_t height;
+    };
+
+    // append only, the numbers are part of the file format
+    enum class Op : uint8_t
+    {
+        Frame,                  // eglSwapBuffers
+        GenBuffers,             // n, names
+        DeleteBuffers,
+        BindBuffer,             // target, buffer
+        BindBufferBase,         // target, index, buffer
+        BufferData,             // target, usage, size64, hasData8, [data]
+        BufferSubData,          // target, offset64, data
+        MapBufferRange,         // target, offset64, length64, access
+        UnmapBuffer,            // target, written data
+        GenVertexArrays,
+        DeleteVertexArrays,
+        BindVertexArray,        // array
+        EnableVertexAttribArray,
+        DisableVertexAttribArray,
+        VertexAttribPointer,    // index, size, type, normalized8, stride, offset64
+        VertexAttribDivisor,    // index, divisor
+        CreateShader,           // type, result
+        DeleteShader,
+        ShaderSource,           // shader, source
+        CompileShader,
+        CreateProgram,          // result
+        DeleteProgram,
+        AttachShader,           // program, shader
+        DetachShader,
+        BindAttribLocation,     // program, index, name
+        LinkProgram,
+        UseProgram,
+        GetUniformLocation,     // program, name, result
+        GetUniformBlockIndex,   // program, name, result
+        UniformBlockBinding,    // program, index, binding
+        Uniform1i,              // location, value
+        Uniform2f,              // location, x, y
+        Uniform4f,              // location, x, y, z, w
+        UniformMatrix4fv,       // location, count, transpose8, values
+        GenTextures,
+        DeleteTextures,
+        ActiveTexture,
+        BindTexture,            // target, texture
+        TexParameteri,          // target, pname, param
+        TexStorage2D,           // target, levels, internalformat, width, height
+        TexSubImage2D,          // target, level, x, y, width, height, format, type, pixels
+        CompressedTexSubImage2D,// target, level, x, y, width, height, format, data
+        PixelStorei,            // pname, param
+        GenFramebuffers,
+        DeleteFramebuffers,
+        BindFramebuffer,        // target, framebuffer
+        GenRenderbuffers,
+        DeleteRenderbuffers,
+        BindRenderbuffer,       // target, renderbuffer
+        RenderbufferStorage,    // target, internalformat, width, height
+        FramebufferRenderbuffer,// target, attachment, renderbuffertarget, renderbuffer
+        InvalidateFramebuffer,  // target, attachments
+        BlitFramebuffer,        // src x0 y0 x1 y1, dst x0 y0 x1 y1, mask, filter
+        Viewport,               // x, y, width, height
+        ClearColor,             // r, g, b, a
+        Clear,                  // mask
+        DrawElements,           // mode, count, type, offset64
+        DrawElementsInstanced,  // mode, count, type, offset64, instances
+        Enable,                 // cap
+        Disable,                // cap
+        ColorMask,              // r8, g8, b8, a8
+        DepthMask,              // flag8
+        GenQueries,
+        DeleteQueries,
+        BeginQuery,             // target, query
+        EndQuery,               // target
+        Uniform3f,              // location, x, y, z
+        Count
+    };
+
+    // bytes glTexSubImage2D reads for an uncompressed image, 0 for unknown formats
+    inline size_t imageSize(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpackAlignment)
+    {
+        size_t components;
+        switch (format)
+        {
+            case GL_RED: case GL_RED_INTEGER: case GL_ALPHA: case GL_LUMINANCE: case GL_DEPTH_COMPONENT:
+                components = 1; break;
+            case GL_RG: case GL_RG_INTEGER: case GL_LUMINANCE_ALPHA: case GL_DEPTH_STENCIL:
+                components = 2; break;
+            case GL_RGB: case GL_RGB_INTEGER:
+                components = 3; break;
+            case GL_RGBA: case GL_RGBA_INTEGER:
+                components = 4; break;
+            default:
+                return 0;
+        }
+
+        size_t pixel;
+        switch (type)
+        {
+            case GL_UNSIGNED_BYTE: case GL_BYTE:
+                pixel = components; break;
+            case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+                pixel = components * 2; break;
+            case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+                pixel = components * 4; break;
+            case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_5_5_5_1:
+                pixel = 2; break;
+            case GL_UNSIGNED_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            case GL_UNSIGNED_INT_5_9_9_9_REV: case GL_UNSIGNED_INT_24_8:
+                pixel = 4; break;
+            default:
+                return 0;
+        }
+
+        if (width <= 0 || height <= 0)
+            return 0;
+
+        const size_t alignment = static_cast<size_t>(unpackAlignment);
+        const size_t row = static_cast<size_t>(width) * pixel;
+        const size_t stride = (row + alignment - 1) / alignment * alignment;
+        return stride * static_cast<size_t>(height - 1) + row;
+    }
+
+    // walks a trace in memory, throws std::runtime_error on truncated data
+    class Reader {
+    public:
+        Reader(const uint8_t* data, size_t size)
+            : cursor(data), end(data + size)
+        {
+        }
+
+        bool atEnd() const
+        {
+            return cursor == end;
+        }
+
+        template<typename T>
+        T get()
+        {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        // pointer into the trace, not aligned
+        const uint8_t* data(uint32_t& size)
+        {
+            size = get<uint32_t>();
+            return take(size);
+        }
+
+    private:
+        const uint8_t* take(size_t bytes)
+        {
+            if (static_cast<size_t>(end - cursor) < bytes)
+                throw std::runtime_error("GL trace is truncated");
+            const uint8_t* p = cursor;
+            cursor += bytes;
+            return p;
+        }
+
+        const uint8_t* cursor;
+        const uint8_t* end;
+    };
+}
+
+
+#endif //PI_GAME_GLTRACE_H
@@ -3,11 +3,15 @@
 //
 
 #include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 #include <cstdio>
 #include <cerrno>
 #include <iostream>
 #include <cstring>
+#include <ctime>
 #include "GraphicsContext.h"
+#include "Trace.h"
 
 GraphicsContext::GraphicsContext()
 {
@@ -26,25 +30,64 @@ GraphicsContext::~GraphicsContext()
 }
 
 void GraphicsContext::swapBuffers() {
-    eglSwapBuffers(eglDisplay, eglSurface);
+    TRACE_SCOPE("swapBuffers");
+    {
+        TRACE_SCOPE("eglSwapBuffers");
+        eglSwapBuffers(eglDisplay, eglSurface);
+    }
     struct gbm_bo *bo = gbm_surface_lock_front_buffer(gbmSurface);
     uint32_t handle = gbm_bo_get_handle(bo).u32;
     uint32_t pitch = gbm_bo_get_stride(bo);
     uint32_t fb;
     drmModeAddFB(drmDeviceFd, modeInfo.hdisplay, modeInfo.vdisplay, 24, 32, pitch, handle, &fb);
-    drmModeSetCrtc(drmDeviceFd, crtc->crtc_id, fb, 0, 0, &connectorId, 1, &modeInfo);
 
-    struct gbm_bo *previous_bo;
-    uint32_t previous_fb;
+    // the first frame sets the mode, after that flip on vblank and wait for
+    // the event so the old buffer is really off screen before it is reused
+    if (previousBo && drmModePageFlip(drmDeviceFd, crtc->crtc_id, fb, DRM_MODE_PAGE_FLIP_EVENT, this) == 0) {
+        waitForFlip();
+    } else {
+        drmModeSetCrtc(drmDeviceFd, crtc->crtc_id, fb, 0, 0, &connectorId, 1, &modeInfo);
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        lastFlipNs = static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+    }
 
-    if (previous_bo) {
-        drmModeRmFB (drmDeviceFd, previous_fb);
-        gbm_surface_release_buffer (gbmSurface, previous_bo);
+    // the previous front buffer is no longer scanned out, hand it back to gbm
+    if (previousBo) {
+        drmModeRmFB (drmDeviceFd, previousFb);
+        gbm_surface_release_buffer (gbmSurface, previousBo);
     }
-    previous_bo = bo;
-    previous_fb = fb;
+    previousBo = bo;
+    previousFb = fb;
 }
 
+void GraphicsContext::onPageFlip(int, unsigned int, unsigned int sec, unsigned int usec, void* data)
+{
+    auto* gfx = static_cast<GraphicsContext*>(data);
+    gfx->flipPending = false;
+    gfx->lastFlipNs = static_cast<uint64_t>(sec) * 1000000000ull + static_cast<uint64_t>(usec) * 1000ull;
+}
+
+void GraphicsContext::waitForFlip()
+{
+    TRACE_SCOPE("waitForFlip");
+
+    drmEventContext events;
+    memset(&events, 0, sizeof(events));
+    events.version = 2;
+    events.page_flip_handler = onPageFlip;
+
+    flipPending = true;
+    pollfd fd { drmDeviceFd, POLLIN, 0 };
+    while (flipPending) {
+        if (poll(&fd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed waiting for the page flip");
+        }
+        drmHandleEvent(drmDeviceFd, &events);
+    }
+}
 
 void GraphicsContext::initEGL()
 {
@@ -86,9 +129,9 @@ void GraphicsContext::initEGL()
                     EGL_NONE
             };
     context = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, context_attribs);
-    eglSurface = eglCreateWindowSurface(eglDisplay, config, gbmSurface, NULL);
     gbmSurface = gbm_surface_create(gbmDevice, modeInfo.hdisplay, modeInfo.vdisplay,
                                     GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+    eglSurface = eglCreateWindowSurface(eglDisplay, config, gbmSurface, NULL);
 
     eglMakeCurrent(eglDisplay, eglSurface, eglSurface, context);
     printf("%s \n", glGetString(GL_RENDERER));
@@ -23,6 +23,24 @@ public:
     void swapBuffers();
     drmModeConnector *findConnector() noexcept;
 
+    // scanout size of the current mode, valid after initDRM()
+    uint32_t getWidth() const
+    {
+        return modeInfo.hdisplay;
+    }
+
+    uint32_t getHeight() const
+    {
+        return modeInfo.vdisplay;
+    }
+
+    // CLOCK_MONOTONIC time in nanoseconds the last swapBuffers() frame hit
+    // the screen, taken from the page flip event
+    uint64_t getLastFlipTime() const
+    {
+        return lastFlipNs;
+    }
+
 private:
 
     // Used for the smart pointer deleter implementation
@@ -46,6 +64,9 @@ private:
         drmModeFreeCrtc(ptr);
     }
 
+    static void onPageFlip(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void* data);
+    void waitForFlip();
+
     const char* drmDevice = "/dev/dri/card1";
     int drmDeviceFd;
     std::shared_ptr<drmModeRes> resources;
@@ -62,6 +83,12 @@ private:
     struct gbm_surface* gbmSurface;
     EGLSurface eglSurface;
 
+    struct gbm_bo* previousBo = nullptr;
+    uint32_t previousFb = 0;
+
+    bool flipPending = false;
+    uint64_t lastFlipNs = 0;
+
 };
 
 
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include "Model.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Flat shaded unit icospheres for the low subdivision levels, generated by
+// the compiler. The math mirrors IcosoSphere (same vertex layout, same face
+// order, same float normalisation) so the tables agree with the runtime
+// generator to within float rounding, and they end up in .rodata.
+///////////////////////////////////////////////////////////////////////////////
+namespace IcosahedronTables
+{
+	// highest level that is baked into the binary, level 3 is ~135KB
+	constexpr int maxLevel = 3;
+
+	namespace detail
+	{
+		constexpr double PI = 3.14159265358979323846;
+
+		// Newton iteration in double, then one rounding to float
+		constexpr double sqrtNewton(double x, double guess, double prev)
+		{
+			return guess == prev ? guess : sqrtNewton(x, 0.5 * (guess + x / guess), guess);
+		}
+
+		constexpr float sqrtf(float x)
+		{
+			return x > 0.0f ? static_cast<float>(sqrtNewton(x, x > 1.0 ? static_cast<double>(x) : 1.0, 0.0)) : 0.0f;
+		}
+
+		// Taylor series, argument reduced to [-pi, pi]
+		constexpr double sin(double x)
+		{
+			while (x > PI)
+				x -= 2 * PI;
+			while (x < -PI)
+				x += 2 * PI;
+
+			double term = x, sum = x;
+			for (int n = 1; n < 20; n++)
+			{
+				term *= -x * x / ((2 * n) * (2 * n + 1));
+				sum += term;
+			}
+			return sum;
+		}
+
+		constexpr double cos(double x)
+		{
+			return sin(x + PI / 2);
+		}
+
+		struct Vec3
+		{
+			float v[3];
+		};
+
+		struct Vec2
+		{
+			float v[2];
+		};
+
+		constexpr Vec2 halfTexCoord(const Vec2& a, const Vec2& b)
+		{
+			return { { (a.v[0] + b.v[0]) * 0.5f, (a.v[1] + b.v[1]) * 0.5f } };
+		}
+
+		constexpr Vec3 halfVertex(const Vec3& a, const Vec3& b)
+		{
+			Vec3 n = { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2] } };
+			float scale = 1.0f / sqrtf(n.v[0] * n.v[0] + n.v[1] * n.v[1] + n.v[2] * n.v[2]);
+			return { { n.v[0] * scale, n.v[1] * scale, n.v[2] * scale } };
+		}
+
+		constexpr Vec3 faceNormal(const Vec3& a, const Vec3& b, const Vec3& c)
+		{
+			float ex1 = b.v[0] - a.v[0], ey1 = b.v[1] - a.v[1], ez1 = b.v[2] - a.v[2];
+			float ex2 = c.v[0] - a.v[0], ey2 = c.v[1] - a.v[1], ez2 = c.v[2] - a.v[2];
+
+			float nx = ey1 * ez2 - ez1 * ey2;
+			float ny = ez1 * ex2 - ex1 * ez2;
+			float nz = ex1 * ey2 - ey1 * ex2;
+
+			float length = sqrtf(nx * nx + ny * ny + nz * nz);
+			if (length <= 0.000001f)
+				return { { 0.0f, 0.0f, 0.0f } };
+
+			float lengthInv = 1.0f / length;
+			return { { nx * lengthInv, ny * lengthInv, nz * lengthInv } };
+		}
+
+		// 12 vertices, north pole, two rings of 5 at +-atan(1/2), south pole
+		constexpr std::array<Vec3, 12> baseVertices()
+		{
+			std::array<Vec3, 12> verts = {};
+			const double H_ANGLE = PI / 180 * 72;
+			const double z = 1.0 / 2.2360679774997896964;    // sin(atan(1/2)) = 1/sqrt(5)
+			const double xy = 2.0 / 2.2360679774997896964;   // cos(atan(1/2)) = 2/sqrt(5)
+
+			verts[0] = { { 0.0f, 0.0f, 1.0f } };
+			double hAngle1 = -PI / 2 - H_ANGLE / 2;
+			double hAngle2 = -PI / 2;
+			for (size_t i = 1; i <= 5; ++i)
+			{
+				verts[i] = { { static_cast<float>(xy * cos(hAngle1)), static_cast<float>(xy * sin(hAngle1)),
+				               static_cast<float>(z) } };
+				verts[i + 5] = { { static_cast<float>(xy * cos(hAngle2)), static_cast<float>(xy * sin(hAngle2)),
+				                   static_cast<float>(-z) } };
+				hAngle1 += H_ANGLE;
+				hAngle2 += H_ANGLE;
+			}
+			verts[11] = { { 0.0f, 0.0f, -1.0f } };
+			return verts;
+		}
+
+		// the 20 faces in IcosoSphere::buildVerticesFlat() order
+		constexpr std::array<Vec3, 60> baseFaces()
+		{
+			std::array<Vec3, 12> v = baseVertices();
+			std::array<Vec3, 60> faces = {};
+			size_t n = 0;
+			for (size_t i = 1; i <= 5; ++i)
+			{
+				size_t i1 = i;
+				size_t i2 = i < 5 ? i + 1 : 1;
+				size_t i3 = i + 5;
+				size_t i4 = (i + 5) < 10 ? i + 6 : 6;
+
+				const size_t tris[4][3] = { { 0, i1, i2 }, { i1, i3, i2 }, { i2, i3, i4 }, { i3, 11, i4 } };
+				for (const auto& t : tris)
+					for (size_t c : t)
+						faces[n++] = v[c];
+			}
+			return faces;
+		}
+
+		// texture coords of baseFaces(), the unwrapped strip of the 2048x1024
+		// layout IcosoSphere::buildVerticesFlat() uses
+		constexpr std::array<Vec2, 60> baseTexCoords()
+		{
+			const float S_STEP = 186 / 2048.0f;
+			const float T_STEP = 322 / 1024.0f;
+
+			std::array<Vec2, 60> coords = {};
+			size_t n = 0;
+			for (size_t i = 1; i <= 5; ++i)
+			{
+				Vec2 t0 = { { static_cast<float>(2 * i - 1) * S_STEP, 0.0f } };
+				Vec2 t1 = { { static_cast<float>(2 * i - 2) * S_STEP, T_STEP } };
+				Vec2 t2 = { { static_cast<float>(2 * i - 0) * S_STEP, T_STEP } };
+				Vec2 t3 = { { static_cast<float>(2 * i - 1) * S_STEP, T_STEP * 2 } };
+				Vec2 t4 = { { static_cast<float>(2 * i + 1) * S_STEP, T_STEP * 2 } };
+				Vec2 t11 = { { static_cast<float>(2 * i) * S_STEP, T_STEP * 3 } };
+
+				const Vec2 tris[12] = { t0, t1, t2, t1, t3, t2, t2, t3, t4, t3, t11, t4 };
+				for (const Vec2& t : tris)
+					coords[n++] = t;
+			}
+			return coords;
+		}
+
+		template<size_t N>
+		constexpr void subdivide(const Vec3& v1, const Vec3& v2, const Vec3& v3,
+		                         const Vec2& t1, const Vec2& t2, const Vec2& t3, int level,
+		                         std::array<VertData, N>& out, size_t& n)
+		{
+			if (level == 0)
+			{
+				Vec3 normal = faceNormal(v1, v2, v3);
+				const Vec3* tri[3] = { &v1, &v2, &v3 };
+				const Vec2* tex[3] = { &t1, &t2, &t3 };
+				for (size_t c = 0; c < 3; c++)
+				{
+					const Vec3* v = tri[c];
+					VertData& d = out[n++];
+					d.position[0] = v->v[0];
+					d.position[1] = v->v[1];
+					d.position[2] = v->v[2];
+					d.color[0] = 0.4f;
+					d.color[1] = 0.6f;
+					d.color[2] = 0.2f;
+					d.normal[0] = normal.v[0];
+					d.normal[1] = normal.v[1];
+					d.normal[2] = normal.v[2];
+					d.texCoord[0] = tex[c]->v[0];
+					d.texCoord[1] = tex[c]->v[1];
+				}
+				return;
+			}
+
+			Vec3 newV1 = halfVertex(v1, v2);
+			Vec3 newV2 = halfVertex(v2, v3);
+			Vec3 newV3 = halfVertex(v1, v3);
+			Vec2 newT1 = halfTexCoord(t1, t2);
+			Vec2 newT2 = halfTexCoord(t2, t3);
+			Vec2 newT3 = halfTexCoord(t1, t3);
+			subdivide(v1, newV1, newV3, t1, newT1, newT3, level - 1, out, n);
+			subdivide(newV1, v2, newV2, newT1, t2, newT2, level - 1, out, n);
+			subdivide(newV1, newV2, newV3, newT1, newT2, newT3, level - 1, out, n);
+			subdivide(newV3, newV2, v3, newT3, newT2, t3, level - 1, out, n);
+		}
+
+		template<int Level>
+		constexpr std::array<VertData, 60 * (size_t(1) << (2 * Level))> build()
+		{
+			std::array<VertData, 60 * (size_t(1) << (2 * Level))> out = {};
+			std::array<Vec3, 60> faces = baseFaces();
+			std::array<Vec2, 60> coords = baseTexCoords();
+			size_t n = 0;
+			for (size_t f = 0; f < 60; f += 3)
+				subdivide(faces[f], faces[f + 1], faces[f + 2], coords[f], coords[f + 1], coords[f + 2], Level, out, n);
+			return out;
+		}
+
+		template<size_t N>
+		constexpr bool allUnitLength(const std::array<VertData, N>& verts)
+		{
+			for (const VertData& d : verts)
+			{
+				float len = d.position[0] * d.position[0] + d.position[1] * d.position[1] + d.position[2] * d.position[2];
+				if (len < 0.9999f || len > 1.0001f)
+					return false;
+			}
+			return true;
+		}
+	}
+
+	// Level<N>::vertices holds 60 * 4^N interleaved vertices, indices are 0..n-1
+	template<int N>
+	struct Level
+	{
+		static_assert(N >= 0 && N <= maxLevel, "level is not baked into the tables");
+		static constexpr std::array<VertData, 60 * (size_t(1) << (2 * N))> vertices = detail::build<N>();
+		static_assert(detail::allUnitLength(vertices), "baked icosphere left the unit sphere");
+	};
+
+	// runtime access, nullptr when the level is not baked
+	inline const VertData* vertices(int level, size_t& numVerts)
+	{
+		switch (level)
+		{
+		case 0: numVerts = Level<0>::vertices.size(); return Level<0>::vertices.data();
+		case 1: numVerts = Level<1>::vertices.size(); return Level<1>::vertices.data();
+		case 2: numVerts = Level<2>::vertices.size(); return Level<2>::vertices.data();
+		case 3: numVerts = Level<3>::vertices.size(); return Level<3>::vertices.data();
+		default: numVerts = 0; return nullptr;
+		}
+	}
+}
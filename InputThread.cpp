@@ -0,0 +1,137 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include "InputThread.h"
+#include "Trace.h"
+
+namespace {
+    constexpr int maxEventNodes = 32;
+    constexpr size_t readBatch = 64;
+}
+
+InputThread::InputThread(const std::vector<std::string>& devices)
+{
+    if (devices.empty())
+    {
+        for (int i = 0; i < maxEventNodes; i++)
+            openDevice("/dev/input/event" + std::to_string(i));
+    }
+    else
+    {
+        for (const auto& path : devices)
+            openDevice(path);
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0)
+    {
+        for (int fd : fds)
+            close(fd);
+        throw std::runtime_error("Failed creating the input wake eventfd");
+    }
+}
+
+InputThread::~InputThread()
+{
+    stop();
+    for (int fd : fds)
+        close(fd);
+    close(wakeFd);
+}
+
+void InputThread::openDevice(const std::string& path)
+{
+    // missing nodes and ones we may not read are simply skipped
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    // event times default to CLOCK_REALTIME, switch to the clock page flips report in
+    int clock = CLOCK_MONOTONIC;
+    ioctl(fd, EVIOCSCLOCKID, &clock);
+    fds.push_back(fd);
+}
+
+void InputThread::start()
+{
+    if (running.load())
+        return;
+
+    running.store(true);
+    thread = std::thread(&InputThread::run, this);
+}
+
+void InputThread::stop()
+{
+    running.store(false);
+    if (!thread.joinable())
+        return;
+
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+    thread.join();
+}
+
+void InputThread::run()
+{
+    TRACE_THREAD_NAME("input");
+
+    std::vector<pollfd> polls;
+    polls.push_back({ wakeFd, POLLIN, 0 });
+    for (int fd : fds)
+        polls.push_back({ fd, POLLIN, 0 });
+
+    input_event events[readBatch];
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (poll(polls.data(), polls.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (polls[0].revents)
+            break;
+
+        for (size_t i = 1; i < polls.size(); i++)
+        {
+            if (polls[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                // unplugged, stop polling it
+                polls[i].fd = -1;
+                continue;
+            }
+            if (!(polls[i].revents & POLLIN))
+                continue;
+
+            ssize_t bytes;
+            while ((bytes = read(polls[i].fd, events, sizeof(events))) > 0)
+            {
+                size_t count = static_cast<size_t>(bytes) / sizeof(input_event);
+                for (size_t n = 0; n < count; n++)
+                {
+                    const input_event& e = events[n];
+                    InputEvent out {
+                        static_cast<uint64_t>(e.input_event_sec) * 1000000000ull +
+                        static_cast<uint64_t>(e.input_event_usec) * 1000ull,
+                        e.type, e.code, e.value
+                    };
+                    if (!queue.push(out))
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+}
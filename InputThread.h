@@ -0,0 +1,76 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_INPUTTHREAD_H
+#define PI_GAME_INPUTTHREAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SpscQueue.h"
+
+// One evdev event, stamped by the kernel on CLOCK_MONOTONIC which is the
+// clock DRM page flip events use as well.
+struct InputEvent
+{
+    uint64_t timeNs;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+// Reads evdev devices on its own thread and hands the events to the render
+// thread through a lock-free queue. The thread sleeps in poll() and forwards
+// every event the moment the kernel delivers it, so the render thread can
+// drain the queue right before it submits a frame instead of sampling input
+// at the start of the frame and carrying it through the whole frame.
+class InputThread {
+public:
+    static constexpr size_t queueCapacity = 1024;
+
+    // every /dev/input/event* that can be opened when no devices are given
+    explicit InputThread(const std::vector<std::string>& devices = {});
+    ~InputThread();
+
+    InputThread(const InputThread&) = delete;
+    InputThread& operator=(const InputThread&) = delete;
+
+    void start();
+    void stop();
+
+    // render thread only, false once the queue is empty
+    bool pop(InputEvent& event) noexcept
+    {
+        return queue.pop(event);
+    }
+
+    size_t getDeviceCount() const
+    {
+        return fds.size();
+    }
+
+    // events thrown away because the render thread fell behind
+    uint64_t getDropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    void openDevice(const std::string& path);
+    void run();
+
+    std::vector<int> fds;
+    int wakeFd = -1;
+
+    std::thread thread;
+    std::atomic<bool> running { false };
+    std::atomic<uint64_t> dropped { 0 };
+
+    SpscQueue<InputEvent, queueCapacity> queue;
+};
+
+
+#endif //PI_GAME_INPUTTHREAD_H
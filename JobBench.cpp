@@ -0,0 +1,112 @@
+//
+// Created by APel on 19/10/26.
+//
+
+// pigame_jobbench: scheduling overhead of the JobSystem, the cost of a job
+// that does nothing. Two cases, each run with one worker and with all of them:
+//  - empty child jobs under one root, created, run and waited on
+//  - parallelFor over empty grains of 1, which adds the recursive splitting
+//
+//   pigame_jobbench [--workers N] [--jobs N] [--rounds N]
+//
+// Prints the best and the median round in nanoseconds per job. Build it with
+// optimizations, a Debug build measures the compiler.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JobSystem.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // children per root, well below the pool and deque size
+    constexpr size_t childBatch = 1024;
+
+    void emptyJob(Job*, const void*)
+    {
+    }
+
+    void usage()
+    {
+        fprintf(stderr, "usage: pigame_jobbench [--workers N] [--jobs N] [--rounds N]\n");
+    }
+
+    template<typename F>
+    void report(const char* name, unsigned workers, size_t jobsPerRound, unsigned rounds, F&& round)
+    {
+        std::vector<double> ns;
+        ns.reserve(rounds);
+
+        round();    // warm up the pools and wake the workers
+        for (unsigned r = 0; r < rounds; r++)
+        {
+            auto start = Clock::now();
+            round();
+            double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            ns.push_back(elapsed / static_cast<double>(jobsPerRound));
+        }
+
+        std::sort(ns.begin(), ns.end());
+        printf("%-16s %2u workers: best %7.1f ns, median %7.1f ns per job\n", name, workers, ns.front(),
+               ns[ns.size() / 2]);
+    }
+
+    void bench(unsigned workers, size_t jobCount, unsigned rounds)
+    {
+        JobSystem jobs(workers);
+        const size_t batches = std::max<size_t>(jobCount / childBatch, 1);
+
+        report("child jobs", workers, batches * childBatch, rounds, [&]() {
+            for (size_t b = 0; b < batches; b++)
+            {
+                Job* root = jobs.createJob(&emptyJob);
+                for (size_t i = 0; i < childBatch; i++)
+                    jobs.run(jobs.createChildJob(root, &emptyJob));
+                jobs.run(root);
+                jobs.wait(root);
+            }
+        });
+
+        report("parallelFor", workers, jobCount, rounds, [&]() {
+            jobs.parallelFor(0, jobCount, 1, [](size_t, size_t) {});
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned workers = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t jobCount = 65536;
+    unsigned rounds = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc)
+            workers = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--jobs" && i + 1 < argc)
+            jobCount = static_cast<size_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--rounds" && i + 1 < argc)
+            rounds = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (workers == 0 || jobCount == 0 || rounds == 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    bench(1, jobCount, rounds);
+    if (workers > 1)
+        bench(workers, jobCount, rounds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include "JobSystem.h"
+#include "Trace.h"
+
+namespace {
+    thread_local JobSystem* tlsSystem = nullptr;
+    thread_local int tlsWorkerIndex = -1;
+
+    void pinCurrentThread(unsigned core)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Chase-Lev deque, memory orderings follow Le et al.
+// "Correct and Efficient Work-Stealing for Weak Memory Models"
+///////////////////////////////////////////////////////////////////////////////
+bool WorkStealingQueue::push(Job* job) noexcept
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+        return false;
+
+    jobs[b & mask].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* WorkStealingQueue::pop() noexcept
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        // deque was empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = jobs[b & mask].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // last element, race against thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* WorkStealingQueue::steal() noexcept
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return nullptr;
+
+    Job* job = jobs[t & mask].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// JobSystem
+///////////////////////////////////////////////////////////////////////////////
+JobSystem::JobSystem(unsigned numWorkers, bool pinToCores)
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+        cores = 1;
+    if (numWorkers == 0)
+        numWorkers = cores;
+
+    workers.resize(numWorkers);
+    for (unsigned i = 0; i < numWorkers; i++)
+    {
+        queues.push_back(std::make_unique<WorkStealingQueue>());
+        workers[i].pool = std::make_unique<Job[]>(jobPoolSize);
+        for (size_t j = 0; j < jobPoolSize; j++)
+            workers[i].pool[j].unfinishedJobs.store(0, std::memory_order_relaxed);
+        workers[i].stealSeed = 2654435761u * (i + 1);
+    }
+
+    // the calling thread is worker 0 and owns the GL context
+    tlsSystem = this;
+    tlsWorkerIndex = 0;
+    if (pinToCores)
+        pinCurrentThread(0);
+
+    for (unsigned i = 1; i < numWorkers; i++)
+    {
+        threads.emplace_back([this, i, pinToCores, cores]() {
+            if (pinToCores)
+                pinCurrentThread(i % cores);
+            workerMain(i);
+        });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    running.store(false);
+    wakeUp.notify_all();
+    for (auto& t : threads)
+        t.join();
+
+    if (tlsSystem == this)
+    {
+        tlsSystem = nullptr;
+        tlsWorkerIndex = -1;
+    }
+}
+
+int JobSystem::getWorkerIndex() const
+{
+    return tlsSystem == this ? tlsWorkerIndex : -1;
+}
+
+Job* JobSystem::createJob(Job::Function function)
+{
+    int index = getWorkerIndex();
+    if (index < 0)
+        throw std::runtime_error("Jobs can only be created from a JobSystem worker thread");
+
+    // Slots come back around in order, but a parent stays unfinished until
+    // its whole subtree is done, so a big parallelFor can still hold an old
+    // slot when the ring wraps. Those are skipped, never overwritten
+    WorkerData& worker = workers[static_cast<size_t>(index)];
+    Job* job = nullptr;
+    for (size_t probe = 0; probe < jobPoolSize && !job; probe++)
+    {
+        Job* slot = &worker.pool[worker.allocated++ & (jobPoolSize - 1)];
+        if (hasCompleted(slot))
+            job = slot;
+    }
+    if (!job)
+        throw std::runtime_error("Job pool exhausted, too many unfinished jobs on one worker");
+
+    job->function = function;
+    job->parent = nullptr;
+    job->unfinishedJobs.store(1, std::memory_order_relaxed);
+    return job;
+}
+
+Job* JobSystem::createChildJob(Job* parent, Job::Function function)
+{
+    parent->unfinishedJobs.fetch_add(1, std::memory_order_relaxed);
+
+    Job* job = createJob(function);
+    job->parent = parent;
+    return job;
+}
+
+void JobSystem::run(Job* job)
+{
+    int index = getWorkerIndex();
+    if (index < 0)
+        throw std::runtime_error("Jobs can only be run from a JobSystem worker thread");
+
+    // a full deque just means we are the ones doing the work
+    if (!queues[static_cast<size_t>(index)]->push(job))
+    {
+        execute(job);
+        return;
+    }
+
+    if (sleepingWorkers.load(std::memory_order_relaxed) > 0)
+        wakeUp.notify_one();
+}
+
+void JobSystem::runOnGLThread(Job* job)
+{
+    std::lock_guard<std::mutex> lock(glQueueMutex);
+    glQueue.push_back(job);
+    glQueueNonEmpty.store(true, std::memory_order_release);
+}
+
+void JobSystem::pumpGLJobs()
+{
+    if (!isGLThread() || !glQueueNonEmpty.load(std::memory_order_acquire))
+        return;
+
+    std::vector<Job*> pending;
+    {
+        std::lock_guard<std::mutex> lock(glQueueMutex);
+        pending.swap(glQueue);
+        glQueueNonEmpty.store(false, std::memory_order_relaxed);
+    }
+
+    for (Job* job : pending)
+        execute(job);
+}
+
+void JobSystem::wait(const Job* job)
+{
+    int index = getWorkerIndex();
+    if (index < 0)
+        throw std::runtime_error("Jobs can only be waited on from a JobSystem worker thread");
+
+    // never block, help out until the job is done
+    while (!hasCompleted(job))
+    {
+        Job* next = getJob(static_cast<unsigned>(index));
+        if (next)
+            execute(next);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::workerMain(unsigned index)
+{
+    tlsSystem = this;
+    tlsWorkerIndex = static_cast<int>(index);
+    TRACE_THREAD_NAME("worker " + std::to_string(index));
+
+    int idleRounds = 0;
+    while (running.load(std::memory_order_relaxed))
+    {
+        Job* job = getJob(index);
+        if (job)
+        {
+            execute(job);
+            idleRounds = 0;
+            continue;
+        }
+
+        if (++idleRounds < 64)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // park for a bit, run() wakes us up early when new work shows up
+        sleepingWorkers.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait_for(lock, std::chrono::milliseconds(1));
+        }
+        sleepingWorkers.fetch_sub(1);
+        idleRounds = 0;
+    }
+}
+
+Job* JobSystem::getJob(unsigned index)
+{
+    Job* job = queues[index]->pop();
+    if (job)
+        return job;
+
+    if (index == 0 && glQueueNonEmpty.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(glQueueMutex);
+        if (!glQueue.empty())
+        {
+            job = glQueue.back();
+            glQueue.pop_back();
+            glQueueNonEmpty.store(!glQueue.empty(), std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    size_t count = queues.size();
+    if (count <= 1)
+        return nullptr;
+
+    // pick a random victim, xorshift is plenty for that
+    uint32_t& seed = workers[index].stealSeed;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    size_t victim = seed % count;
+    if (victim == index)
+        victim = (victim + 1) % count;
+
+    return queues[victim]->steal();
+}
+
+void JobSystem::execute(Job* job)
+{
+    TRACE_SCOPE("job");
+    job->function(job, job->data);
+    finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+    // once the count hits zero the slot may be recycled, read the parent first
+    Job* parent = job->parent;
+    int32_t left = job->unfinishedJobs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (left == 0 && parent)
+        finish(parent);
+}
+
+bool JobSystem::hasCompleted(const Job* job) const
+{
+    return job->unfinishedJobs.load(std::memory_order_acquire) == 0;
+}
+
+void JobSystem::parallelForJob(Job* job, const void* data)
+{
+    ParallelForData range;
+    std::memcpy(&range, data, sizeof(range));
+
+    // split until the range fits the grain size, thieves pick up the halves
+    if (range.last - range.first > range.grainSize)
+    {
+        JobSystem* system = tlsSystem;
+        size_t mid = range.first + (range.last - range.first) / 2;
+
+        ParallelForData left = range;
+        left.last = mid;
+        ParallelForData right = range;
+        right.first = mid;
+
+        system->run(system->createChildJob(job, &parallelForJob, left));
+        system->run(system->createChildJob(job, &parallelForJob, right));
+        return;
+    }
+
+    range.invoke(range.func, range.first, range.last);
+}
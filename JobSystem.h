@@ -0,0 +1,173 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_JOBSYSTEM_H
+#define PI_GAME_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class JobSystem;
+
+// A job is a function pointer plus a small inline payload. Jobs are never
+// freed, they come out of a per-worker ring and get recycled, so creating one
+// is a couple of stores and no allocation.
+struct alignas(64) Job
+{
+    using Function = void (*)(Job*, const void*);
+
+    Function function;
+    Job* parent;
+    std::atomic<int32_t> unfinishedJobs;
+    unsigned char data[64 - sizeof(Function) - sizeof(Job*) - sizeof(std::atomic<int32_t>)];
+};
+
+// Chase-Lev work stealing deque. The owning worker pushes and pops at the
+// bottom, every other worker steals from the top.
+class WorkStealingQueue {
+public:
+    static constexpr int64_t capacity = 4096;
+
+    bool push(Job* job) noexcept;
+    Job* pop() noexcept;
+    Job* steal() noexcept;
+
+private:
+    static constexpr int64_t mask = capacity - 1;
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Job*> jobs[capacity];
+};
+
+class JobSystem {
+public:
+    // numWorkers == 0 uses one worker per core. The constructing thread becomes
+    // worker 0 and is treated as the GL thread: it is the only one that runs
+    // jobs queued with runOnGLThread().
+    explicit JobSystem(unsigned numWorkers = 0, bool pinToCores = true);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    Job* createJob(Job::Function function);
+    Job* createChildJob(Job* parent, Job::Function function);
+
+    template<typename T>
+    Job* createJob(Job::Function function, const T& data)
+    {
+        return storeData(createJob(function), data);
+    }
+
+    template<typename T>
+    Job* createChildJob(Job* parent, Job::Function function, const T& data)
+    {
+        return storeData(createChildJob(parent, function), data);
+    }
+
+    void run(Job* job);
+    void runOnGLThread(Job* job);
+
+    // Helps executing jobs until the given one and all its children are done
+    void wait(const Job* job);
+
+    // Executes whatever is queued for the GL thread, call once per frame
+    void pumpGLJobs();
+
+    // Calls func(begin, end) over sub ranges of [first, last) of at most
+    // grainSize elements, blocks until the whole range has been processed
+    template<typename F>
+    void parallelFor(size_t first, size_t last, size_t grainSize, const F& func)
+    {
+        if (first >= last)
+            return;
+
+        ParallelForData data { &invokeRange<F>, &func, first, last, grainSize > 0 ? grainSize : 1 };
+        Job* root = createJob(&parallelForJob, data);
+        run(root);
+        wait(root);
+    }
+
+    unsigned getNumWorkers() const
+    {
+        return static_cast<unsigned>(queues.size());
+    }
+
+    // index of the calling thread, -1 if it is not a worker of this system
+    int getWorkerIndex() const;
+
+    bool isGLThread() const
+    {
+        return getWorkerIndex() == 0;
+    }
+
+private:
+    struct ParallelForData
+    {
+        void (*invoke)(const void*, size_t, size_t);
+        const void* func;
+        size_t first;
+        size_t last;
+        size_t grainSize;
+    };
+
+    template<typename F>
+    static void invokeRange(const void* func, size_t first, size_t last)
+    {
+        (*static_cast<const F*>(func))(first, last);
+    }
+
+    template<typename T>
+    static Job* storeData(Job* job, const T& data)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "job data must be trivially copyable");
+        static_assert(sizeof(T) <= sizeof(Job::data), "job data does not fit into a job");
+        std::memcpy(job->data, &data, sizeof(T));
+        return job;
+    }
+
+    static void parallelForJob(Job* job, const void* data);
+
+    void workerMain(unsigned index);
+    Job* getJob(unsigned index);
+    void execute(Job* job);
+    void finish(Job* job);
+    bool hasCompleted(const Job* job) const;
+
+    static constexpr size_t jobPoolSize = 4096;
+
+    struct WorkerData
+    {
+        std::unique_ptr<Job[]> pool;
+        size_t allocated = 0;
+        uint32_t stealSeed = 0;
+    };
+
+    std::vector<std::unique_ptr<WorkStealingQueue>> queues;
+    std::vector<WorkerData> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex glQueueMutex;
+    std::vector<Job*> glQueue;
+    std::atomic<bool> glQueueNonEmpty{false};
+
+    // idle workers park here instead of spinning
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<int> sleepingWorkers{0};
+
+    std::atomic<bool> running{true};
+};
+
+
+#endif //PI_GAME_JOBSYSTEM_H
@@ -0,0 +1,257 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "KtxTexture.h"
+#include "MemoryTracker.h"
+
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+
+namespace {
+    const unsigned char ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    constexpr uint32_t ktxEndianness = 0x04030201;
+
+    struct KtxHeader
+    {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+    static_assert(sizeof(KtxHeader) == 64, "KTX header is 64 bytes");
+
+    // bytes per 4x4 block, 0 for formats we don't take
+    uint32_t blockBytes(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_COMPRESSED_RGB8_ETC2:
+            case GL_COMPRESSED_SRGB8_ETC2:
+            case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            case GL_COMPRESSED_R11_EAC:
+            case GL_COMPRESSED_SIGNED_R11_EAC:
+                return 8;
+            case GL_COMPRESSED_RGBA8_ETC2_EAC:
+            case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            case GL_COMPRESSED_RG11_EAC:
+            case GL_COMPRESSED_SIGNED_RG11_EAC:
+                return 16;
+            default:
+                return 0;
+        }
+    }
+}
+
+KtxTexture::KtxTexture(const std::string& file)
+    : path(file)
+{
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Failed opening texture " + path + ": " + strerror(errno));
+
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(KtxHeader)))
+    {
+        close(fd);
+        throw std::runtime_error("Texture " + path + " is too small to be a KTX file");
+    }
+
+    mappingSize = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("Failed mapping texture " + path + ": " + strerror(errno));
+    }
+    mapping = static_cast<unsigned char*>(p);
+
+    try
+    {
+        parse();
+    }
+    catch (...)
+    {
+        unmap();
+        throw;
+    }
+
+    // the smallest levels are tiny, get them paged in before create()
+    adviseLevel(residentLevel - 1);
+}
+
+KtxTexture::~KtxTexture()
+{
+    unmap();
+    if (texture)
+    {
+        MemoryTracker::instance().untrackTexture(texture);
+        glDeleteTextures(1, &texture);
+    }
+}
+
+void KtxTexture::parse()
+{
+    KtxHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+
+    if (std::memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0)
+        throw std::runtime_error("Texture " + path + " is not a KTX 1.1 file");
+    if (header.endianness != ktxEndianness)
+        throw std::runtime_error("Texture " + path + " was written with the other endianness");
+    if (header.glType != 0 || header.glFormat != 0)
+        throw std::runtime_error("Texture " + path + " is not compressed");
+
+    // ETC2 decoders read ETC1 as is
+    internalFormat = header.glInternalFormat == GL_ETC1_RGB8_OES ? GL_COMPRESSED_RGB8_ETC2 : header.glInternalFormat;
+    uint32_t bytesPerBlock = blockBytes(internalFormat);
+    if (bytesPerBlock == 0)
+        throw std::runtime_error("Texture " + path + " is not ETC2/EAC compressed");
+
+    if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1)
+        throw std::runtime_error("Texture " + path + " is not a plain 2D texture");
+    if (header.pixelWidth == 0 || header.pixelHeight == 0)
+        throw std::runtime_error("Texture " + path + " has no size");
+
+    width = header.pixelWidth;
+    height = header.pixelHeight;
+
+    // 0 asks the loader to generate mips, we don't, the base level is all there is
+    uint32_t numLevels = std::max(header.numberOfMipmapLevels, 1u);
+
+    size_t offset = sizeof(KtxHeader) + header.bytesOfKeyValueData;
+    for (uint32_t level = 0; level < numLevels; level++)
+    {
+        if (offset + sizeof(uint32_t) > mappingSize)
+            throw std::runtime_error("Texture " + path + " is truncated");
+
+        uint32_t imageSize;
+        std::memcpy(&imageSize, mapping + offset, sizeof(imageSize));
+        offset += sizeof(uint32_t);
+
+        uint32_t w = std::max(width >> level, 1u);
+        uint32_t h = std::max(height >> level, 1u);
+        uint32_t expected = ((w + 3) / 4) * ((h + 3) / 4) * bytesPerBlock;
+        if (imageSize != expected || offset + imageSize > mappingSize)
+            throw std::runtime_error("Texture " + path + " has a bad size for mip level " + std::to_string(level));
+
+        levels.push_back({ mapping + offset, imageSize });
+        offset += (imageSize + 3u) & ~3u;
+    }
+
+    residentLevel = static_cast<uint32_t>(levels.size());
+}
+
+void KtxTexture::adviseLevel(uint32_t level) const
+{
+    if (!mapping || level >= levels.size())
+        return;
+
+    // madvise wants a page aligned start
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = reinterpret_cast<uintptr_t>(levels[level].data);
+    uintptr_t aligned = start & ~static_cast<uintptr_t>(pageSize - 1);
+    madvise(reinterpret_cast<void*>(aligned), levels[level].size + (start - aligned), MADV_WILLNEED);
+}
+
+void KtxTexture::unmap()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool KtxTexture::streamNext(size_t byteBudget)
+{
+    if (isComplete())
+        return true;
+
+    if (!texture)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(levels.size()), internalFormat,
+                       static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size() - 1));
+
+        if (glGetError() != GL_NO_ERROR)
+            throw std::runtime_error("Failed allocating texture storage for " + path);
+
+        // storage for every level is reserved up front, streaming only fills it
+        size_t bytes = 0;
+        for (const Level& l : levels)
+            bytes += l.size;
+        MemoryTracker::instance().trackTexture(texture, bytes);
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    size_t spent = 0;
+    do
+    {
+        uint32_t level = residentLevel - 1;
+        const Level& l = levels[level];
+
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0,
+                                  static_cast<GLsizei>(std::max(width >> level, 1u)),
+                                  static_cast<GLsizei>(std::max(height >> level, 1u)),
+                                  internalFormat, static_cast<GLsizei>(l.size), l.data);
+
+        spent += l.size;
+        residentLevel = level;
+
+        // get the kernel reading the next level while this frame renders
+        if (level > 0)
+            adviseLevel(level - 1);
+    } while (residentLevel > 0 && spent + levels[residentLevel - 1].size <= byteBudget);
+
+    // sampling stays on the levels that have data
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(residentLevel));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // GL has its own copy of everything now
+    if (isComplete())
+        unmap();
+
+    return isComplete();
+}
+
+void KtxTexture::bind(GLint unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
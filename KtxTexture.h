@@ -0,0 +1,92 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_KTXTEXTURE_H
+#define PI_GAME_KTXTEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <GLES3/gl3.h>
+
+// ETC2/EAC compressed texture from a KTX 1.1 file. The file is mmap'd and
+// every mip level goes to glCompressedTexSubImage2D straight out of the
+// mapping, nothing is decoded or generated on the CPU. Levels are streamed
+// coarsest first and GL_TEXTURE_BASE_LEVEL follows the finest resident one,
+// so the texture is usable (if blurry) after the first few hundred bytes.
+class KtxTexture {
+public:
+    // maps and validates the file, no GL calls
+    explicit KtxTexture(const std::string& path);
+    ~KtxTexture();
+
+    KtxTexture(const KtxTexture&) = delete;
+    KtxTexture& operator=(const KtxTexture&) = delete;
+
+    // GL thread only. The first call allocates the storage, then every call
+    // uploads at least one more level and keeps going while the byte budget
+    // lasts. Returns true once all levels are resident.
+    bool streamNext(size_t byteBudget = 256 * 1024);
+
+    void bind(GLint unit) const;
+
+    bool isComplete() const
+    {
+        return residentLevel == 0;
+    }
+
+    GLuint getTexture() const
+    {
+        return texture;
+    }
+
+    uint32_t getWidth() const
+    {
+        return width;
+    }
+
+    uint32_t getHeight() const
+    {
+        return height;
+    }
+
+    uint32_t getLevels() const
+    {
+        return static_cast<uint32_t>(levels.size());
+    }
+
+    // finest mip level uploaded so far, getLevels() before the first upload
+    uint32_t getResidentLevel() const
+    {
+        return residentLevel;
+    }
+
+private:
+    struct Level
+    {
+        const unsigned char* data;
+        uint32_t size;
+    };
+
+    void parse();
+    void adviseLevel(uint32_t level) const;
+    void unmap();
+
+    std::string path;
+    int fd = -1;
+    unsigned char* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    GLenum internalFormat = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<Level> levels;
+    uint32_t residentLevel = 0;
+
+    GLuint texture = 0;
+};
+
+
+#endif //PI_GAME_KTXTEXTURE_H
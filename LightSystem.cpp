@@ -0,0 +1,374 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <glm/vec4.hpp>
+#include "LightSystem.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "MemoryTracker.h"
+
+namespace {
+    constexpr uint32_t tilesPerSlice = LightSystem::tilesX * LightSystem::tilesY;
+
+    // std140 layout of the Lights block, two vec4 arrays back to back
+    constexpr GLsizeiptr lightArrayBytes = LightSystem::maxLights * 4 * sizeof(float);
+
+    uint8_t toTile(float ndc, uint32_t tiles)
+    {
+        float t = (ndc * 0.5f + 0.5f) * static_cast<float>(tiles);
+        t = std::min(std::max(t, 0.0f), static_cast<float>(tiles - 1));
+        return static_cast<uint8_t>(t);
+    }
+}
+
+LightSystem::LightSystem(uint32_t viewportWidth, uint32_t viewportHeight)
+    : width(viewportWidth), height(viewportHeight), sliceIndices(slices),
+      grid(clusterCount * 2, 0), indices(maxLightIndices, 0)
+{
+}
+
+LightSystem::~LightSystem()
+{
+    MemoryTracker& memory = MemoryTracker::instance();
+    if (lightBuffer)
+    {
+        memory.untrackBuffer(lightBuffer);
+        glDeleteBuffers(1, &lightBuffer);
+    }
+    if (gridTexture)
+    {
+        memory.untrackTexture(gridTexture);
+        glDeleteTextures(1, &gridTexture);
+    }
+    if (indexTexture)
+    {
+        memory.untrackTexture(indexTexture);
+        glDeleteTextures(1, &indexTexture);
+    }
+}
+
+uint32_t LightSystem::add(const PointLight& light)
+{
+    if (lights.size() >= maxLights)
+        throw std::runtime_error("Too many lights, the uniform block holds " + std::to_string(maxLights));
+
+    lights.push_back(light);
+    return static_cast<uint32_t>(lights.size() - 1);
+}
+
+void LightSystem::set(uint32_t index, const PointLight& light)
+{
+    lights[index] = light;
+}
+
+void LightSystem::clear()
+{
+    lights.clear();
+}
+
+uint32_t LightSystem::sliceFor(float depth) const
+{
+    // slices grow exponentially with distance, the same formula runs per
+    // fragment in tutorial2.frag
+    float s = std::log(depth) * sliceScale + sliceBias;
+    s = std::min(std::max(s, 0.0f), static_cast<float>(slices - 1));
+    return static_cast<uint32_t>(s);
+}
+
+void LightSystem::computeBounds(size_t first, size_t last, const glm::mat4& view, const glm::mat4& projection)
+{
+    for (size_t i = first; i < last; i++)
+    {
+        const PointLight& light = lights[i];
+        LightBounds& b = bounds[i];
+        b = { 1, 0, 1, 0, 1, 0 };
+
+        glm::vec4 center = view * glm::vec4(light.position, 1.0f);
+        float depth = -center.z;
+        float r = light.radius;
+
+        if (depth + r < nearPlane || depth - r > farPlane)
+            continue;
+
+        b.z0 = static_cast<uint8_t>(sliceFor(std::max(depth - r, nearPlane)));
+        b.z1 = static_cast<uint8_t>(sliceFor(std::min(depth + r, farPlane)));
+
+        if (depth - r <= nearPlane)
+        {
+            // the camera is inside or right next to the light, projecting the
+            // box would wrap around so just cover the whole screen
+            b.x0 = 0;
+            b.x1 = static_cast<uint8_t>(tilesX - 1);
+            b.y0 = 0;
+            b.y1 = static_cast<uint8_t>(tilesY - 1);
+            continue;
+        }
+
+        // screen rectangle of the view space box around the sphere
+        float minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 p(center.x + ((corner & 1) ? r : -r),
+                        center.y + ((corner & 2) ? r : -r),
+                        center.z + ((corner & 4) ? r : -r),
+                        1.0f);
+            glm::vec4 clip = projection * p;
+            float x = clip.x / clip.w;
+            float y = clip.y / clip.w;
+            if (corner == 0)
+            {
+                minX = maxX = x;
+                minY = maxY = y;
+            }
+            else
+            {
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minY = std::min(minY, y);
+                maxY = std::max(maxY, y);
+            }
+        }
+
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+        {
+            b.z0 = 1;
+            b.z1 = 0;
+            continue;
+        }
+
+        b.x0 = toTile(minX, tilesX);
+        b.x1 = toTile(maxX, tilesX);
+        b.y0 = toTile(minY, tilesY);
+        b.y1 = toTile(maxY, tilesY);
+    }
+}
+
+void LightSystem::binSlice(uint32_t slice)
+{
+    uint16_t* cells = &grid[slice * tilesPerSlice * 2];
+    std::vector<uint16_t>& list = sliceIndices[slice];
+
+    // count, prefix sum, then fill, so the list never reallocates mid way
+    std::memset(cells, 0, tilesPerSlice * 2 * sizeof(uint16_t));
+
+    size_t total = 0;
+    for (const LightBounds& b : bounds)
+    {
+        if (slice < b.z0 || slice > b.z1 || b.x0 > b.x1)
+            continue;
+
+        for (uint32_t y = b.y0; y <= b.y1; y++)
+            for (uint32_t x = b.x0; x <= b.x1; x++)
+                cells[(y * tilesX + x) * 2 + 1]++;
+        total += static_cast<size_t>(b.x1 - b.x0 + 1) * static_cast<size_t>(b.y1 - b.y0 + 1);
+    }
+
+    // a slice can't reference more than the whole index texture anyway
+    total = std::min(total, static_cast<size_t>(maxLightIndices));
+    list.resize(total);
+    if (total == 0)
+        return;
+
+    uint32_t offset = 0;
+    for (uint32_t cell = 0; cell < tilesPerSlice; cell++)
+    {
+        cells[cell * 2] = static_cast<uint16_t>(std::min(offset, maxLightIndices));
+        offset += cells[cell * 2 + 1];
+        cells[cell * 2 + 1] = 0;
+    }
+
+    for (size_t i = 0; i < bounds.size(); i++)
+    {
+        const LightBounds& b = bounds[i];
+        if (slice < b.z0 || slice > b.z1 || b.x0 > b.x1)
+            continue;
+
+        for (uint32_t y = b.y0; y <= b.y1; y++)
+        {
+            for (uint32_t x = b.x0; x <= b.x1; x++)
+            {
+                uint16_t* cell = &cells[(y * tilesX + x) * 2];
+                uint32_t at = static_cast<uint32_t>(cell[0]) + cell[1];
+                if (at < total)
+                    list[at] = static_cast<uint16_t>(i);
+                cell[1]++;
+            }
+        }
+    }
+}
+
+void LightSystem::update(const glm::mat4& view, const glm::mat4& projection, float nearZ, float farZ,
+                         JobSystem* jobs)
+{
+    nearPlane = nearZ;
+    farPlane = farZ;
+    sliceScale = static_cast<float>(slices) / std::log(farPlane / nearPlane);
+    sliceBias = -sliceScale * std::log(nearPlane);
+
+    const size_t active = std::min(lights.size(), static_cast<size_t>(budget));
+    bounds.resize(active);
+
+    if (jobs)
+    {
+        jobs->parallelFor(0, active, 32, [&](size_t first, size_t last) {
+            computeBounds(first, last, view, projection);
+        });
+        jobs->parallelFor(0, slices, 1, [this](size_t first, size_t last) {
+            for (size_t s = first; s < last; s++)
+                binSlice(static_cast<uint32_t>(s));
+        });
+    }
+    else
+    {
+        computeBounds(0, active, view, projection);
+        for (uint32_t s = 0; s < slices; s++)
+            binSlice(s);
+    }
+
+    // stitch the slices into one index list, rebasing the cluster offsets
+    indexCount = 0;
+    overflowed = false;
+    for (uint32_t s = 0; s < slices; s++)
+    {
+        const std::vector<uint16_t>& list = sliceIndices[s];
+        uint32_t available = maxLightIndices - indexCount;
+        uint32_t used = static_cast<uint32_t>(std::min(list.size(), static_cast<size_t>(available)));
+
+        uint16_t* cells = &grid[s * tilesPerSlice * 2];
+        for (uint32_t cell = 0; cell < tilesPerSlice; cell++)
+        {
+            uint32_t offset = cells[cell * 2];
+            uint32_t count = cells[cell * 2 + 1];
+            if (offset + count > used)
+            {
+                overflowed = true;
+                count = offset < used ? used - offset : 0;
+            }
+            cells[cell * 2] = static_cast<uint16_t>(count ? indexCount + offset : 0);
+            cells[cell * 2 + 1] = static_cast<uint16_t>(count);
+        }
+
+        if (used)
+            std::memcpy(&indices[indexCount], list.data(), used * sizeof(uint16_t));
+        indexCount += used;
+    }
+}
+
+void LightSystem::createObjects()
+{
+    glGenBuffers(1, &lightBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, lightArrayBytes * 2, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    MemoryTracker::instance().trackBuffer(lightBuffer, MemoryCategory::UniformBuffer, static_cast<size_t>(lightArrayBytes * 2));
+
+    // integer textures can't be filtered, everything is read with texelFetch
+    auto makeTexture = [](GLuint& texture, GLenum format, GLsizei w, GLsizei h) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, w, h);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+
+    makeTexture(gridTexture, GL_RG16UI, tilesPerSlice, slices);
+    makeTexture(indexTexture, GL_R16UI, indexTextureWidth, maxLightIndices / indexTextureWidth);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    MemoryTracker::instance().trackTexture(gridTexture, grid.size() * sizeof(uint16_t));
+    MemoryTracker::instance().trackTexture(indexTexture, indices.size() * sizeof(uint16_t));
+
+    if (glGetError() != GL_NO_ERROR)
+        throw std::runtime_error("Failed creating the cluster light buffers");
+}
+
+void LightSystem::upload(FrameArena* arena)
+{
+    if (!lightBuffer)
+        createObjects();
+
+    if (!lights.empty())
+    {
+        ArenaVector<float> packed(lights.size() * 8, 0.0f, ArenaAllocator<float>(arena));
+        float* posRadius = packed.data();
+        float* color = packed.data() + lights.size() * 4;
+        for (const PointLight& light : lights)
+        {
+            *posRadius++ = light.position.x;
+            *posRadius++ = light.position.y;
+            *posRadius++ = light.position.z;
+            *posRadius++ = light.radius;
+            *color++ = light.color.x * light.intensity;
+            *color++ = light.color.y * light.intensity;
+            *color++ = light.color.z * light.intensity;
+            *color++ = 1.0f;
+        }
+
+        GLsizeiptr bytes = static_cast<GLsizeiptr>(lights.size() * 4 * sizeof(float));
+        glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, bytes, packed.data());
+        glBufferSubData(GL_UNIFORM_BUFFER, lightArrayBytes, bytes, packed.data() + lights.size() * 4);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+
+    glBindTexture(GL_TEXTURE_2D, gridTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tilesPerSlice, slices, GL_RG_INTEGER, GL_UNSIGNED_SHORT, grid.data());
+
+    // only the rows that hold this frame's lists
+    GLsizei rows = static_cast<GLsizei>((indexCount + indexTextureWidth - 1) / indexTextureWidth);
+    if (rows > 0)
+    {
+        glBindTexture(GL_TEXTURE_2D, indexTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, indexTextureWidth, rows, GL_RED_INTEGER, GL_UNSIGNED_SHORT,
+                        indices.data());
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+const LightSystem::ProgramBinding& LightSystem::getBinding(GLuint program) const
+{
+    for (const ProgramBinding& binding : programs)
+        if (binding.program == program)
+            return binding;
+
+    // block binding and samplers are program state and never change, set them once
+    GLuint blockIndex = glGetUniformBlockIndex(program, "Lights");
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, blockIndex, lightsBinding);
+    glUniform1i(glGetUniformLocation(program, "clusterGrid"), clusterGridUnit);
+    glUniform1i(glGetUniformLocation(program, "lightIndices"), lightIndicesUnit);
+
+    programs.push_back({ program, glGetUniformLocation(program, "clusterParams"),
+                         glGetUniformLocation(program, "clusterDepth") });
+    return programs.back();
+}
+
+void LightSystem::bind(GLuint program) const
+{
+    const ProgramBinding& binding = getBinding(program);
+    glBindBufferBase(GL_UNIFORM_BUFFER, lightsBinding, lightBuffer);
+
+    glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(clusterGridUnit));
+    glBindTexture(GL_TEXTURE_2D, gridTexture);
+    glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(lightIndicesUnit));
+    glBindTexture(GL_TEXTURE_2D, indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform4f(binding.clusterParams,
+                static_cast<float>(width) / static_cast<float>(tilesX),
+                static_cast<float>(height) / static_cast<float>(tilesY),
+                sliceScale, sliceBias);
+    glUniform2f(binding.clusterDepth, nearPlane, farPlane);
+}
@@ -0,0 +1,163 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_LIGHTSYSTEM_H
+#define PI_GAME_LIGHTSYSTEM_H
+
+#include <cstdint>
+#include <vector>
+#include <GLES3/gl3.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+class JobSystem;
+class FrameArena;
+
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float intensity;
+};
+
+// Clustered forward lighting. Every frame the lights are binned on the CPU
+// into a grid of screen tiles times exponential depth slices. The GPU gets
+// the lights in a uniform block, (offset, count) per cluster in an RG16UI
+// texture and the flattened light index lists in an R16UI texture, so a
+// fragment only loops over the lights touching its own cluster.
+// The sizes below are mirrored as defines in tutorial2.frag.
+class LightSystem {
+public:
+    static constexpr uint32_t maxLights = 256;
+    static constexpr uint32_t tilesX = 16;
+    static constexpr uint32_t tilesY = 9;
+    static constexpr uint32_t slices = 24;
+    static constexpr uint32_t clusterCount = tilesX * tilesY * slices;
+
+    static constexpr uint32_t indexTextureWidth = 1024;
+    static constexpr uint32_t maxLightIndices = indexTextureWidth * 32;
+
+    // uniform block binding point and texture units used by bind()
+    static constexpr GLuint lightsBinding = 0;
+    static constexpr GLint clusterGridUnit = 4;
+    static constexpr GLint lightIndicesUnit = 5;
+
+    LightSystem(uint32_t viewportWidth, uint32_t viewportHeight);
+    ~LightSystem();
+
+    LightSystem(const LightSystem&) = delete;
+    LightSystem& operator=(const LightSystem&) = delete;
+
+    // size in pixels of what gets rendered, tiles are laid out over it
+    void setViewport(uint32_t viewportWidth, uint32_t viewportHeight)
+    {
+        width = viewportWidth;
+        height = viewportHeight;
+    }
+
+    uint32_t add(const PointLight& light);
+    void set(uint32_t index, const PointLight& light);
+    void clear();
+
+    const PointLight& get(uint32_t index) const
+    {
+        return lights[index];
+    }
+
+    size_t size() const
+    {
+        return lights.size();
+    }
+
+    // Only the first budget lights get binned, the rest stay but light
+    // nothing. For the quality governor, add the important lights first.
+    void setBudget(uint32_t lightBudget)
+    {
+        budget = lightBudget;
+    }
+
+    uint32_t getBudget() const
+    {
+        return budget;
+    }
+
+    // Bins all lights against the camera, runs one job per depth slice when
+    // a job system is given. Call from a worker of that system.
+    void update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+                JobSystem* jobs = nullptr);
+
+    // GL thread only, sends the result of the last update(). Staging comes
+    // out of the arena when one is given.
+    void upload(FrameArena* arena = nullptr);
+
+    // Hooks the light data into a program built with SHADER_LIGHTING_CLUSTERED.
+    // The program has to be in use. The block binding, sampler units and
+    // uniform locations are looked up on the first bind of a program only,
+    // so don't hand in a program name that was deleted and reused.
+    void bind(GLuint program) const;
+
+    // light indices written by the last update(), all clusters together
+    uint32_t getIndexCount() const
+    {
+        return indexCount;
+    }
+
+    // true if the last update() ran out of room and dropped light indices
+    bool hasOverflowed() const
+    {
+        return overflowed;
+    }
+
+private:
+    // inclusive cluster ranges a light touches, empty when x0 > x1
+    struct LightBounds
+    {
+        uint8_t x0, x1, y0, y1, z0, z1;
+    };
+
+    void computeBounds(size_t first, size_t last, const glm::mat4& view, const glm::mat4& projection);
+    void binSlice(uint32_t slice);
+    // what bind() looked up for one program
+    struct ProgramBinding
+    {
+        GLuint program;
+        GLint clusterParams;
+        GLint clusterDepth;
+    };
+
+    uint32_t sliceFor(float depth) const;
+    void createObjects();
+    const ProgramBinding& getBinding(GLuint program) const;
+
+    uint32_t width;
+    uint32_t height;
+
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    float sliceScale = 0.0f;
+    float sliceBias = 0.0f;
+
+    std::vector<PointLight> lights;
+    std::vector<LightBounds> bounds;    // of the lights within budget
+    uint32_t budget = maxLights;
+
+    // per slice (offset, count) pairs relative to the slice and index lists,
+    // stitched together into grid/indices after all slices are binned
+    std::vector<std::vector<uint16_t>> sliceIndices;
+
+    // (offset, count) per cluster, tiles along x and slices along y
+    std::vector<uint16_t> grid;
+    std::vector<uint16_t> indices;
+    uint32_t indexCount = 0;
+    bool overflowed = false;
+
+    GLuint lightBuffer = 0;
+    GLuint gridTexture = 0;
+    GLuint indexTexture = 0;
+    mutable std::vector<ProgramBinding> programs;
+};
+
+
+#endif //PI_GAME_LIGHTSYSTEM_H
@@ -0,0 +1,201 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include "MemoryTracker.h"
+
+namespace {
+    void raisePeak(std::atomic<size_t>& peak, size_t value)
+    {
+        size_t current = peak.load(std::memory_order_relaxed);
+        while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    double toMiB(size_t bytes)
+    {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+}
+
+MemoryTracker& MemoryTracker::instance()
+{
+    static MemoryTracker tracker;
+    return tracker;
+}
+
+const char* MemoryTracker::getName(MemoryCategory category)
+{
+    switch (category)
+    {
+        case MemoryCategory::MeshCpu: return "mesh (cpu)";
+        case MemoryCategory::VertexBuffer: return "vertex buffers";
+        case MemoryCategory::IndexBuffer: return "index buffers";
+        case MemoryCategory::InstanceBuffer: return "instance buffers";
+        case MemoryCategory::UniformBuffer: return "uniform buffers";
+        case MemoryCategory::Texture: return "textures";
+        case MemoryCategory::RenderTarget: return "render targets";
+        default: return "unknown";
+    }
+}
+
+void MemoryTracker::allocate(MemoryCategory category, size_t bytes)
+{
+    if (bytes == 0)
+        return;
+
+    Counters& c = counters[static_cast<size_t>(category)];
+    size_t live = c.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    raisePeak(c.peak, live);
+
+    size_t total = totalLive.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raisePeak(totalPeak, total);
+}
+
+void MemoryTracker::release(MemoryCategory category, size_t bytes)
+{
+    if (bytes == 0)
+        return;
+
+    Counters& c = counters[static_cast<size_t>(category)];
+    c.live.fetch_sub(bytes, std::memory_order_relaxed);
+    c.releases.fetch_add(1, std::memory_order_relaxed);
+    totalLive.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryTracker::trackObject(std::unordered_map<GLuint, GLObject>& objects, GLuint name,
+                                MemoryCategory category, size_t bytes)
+{
+    GLObject previous { category, 0 };
+    {
+        std::lock_guard<std::mutex> lock(objectMutex);
+        auto it = objects.find(name);
+        if (it != objects.end())
+            previous = it->second;
+        objects[name] = { category, bytes };
+    }
+
+    release(previous.category, previous.bytes);
+    allocate(category, bytes);
+}
+
+void MemoryTracker::untrackObject(std::unordered_map<GLuint, GLObject>& objects, GLuint name)
+{
+    GLObject previous;
+    {
+        std::lock_guard<std::mutex> lock(objectMutex);
+        auto it = objects.find(name);
+        if (it == objects.end())
+            return;
+        previous = it->second;
+        objects.erase(it);
+    }
+
+    release(previous.category, previous.bytes);
+}
+
+void MemoryTracker::trackBuffer(GLuint buffer, MemoryCategory category, size_t bytes)
+{
+    trackObject(buffers, buffer, category, bytes);
+}
+
+void MemoryTracker::untrackBuffer(GLuint buffer)
+{
+    untrackObject(buffers, buffer);
+}
+
+void MemoryTracker::trackTexture(GLuint texture, size_t bytes)
+{
+    trackObject(textures, texture, MemoryCategory::Texture, bytes);
+}
+
+void MemoryTracker::untrackTexture(GLuint texture)
+{
+    untrackObject(textures, texture);
+}
+
+void MemoryTracker::trackRenderbuffer(GLuint renderbuffer, size_t bytes)
+{
+    trackObject(renderbuffers, renderbuffer, MemoryCategory::RenderTarget, bytes);
+}
+
+void MemoryTracker::untrackRenderbuffer(GLuint renderbuffer)
+{
+    untrackObject(renderbuffers, renderbuffer);
+}
+
+MemoryTracker::Stats MemoryTracker::getStats(MemoryCategory category) const
+{
+    const Counters& c = counters[static_cast<size_t>(category)];
+    return {
+        c.live.load(std::memory_order_relaxed),
+        c.peak.load(std::memory_order_relaxed),
+        c.allocations.load(std::memory_order_relaxed),
+        c.releases.load(std::memory_order_relaxed)
+    };
+}
+
+size_t MemoryTracker::getTotalLive() const
+{
+    return totalLive.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::getTotalPeak() const
+{
+    return totalPeak.load(std::memory_order_relaxed);
+}
+
+void MemoryTracker::dump(FILE* out) const
+{
+    fprintf(out, "memory: %-18s %10s %10s %8s %8s\n", "category", "live MiB", "peak MiB", "allocs", "frees");
+    for (size_t i = 0; i < categoryCount; i++)
+    {
+        Stats s = getStats(static_cast<MemoryCategory>(i));
+        fprintf(out, "memory: %-18s %10.2f %10.2f %8llu %8llu\n", getName(static_cast<MemoryCategory>(i)),
+                toMiB(s.live), toMiB(s.peak),
+                static_cast<unsigned long long>(s.allocations), static_cast<unsigned long long>(s.releases));
+    }
+
+    size_t live = getTotalLive();
+    fprintf(out, "memory: %-18s %10.2f %10.2f", "total", toMiB(live), toMiB(getTotalPeak()));
+    if (budget)
+        fprintf(out, "  of %.2f MiB budget%s", toMiB(budget), live > budget ? "  OVER BUDGET" : "");
+    fprintf(out, "\n");
+}
+
+void MemoryTracker::dumpEvery(std::chrono::steady_clock::duration interval, FILE* out)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastDump < interval)
+        return;
+
+    lastDump = now;
+    dump(out);
+}
+
+size_t MemoryTracker::reportLeaks(FILE* out) const
+{
+    size_t leaked = getTotalLive();
+    if (leaked == 0)
+        return 0;
+
+    fprintf(out, "memory: %zu bytes still live\n", leaked);
+    for (size_t i = 0; i < categoryCount; i++)
+    {
+        Stats s = getStats(static_cast<MemoryCategory>(i));
+        if (s.live)
+            fprintf(out, "memory:   %-18s %zu bytes\n", getName(static_cast<MemoryCategory>(i)), s.live);
+    }
+
+    std::lock_guard<std::mutex> lock(objectMutex);
+    for (const auto& b : buffers)
+        fprintf(out, "memory:   buffer %u, %s, %zu bytes\n", b.first, getName(b.second.category), b.second.bytes);
+    for (const auto& t : textures)
+        fprintf(out, "memory:   texture %u, %zu bytes\n", t.first, t.second.bytes);
+    for (const auto& r : renderbuffers)
+        fprintf(out, "memory:   renderbuffer %u, %zu bytes\n", r.first, r.second.bytes);
+
+    return leaked;
+}
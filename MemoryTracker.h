@@ -0,0 +1,119 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_MEMORYTRACKER_H
+#define PI_GAME_MEMORYTRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include <GLES3/gl3.h>
+
+enum class MemoryCategory : uint8_t
+{
+    MeshCpu,            // vertex and index arrays kept by Model
+    VertexBuffer,
+    IndexBuffer,
+    InstanceBuffer,
+    UniformBuffer,
+    Texture,
+    RenderTarget,       // offscreen colour/depth renderbuffers
+    Count
+};
+
+// Counts live and peak bytes per category for CPU side mesh data and GL
+// buffers/textures. On the Pi the GPU carve-out and the CPU heap come out of
+// the same RAM, so both go against one budget. GL objects are keyed by name,
+// re-specifying a buffer replaces its old size instead of adding to it.
+class MemoryTracker {
+public:
+    struct Stats
+    {
+        size_t live;
+        size_t peak;
+        uint64_t allocations;
+        uint64_t releases;
+    };
+
+    static MemoryTracker& instance();
+
+    // plain byte counts, safe from any thread
+    void allocate(MemoryCategory category, size_t bytes);
+    void release(MemoryCategory category, size_t bytes);
+
+    // GL objects, call after glBufferData / glTexStorage2D and before delete
+    void trackBuffer(GLuint buffer, MemoryCategory category, size_t bytes);
+    void untrackBuffer(GLuint buffer);
+    void trackTexture(GLuint texture, size_t bytes);
+    void untrackTexture(GLuint texture);
+    void trackRenderbuffer(GLuint renderbuffer, size_t bytes);
+    void untrackRenderbuffer(GLuint renderbuffer);
+
+    Stats getStats(MemoryCategory category) const;
+    size_t getTotalLive() const;
+    size_t getTotalPeak() const;
+
+    // combined CPU + GPU budget in bytes, 0 means none; dump() flags overruns
+    void setBudget(size_t bytes)
+    {
+        budget = bytes;
+    }
+
+    size_t getBudget() const
+    {
+        return budget;
+    }
+
+    void dump(FILE* out = stdout) const;
+
+    // dumps at most once per interval, call once per frame
+    void dumpEvery(std::chrono::steady_clock::duration interval, FILE* out = stdout);
+
+    // Everything still live is a leak once the owners are gone. Prints what
+    // is left and returns the byte count.
+    size_t reportLeaks(FILE* out = stderr) const;
+
+    static const char* getName(MemoryCategory category);
+
+private:
+    MemoryTracker() = default;
+
+    struct Counters
+    {
+        std::atomic<size_t> live { 0 };
+        std::atomic<size_t> peak { 0 };
+        std::atomic<uint64_t> allocations { 0 };
+        std::atomic<uint64_t> releases { 0 };
+    };
+
+    struct GLObject
+    {
+        MemoryCategory category;
+        size_t bytes;
+    };
+
+    static constexpr size_t categoryCount = static_cast<size_t>(MemoryCategory::Count);
+
+    void trackObject(std::unordered_map<GLuint, GLObject>& objects, GLuint name, MemoryCategory category, size_t bytes);
+    void untrackObject(std::unordered_map<GLuint, GLObject>& objects, GLuint name);
+
+    Counters counters[categoryCount];
+    std::atomic<size_t> totalLive { 0 };
+    std::atomic<size_t> totalPeak { 0 };
+    size_t budget = 0;
+
+    mutable std::mutex objectMutex;
+    std::unordered_map<GLuint, GLObject> buffers;
+    std::unordered_map<GLuint, GLObject> textures;
+    std::unordered_map<GLuint, GLObject> renderbuffers;
+
+    std::chrono::steady_clock::time_point lastDump;
+};
+
+
+#endif //PI_GAME_MEMORYTRACKER_H
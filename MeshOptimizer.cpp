@@ -0,0 +1,284 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include "MeshOptimizer.h"
+
+MeshOptimizer::Stats MeshOptimizer::optimize(Model& model, const Options& options)
+{
+    Stats stats;
+
+    GLuint* indices = model.getIndPtr();
+    if (!indices)
+        return stats;   // already shrunk, nothing left to do
+
+    size_t numIndices = static_cast<size_t>(model.getNumIndices());
+    size_t numVerts = static_cast<size_t>(model.getNumVerts());
+
+    // Every index its own vertex (flat shading): each one is a cache miss in
+    // any triangle order, ACMR stays 3.0, so skip straight to the cheap steps
+    if (!sharesVertices(indices, numIndices, numVerts))
+    {
+        stats.unsharedVertices = true;
+        reorderVertices(indices, numIndices, model.getDataPtr(), numVerts);
+        if (options.shrinkIndices)
+            stats.shortIndices = model.shrinkIndices();
+        return stats;
+    }
+
+    stats.acmrBefore = computeACMR(indices, numIndices, numVerts, options.cacheSize);
+
+    std::vector<size_t> clusterStarts;
+    std::vector<GLuint> ordered = tipsify(indices, numIndices, numVerts, options.cacheSize, clusterStarts);
+    stats.clusters = clusterStarts.size();
+
+    if (options.sortForOverdraw)
+        sortClustersForOverdraw(ordered, clusterStarts, model.getDataPtr(), numVerts);
+
+    std::copy(ordered.begin(), ordered.end(), indices);
+    reorderVertices(indices, numIndices, model.getDataPtr(), numVerts);
+
+    stats.acmrAfter = computeACMR(indices, numIndices, numVerts, options.cacheSize);
+
+    if (options.shrinkIndices)
+        stats.shortIndices = model.shrinkIndices();
+
+    return stats;
+}
+
+float MeshOptimizer::computeACMR(const GLuint* indices, size_t numIndices, size_t numVerts, unsigned cacheSize)
+{
+    if (numIndices < 3)
+        return 0.0f;
+
+    // FIFO cache, a vertex is in it while its entry time is within the last cacheSize misses
+    std::vector<size_t> entered(numVerts, 0);
+    size_t misses = 0;
+
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        GLuint v = indices[i];
+        if (entered[v] == 0 || misses - entered[v] >= cacheSize)
+        {
+            misses++;
+            entered[v] = misses;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(numIndices / 3);
+}
+
+std::vector<GLuint> MeshOptimizer::tipsify(const GLuint* indices, size_t numIndices, size_t numVerts,
+                                           unsigned cacheSize, std::vector<size_t>& clusterStarts)
+{
+    const size_t numTris = numIndices / 3;
+    const long k = static_cast<long>(cacheSize);
+
+    // vertex -> triangle adjacency in CSR form
+    std::vector<GLuint> liveCount(numVerts, 0);
+    for (size_t i = 0; i < numTris * 3; i++)
+        liveCount[indices[i]]++;
+
+    std::vector<size_t> adjOffset(numVerts + 1, 0);
+    for (size_t v = 0; v < numVerts; v++)
+        adjOffset[v + 1] = adjOffset[v] + liveCount[v];
+
+    std::vector<GLuint> adjacency(adjOffset[numVerts]);
+    std::vector<size_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+    for (size_t t = 0; t < numTris; t++)
+        for (size_t c = 0; c < 3; c++)
+            adjacency[fill[indices[t * 3 + c]]++] = static_cast<GLuint>(t);
+
+    std::vector<long> cacheTime(numVerts, 0);
+    std::vector<bool> emitted(numTris, false);
+    std::vector<GLuint> deadEnd;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> output;
+    output.reserve(numTris * 3);
+    clusterStarts.clear();
+
+    long timeStamp = k + 1;
+    size_t cursor = 0;
+    long fanning = numVerts > 0 ? 0 : -1;
+    bool newCluster = true;
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        size_t f = static_cast<size_t>(fanning);
+
+        for (size_t a = adjOffset[f]; a < adjOffset[f + 1]; a++)
+        {
+            GLuint t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            if (newCluster)
+            {
+                clusterStarts.push_back(output.size() / 3);
+                newCluster = false;
+            }
+
+            for (size_t c = 0; c < 3; c++)
+            {
+                GLuint v = indices[t * 3 + c];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveCount[v]--;
+
+                if (timeStamp - cacheTime[v] > k)
+                    cacheTime[v] = timeStamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // best candidate: still has live triangles and will still be cached after fanning it
+        long next = -1;
+        long best = -1;
+        for (GLuint v : candidates)
+        {
+            if (liveCount[v] == 0)
+                continue;
+
+            long priority = 0;
+            if (timeStamp - cacheTime[v] + 2 * static_cast<long>(liveCount[v]) <= k)
+                priority = timeStamp - cacheTime[v];
+
+            if (priority > best)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if (next == -1)
+        {
+            // dead end, the cache is effectively flushed, start a new cluster
+            newCluster = true;
+
+            while (!deadEnd.empty() && next == -1)
+            {
+                GLuint d = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveCount[d] > 0)
+                    next = d;
+            }
+
+            while (next == -1 && cursor < numVerts)
+            {
+                if (liveCount[cursor] > 0)
+                    next = static_cast<long>(cursor);
+                cursor++;
+            }
+        }
+
+        fanning = next;
+    }
+
+    return output;
+}
+
+void MeshOptimizer::sortClustersForOverdraw(std::vector<GLuint>& indices, const std::vector<size_t>& clusterStarts,
+                                            const VertData* verts, size_t numVerts)
+{
+    if (clusterStarts.size() < 2 || numVerts == 0)
+        return;
+
+    const size_t numTris = indices.size() / 3;
+
+    float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t v = 0; v < numVerts; v++)
+        for (int c = 0; c < 3; c++)
+            meshCenter[c] += verts[v].position[c];
+    for (float& c : meshCenter)
+        c /= static_cast<float>(numVerts);
+
+    struct Cluster
+    {
+        size_t first;
+        size_t last;
+        float occlusion;
+    };
+    std::vector<Cluster> clusters;
+
+    // view independent occlusion potential: clusters facing away from the
+    // mesh center sit on the outside and tend to hide the rest, draw them first
+    for (size_t i = 0; i < clusterStarts.size(); i++)
+    {
+        Cluster cl { clusterStarts[i], i + 1 < clusterStarts.size() ? clusterStarts[i + 1] : numTris, 0.0f };
+
+        float centroid[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        for (size_t t = cl.first; t < cl.last; t++)
+        {
+            const float* p0 = verts[indices[t * 3]].position;
+            const float* p1 = verts[indices[t * 3 + 1]].position;
+            const float* p2 = verts[indices[t * 3 + 2]].position;
+
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+            // area weighted normal
+            normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+            normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+            normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+
+            for (int c = 0; c < 3; c++)
+                centroid[c] += (p0[c] + p1[c] + p2[c]) / 3.0f;
+        }
+
+        float tris = static_cast<float>(cl.last - cl.first);
+        for (int c = 0; c < 3; c++)
+            cl.occlusion += (centroid[c] / tris - meshCenter[c]) * normal[c];
+
+        clusters.push_back(cl);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.occlusion > b.occlusion;
+    });
+
+    std::vector<GLuint> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& cl : clusters)
+        sorted.insert(sorted.end(), indices.begin() + static_cast<long>(cl.first * 3),
+                      indices.begin() + static_cast<long>(cl.last * 3));
+    indices.swap(sorted);
+}
+
+bool MeshOptimizer::sharesVertices(const GLuint* indices, size_t numIndices, size_t numVerts)
+{
+    std::vector<bool> used(numVerts, false);
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        if (used[indices[i]])
+            return true;
+        used[indices[i]] = true;
+    }
+    return false;
+}
+
+void MeshOptimizer::reorderVertices(GLuint* indices, size_t numIndices, VertData* verts, size_t numVerts)
+{
+    const GLuint unused = 0xffffffffu;
+    std::vector<GLuint> remap(numVerts, unused);
+    GLuint next = 0;
+
+    // vertices in order of first reference, never referenced ones go last
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        if (remap[indices[i]] == unused)
+            remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+    for (size_t v = 0; v < numVerts; v++)
+        if (remap[v] == unused)
+            remap[v] = next++;
+
+    std::vector<VertData> original(verts, verts + numVerts);
+    for (size_t v = 0; v < numVerts; v++)
+        verts[remap[v]] = original[v];
+}
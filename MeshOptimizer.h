@@ -0,0 +1,61 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_MESHOPTIMIZER_H
+#define PI_GAME_MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+#include "Model.h"
+
+// Pre-upload pass over a Model's buffers:
+//  1. triangle order for the post-transform vertex cache (Tipsify, Sander et al. 2007)
+//  2. optionally, sort Tipsify's clusters outside-in to cut overdraw
+//  3. vertex order for fetch locality (order of first use)
+//  4. 16 bit indices whenever the vertex count allows it
+// A mesh where no vertex is used twice only gets 3 and 4, no triangle order
+// can help it.
+class MeshOptimizer {
+public:
+    struct Options
+    {
+        unsigned cacheSize = 16;
+        bool sortForOverdraw = true;
+        bool shrinkIndices = true;
+    };
+
+    struct Stats
+    {
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+        size_t clusters = 0;
+        bool shortIndices = false;
+        bool unsharedVertices = false;  // no index repeats, steps 1 and 2 skipped, ACMRs not computed
+    };
+
+    static Stats optimize(Model& model, const Options& options);
+    static Stats optimize(Model& model)
+    {
+        return optimize(model, Options());
+    }
+
+    // average cache miss ratio, transformed vertices per triangle with a FIFO
+    // cache of the given size. 3.0 is the worst case, ~0.5 the best achievable
+    static float computeACMR(const GLuint* indices, size_t numIndices, size_t numVerts, unsigned cacheSize);
+
+    // returns the new triangle order, clusterStarts receives the first
+    // triangle of every cluster (a new cluster begins at every dead end)
+    static std::vector<GLuint> tipsify(const GLuint* indices, size_t numIndices, size_t numVerts,
+                                       unsigned cacheSize, std::vector<size_t>& clusterStarts);
+
+private:
+    static void sortClustersForOverdraw(std::vector<GLuint>& indices, const std::vector<size_t>& clusterStarts,
+                                        const VertData* verts, size_t numVerts);
+    // true if some vertex is referenced more than once
+    static bool sharesVertices(const GLuint* indices, size_t numIndices, size_t numVerts);
+    static void reorderVertices(GLuint* indices, size_t numIndices, VertData* verts, size_t numVerts);
+};
+
+
+#endif //PI_GAME_MESHOPTIMIZER_H
@@ -0,0 +1,304 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <map>
+#include <queue>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "Meshlets.h"
+#include "FrustumCuller.h"
+
+namespace {
+    bool isVisible(const MeshletSet::Meshlet& m, const Frustum& frustum, const glm::vec3& cameraPosition)
+    {
+        glm::vec3 center(m.center[0], m.center[1], m.center[2]);
+        if (!frustum.intersectsSphere(center, m.radius))
+            return false;
+
+        // every triangle faces away when the camera sits behind the cone's back
+        // side, the bounding sphere makes the apex position irrelevant
+        glm::vec3 toCenter = center - cameraPosition;
+        glm::vec3 axis(m.coneAxis[0], m.coneAxis[1], m.coneAxis[2]);
+        return glm::dot(toCenter, axis) < m.coneCutoff * glm::length(toCenter) + m.radius;
+    }
+
+    // spread the low 10 bits of v so there are two zero bits between each
+    uint32_t expandBits(uint32_t v)
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    template<typename Index>
+    void reorderTriangles(Index* indices, const std::vector<uint32_t>& order)
+    {
+        std::vector<Index> original(indices, indices + order.size() * 3);
+        for (size_t t = 0; t < order.size(); t++)
+            for (size_t c = 0; c < 3; c++)
+                indices[t * 3 + c] = original[order[t] * 3 + c];
+    }
+}
+
+void MeshletSet::build(Model& model, unsigned maxTriangles)
+{
+    meshlets.clear();
+    visible.clear();
+
+    const size_t numTris = static_cast<size_t>(model.getNumIndices()) / 3;
+    const VertData* verts = model.getDataPtr();
+    GLuint* longIndices = model.getIndPtr();
+    GLushort* shortIndices = model.getShortIndPtr();
+    if (numTris == 0 || maxTriangles == 0)
+        return;
+
+    auto index = [&](size_t i) -> size_t {
+        return shortIndices ? shortIndices[i] : longIndices[i];
+    };
+
+    // triangle centroids and the mesh bounds
+    std::vector<glm::vec3> centroids(numTris);
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (size_t t = 0; t < numTris; t++)
+    {
+        glm::vec3 c(0.0f);
+        for (size_t k = 0; k < 3; k++)
+        {
+            const float* p = verts[index(t * 3 + k)].position;
+            c += glm::vec3(p[0], p[1], p[2]);
+        }
+        centroids[t] = c / 3.0f;
+        lo = glm::min(lo, centroids[t]);
+        hi = glm::max(hi, centroids[t]);
+    }
+
+    // Morton order of the triangles decides where new meshlets get seeded
+    glm::vec3 extent = hi - lo;
+    float scale = 1023.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+    std::vector<uint32_t> morton(numTris);
+    for (size_t t = 0; t < numTris; t++)
+    {
+        glm::vec3 q = (centroids[t] - lo) * scale;
+        morton[t] = (expandBits(static_cast<uint32_t>(q.x)) << 2)
+                    | (expandBits(static_cast<uint32_t>(q.y)) << 1)
+                    | expandBits(static_cast<uint32_t>(q.z));
+    }
+
+    std::vector<uint32_t> seedOrder(numTris);
+    for (size_t t = 0; t < numTris; t++)
+        seedOrder[t] = static_cast<uint32_t>(t);
+    std::stable_sort(seedOrder.begin(), seedOrder.end(), [&](uint32_t a, uint32_t b) { return morton[a] < morton[b]; });
+
+    // triangles touching the same position are neighbours, even on flat shaded
+    // meshes where no vertex is shared
+    std::map<std::array<float, 3>, uint32_t> positionIds;
+    std::vector<uint32_t> triPositions(numTris * 3);
+    for (size_t i = 0; i < numTris * 3; i++)
+    {
+        const float* p = verts[index(i)].position;
+        auto inserted = positionIds.emplace(std::array<float, 3>{ p[0], p[1], p[2] },
+                                            static_cast<uint32_t>(positionIds.size()));
+        triPositions[i] = inserted.first->second;
+    }
+
+    std::vector<uint32_t> adjOffset(positionIds.size() + 1, 0);
+    for (uint32_t id : triPositions)
+        adjOffset[id + 1]++;
+    for (size_t i = 1; i < adjOffset.size(); i++)
+        adjOffset[i] += adjOffset[i - 1];
+    std::vector<uint32_t> adjacency(triPositions.size());
+    std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+    for (size_t i = 0; i < triPositions.size(); i++)
+        adjacency[fill[triPositions[i]]++] = static_cast<uint32_t>(i / 3);
+
+    // grow each meshlet as a disc around a seed: always take the closest
+    // neighbouring triangle, seeds are visited in Morton order
+    std::vector<uint32_t> order;
+    std::vector<size_t> meshletStarts;
+    std::vector<bool> assigned(numTris, false);
+    std::vector<bool> queued(numTris, false);
+    std::vector<uint32_t> touched;
+    using Candidate = std::pair<float, uint32_t>;
+
+    for (uint32_t seed : seedOrder)
+    {
+        if (assigned[seed])
+            continue;
+
+        size_t start = order.size();
+        meshletStarts.push_back(start);
+
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+        frontier.push({ 0.0f, seed });
+        queued[seed] = true;
+        touched.push_back(seed);
+
+        while (!frontier.empty() && order.size() - start < maxTriangles)
+        {
+            uint32_t t = frontier.top().second;
+            frontier.pop();
+            assigned[t] = true;
+            order.push_back(t);
+
+            for (size_t k = 0; k < 3; k++)
+            {
+                uint32_t id = triPositions[t * 3 + k];
+                for (uint32_t a = adjOffset[id]; a < adjOffset[id + 1]; a++)
+                {
+                    uint32_t n = adjacency[a];
+                    if (assigned[n] || queued[n])
+                        continue;
+                    queued[n] = true;
+                    touched.push_back(n);
+                    frontier.push({ glm::length(centroids[n] - centroids[seed]), n });
+                }
+            }
+        }
+
+        for (uint32_t t : touched)
+            queued[t] = false;
+        touched.clear();
+
+        // restore the cache friendly order inside the meshlet
+        std::sort(order.begin() + static_cast<long>(start), order.end());
+    }
+    meshletStarts.push_back(numTris);
+
+    if (shortIndices)
+        reorderTriangles(shortIndices, order);
+    else
+        reorderTriangles(longIndices, order);
+
+    for (size_t m = 0; m + 1 < meshletStarts.size(); m++)
+    {
+        size_t first = meshletStarts[m];
+        size_t last = meshletStarts[m + 1];
+
+        glm::vec3 bmin(INFINITY), bmax(-INFINITY), normalSum(0.0f);
+        std::vector<glm::vec3> normals;
+        for (size_t t = first; t < last; t++)
+        {
+            glm::vec3 p[3];
+            for (size_t k = 0; k < 3; k++)
+            {
+                const float* v = verts[index(t * 3 + k)].position;
+                p[k] = glm::vec3(v[0], v[1], v[2]);
+                bmin = glm::min(bmin, p[k]);
+                bmax = glm::max(bmax, p[k]);
+            }
+
+            glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            float len = glm::length(n);
+            if (len > 0.0f)
+            {
+                normals.push_back(n / len);
+                normalSum += n / len;
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.firstIndex = static_cast<uint32_t>(first * 3);
+        meshlet.indexCount = static_cast<uint32_t>((last - first) * 3);
+
+        glm::vec3 center = (bmin + bmax) * 0.5f;
+        float radius = 0.0f;
+        for (size_t i = first * 3; i < last * 3; i++)
+        {
+            const float* v = verts[index(i)].position;
+            radius = std::max(radius, glm::length(glm::vec3(v[0], v[1], v[2]) - center));
+        }
+        meshlet.center[0] = center.x;
+        meshlet.center[1] = center.y;
+        meshlet.center[2] = center.z;
+        meshlet.radius = radius;
+
+        // cone around the average normal, its spread is the worst normal
+        float axisLen = glm::length(normalSum);
+        glm::vec3 axis = axisLen > 0.0f ? normalSum / axisLen : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minDot = axisLen > 0.0f ? 1.0f : -1.0f;
+        for (const auto& n : normals)
+            minDot = std::min(minDot, glm::dot(n, axis));
+
+        meshlet.coneAxis[0] = axis.x;
+        meshlet.coneAxis[1] = axis.y;
+        meshlet.coneAxis[2] = axis.z;
+        meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+
+        meshlets.push_back(meshlet);
+    }
+}
+
+const std::vector<MeshletSet::DrawRange>& MeshletSet::cull(const glm::mat4& modelViewProjection,
+                                                           const glm::vec3& cameraPosition)
+{
+    visible.clear();
+    visibleTriangles = 0;
+
+    // planes of the model space frustum, so the meshlet data never gets transformed
+    Frustum frustum = Frustum::fromMatrix(modelViewProjection);
+
+    for (const Meshlet& m : meshlets)
+    {
+        if (!isVisible(m, frustum, cameraPosition))
+            continue;
+
+        // neighbouring survivors collapse into one draw call
+        if (!visible.empty() && visible.back().firstIndex + visible.back().indexCount == m.firstIndex)
+            visible.back().indexCount += m.indexCount;
+        else
+            visible.push_back({ m.firstIndex, m.indexCount });
+
+        visibleTriangles += m.indexCount / 3;
+    }
+
+    return visible;
+}
+
+void MeshletSet::draw(Model& model) const
+{
+    const GLenum type = model.getIndexType();
+    const GLuint size = model.getIndexSize();
+
+    for (const DrawRange& r : visible)
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(r.indexCount), type,
+                       reinterpret_cast<const GLvoid*>(static_cast<uintptr_t>(r.firstIndex) * size));
+}
+
+size_t MeshletSet::record(CommandBuffer& commands, IndexType indexType, const glm::mat4& modelViewProjection,
+                          const glm::vec3& cameraPosition, size_t first, size_t last) const
+{
+    Frustum frustum = Frustum::fromMatrix(modelViewProjection);
+    last = std::min(last, meshlets.size());
+
+    DrawRange run { 0, 0 };
+    size_t triangles = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        const Meshlet& m = meshlets[i];
+        if (!isVisible(m, frustum, cameraPosition))
+            continue;
+
+        if (run.indexCount > 0 && run.firstIndex + run.indexCount == m.firstIndex)
+        {
+            run.indexCount += m.indexCount;
+        }
+        else
+        {
+            if (run.indexCount > 0)
+                commands.drawIndexed(run.firstIndex, run.indexCount, indexType);
+            run = { m.firstIndex, m.indexCount };
+        }
+        triangles += m.indexCount / 3;
+    }
+    // nothing visible leaves nothing to draw
+    if (run.indexCount > 0)
+        commands.drawIndexed(run.firstIndex, run.indexCount, indexType);
+
+    return triangles;
+}
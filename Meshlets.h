@@ -0,0 +1,72 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_MESHLETS_H
+#define PI_GAME_MESHLETS_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include "Model.h"
+#include "CommandBuffer.h"
+
+// Splits a Model's index buffer into small clusters of spatially close
+// triangles, each with a bounding sphere and a normal cone. At draw time whole
+// clusters that are outside the view or face away from the camera are dropped
+// and only the surviving index ranges are submitted.
+class MeshletSet {
+public:
+    struct Meshlet
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float center[3];
+        float radius;
+        float coneAxis[3];
+        float coneCutoff;       // sin of the cone spread, 1 means never backface culled
+    };
+
+    struct DrawRange
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    // Reorders the model's triangles so every meshlet is one contiguous index
+    // range. Triangles keep their relative order inside a meshlet, so a prior
+    // MeshOptimizer pass still pays off. Call before genBufferObjects().
+    void build(Model& model, unsigned maxTriangles = 128);
+
+    // modelViewProjection = Projection * View * World, cameraPosition in model space
+    const std::vector<DrawRange>& cull(const glm::mat4& modelViewProjection, const glm::vec3& cameraPosition);
+
+    // issues the ranges of the last cull(), the model's VAO has to be bound
+    void draw(Model& model) const;
+
+    // Culls meshlets [first, last) the same way as cull() and records a draw
+    // per run of survivors into commands, returns the triangles kept. Only
+    // reads the set, so jobs can record disjoint ranges at the same time.
+    // Program and VAO are up to the caller.
+    size_t record(CommandBuffer& commands, IndexType indexType, const glm::mat4& modelViewProjection,
+                  const glm::vec3& cameraPosition, size_t first, size_t last) const;
+
+    const std::vector<Meshlet>& getMeshlets() const
+    {
+        return meshlets;
+    }
+
+    size_t getVisibleTriangles() const
+    {
+        return visibleTriangles;
+    }
+
+private:
+    std::vector<Meshlet> meshlets;
+    std::vector<DrawRange> visible;
+    size_t visibleTriangles = 0;
+};
+
+
+#endif //PI_GAME_MESHLETS_H
@@ -1,13 +1,35 @@
 #pragma once 
 
 #include <GLES3/gl3.h> 
+#include <cstddef>
 #include <iostream>
+#include "MemoryTracker.h"
 
 struct VertData
 {
 	GLfloat position[3];
 	GLfloat color[3];
 	GLfloat normal[3];
+	GLfloat texCoord[2];
+};
+
+// GPU side layout used with genBufferObjects(true), 24 instead of 44 bytes.
+// Color is normalized bytes, the normal is GL_INT_2_10_10_10_REV and the
+// texture coordinates are normalized shorts.
+struct PackedVertData
+{
+	GLfloat position[3];
+	GLubyte color[4];
+	GLuint normal;
+	GLushort texCoord[2];
+};
+
+// Per instance attributes for instanced draws (locations 3-7),
+// see setInstanceBuffer()
+struct InstanceData
+{
+	GLfloat world[16];
+	GLfloat color[4];
 };
 
 class Model
@@ -22,6 +44,7 @@ public:
 		indices = new GLuint[numI];
 		numVerts = numV;
 		numIndices = numI;
+		MemoryTracker::instance().allocate(MemoryCategory::MeshCpu, cpuBytes());
 
 		vbo[0] = 0;
 		vao[0] = 0;
@@ -30,54 +53,55 @@ public:
 
 	Model(Model&& m)
 	{
-		delete[] data;
-		delete[] indices;
-
 		data = m.data;
 		indices = m.indices;
+		shortIndices = m.shortIndices;
 
 		m.data = nullptr;
 		m.indices = nullptr;
+		m.shortIndices = nullptr;
 
 		numVerts = m.numVerts;
 		numIndices = m.numIndices;
+		indexType = m.indexType;
 
 		vao[0] = m.vao[0];
 		vbo[0] = m.vbo[0];
 		ebo[0] = m.ebo[0];
-
-		numVerts = m.numVerts;
-		numIndices = m.numIndices;
 	}
 
 	Model& operator=(Model&& m)
 	{
+		MemoryTracker::instance().release(MemoryCategory::MeshCpu, cpuBytes());
 		delete[] data;
 		delete[] indices;
+		delete[] shortIndices;
 
 		data = m.data;
 		indices = m.indices;
+		shortIndices = m.shortIndices;
 
 		m.data = nullptr;
 		m.indices = nullptr;
+		m.shortIndices = nullptr;
 
 		numVerts = m.numVerts;
 		numIndices = m.numIndices;
+		indexType = m.indexType;
 
 		vao[0] = m.vao[0];
 		vbo[0] = m.vbo[0];
 		ebo[0] = m.ebo[0];
 
-		numVerts = m.numVerts;
-		numIndices = m.numIndices;
-
 		return *this;
 	}
 
 	~Model()
 	{
+		MemoryTracker::instance().release(MemoryCategory::MeshCpu, cpuBytes());
 		delete[] data;
 		delete[] indices;
+		delete[] shortIndices;
 	}
 
 	VertData* getDataPtr()
@@ -85,11 +109,54 @@ public:
 		return data;
 	}
 
+	// 32 bit indices, only valid until shrinkIndices() succeeded
 	GLuint* getIndPtr()
 	{
 		return indices;
 	}
 
+	GLushort* getShortIndPtr()
+	{
+		return shortIndices;
+	}
+
+	// GL_UNSIGNED_INT or GL_UNSIGNED_SHORT, pass it to glDrawElements
+	GLenum getIndexType()
+	{
+		return indexType;
+	}
+
+	GLuint getIndexSize()
+	{
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
+	int getNumVerts()
+	{
+		return numVerts;
+	}
+
+	// Switches to 16 bit indices when every vertex is addressable with them,
+	// halving the index buffer. Call after all index edits, before upload.
+	bool shrinkIndices()
+	{
+		if (indexType == GL_UNSIGNED_SHORT)
+			return true;
+		if (numVerts > 65536)
+			return false;
+
+		shortIndices = new GLushort[numIndices];
+		for (GLuint i = 0; i < numIndices; i++)
+			shortIndices[i] = static_cast<GLushort>(indices[i]);
+
+		MemoryTracker::instance().allocate(MemoryCategory::MeshCpu, numIndices * sizeof(GLushort));
+		MemoryTracker::instance().release(MemoryCategory::MeshCpu, numIndices * sizeof(GLuint));
+		delete[] indices;
+		indices = nullptr;
+		indexType = GL_UNSIGNED_SHORT;
+		return true;
+	}
+
 	GLuint getVao()
 	{
 		return vao[0];
@@ -100,7 +167,9 @@ public:
 		return numIndices;
 	}
 
-	void genBufferObjects()
+	// packNormals uploads PackedVertData instead of VertData, pair it with
+	// the SHADER_PACKED_NORMALS shader variant
+	void genBufferObjects(bool packNormals = false)
 	{
 		glGenBuffers(1, vbo);
 		glGenBuffers(1, ebo);
@@ -108,32 +177,76 @@ public:
 		glGenVertexArrays(1, vao);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo[0]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (numIndices * sizeof(GLuint)), indices, GL_STATIC_DRAW);
+		if (indexType == GL_UNSIGNED_SHORT)
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, (numIndices * sizeof(GLushort)), shortIndices, GL_STATIC_DRAW);
+		else
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, (numIndices * sizeof(GLuint)), indices, GL_STATIC_DRAW);
+		MemoryTracker::instance().trackBuffer(ebo[0], MemoryCategory::IndexBuffer, numIndices * getIndexSize());
 
 		glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, (sizeof(VertData) * numVerts), data, GL_STATIC_DRAW);
+		glBindVertexArray(vao[0]);
 
-		uint64_t posSize = 3 * sizeof(GL_FLOAT);
-		uint64_t colorSize = 3 * sizeof(GL_FLOAT);
-		uint64_t normalSize = 3 * sizeof(GL_FLOAT);
-		uint64_t stride = posSize + colorSize + normalSize;
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo[0]);
 
-		uint64_t posOffset = 0;
-		uint64_t colorOffset = posSize;
-		uint64_t normalOffset = posSize + colorSize;
+		if (packNormals)
+		{
+			PackedVertData* packed = new PackedVertData[numVerts];
+			for (GLuint i = 0; i < numVerts; i++)
+				packVertex(data[i], packed[i]);
 
-		glBindVertexArray(vao[0]);
+			glBufferData(GL_ARRAY_BUFFER, (sizeof(PackedVertData) * numVerts), packed, GL_STATIC_DRAW);
+			MemoryTracker::instance().trackBuffer(vbo[0], MemoryCategory::VertexBuffer, sizeof(PackedVertData) * numVerts);
+			delete[] packed;
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo[0]);
+			GLsizei stride = sizeof(PackedVertData);
 
-		glVertexAttribPointer(positionAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(posOffset));
-		glEnableVertexAttribArray(positionAttributeIndex);
+			glVertexAttribPointer(positionAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(PackedVertData, position)));
+			glVertexAttribPointer(colorAttributeIndex, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, reinterpret_cast<GLvoid*>(offsetof(PackedVertData, color)));
+			glVertexAttribPointer(normalAttributeIndex, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, reinterpret_cast<GLvoid*>(offsetof(PackedVertData, normal)));
+			glVertexAttribPointer(texCoordAttributeIndex, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, reinterpret_cast<GLvoid*>(offsetof(PackedVertData, texCoord)));
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, (sizeof(VertData) * numVerts), data, GL_STATIC_DRAW);
+			MemoryTracker::instance().trackBuffer(vbo[0], MemoryCategory::VertexBuffer, sizeof(VertData) * numVerts);
 
-		glVertexAttribPointer(colorAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(colorOffset));
-		glEnableVertexAttribArray(colorAttributeIndex);
+			GLsizei stride = sizeof(VertData);
 
-		glVertexAttribPointer(normalAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(normalOffset));
+			glVertexAttribPointer(positionAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(VertData, position)));
+			glVertexAttribPointer(colorAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(VertData, color)));
+			glVertexAttribPointer(normalAttributeIndex, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(VertData, normal)));
+			glVertexAttribPointer(texCoordAttributeIndex, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(VertData, texCoord)));
+		}
+
+		glEnableVertexAttribArray(positionAttributeIndex);
+		glEnableVertexAttribArray(colorAttributeIndex);
 		glEnableVertexAttribArray(normalAttributeIndex);
+		glEnableVertexAttribArray(texCoordAttributeIndex);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Hooks a buffer of InstanceData into this model's VAO, one element per
+	// instance. Draw with glDrawElementsInstanced and a SHADER_INSTANCING variant.
+	void setInstanceBuffer(GLuint instanceBuffer)
+	{
+		glBindVertexArray(vao[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+		GLsizei stride = sizeof(InstanceData);
+
+		// a mat4 attribute takes 4 consecutive locations, one per column
+		for (GLuint column = 0; column < 4; column++)
+		{
+			GLuint location = instanceWorldAttributeIndex + column;
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(InstanceData, world) + column * 4 * sizeof(GLfloat)));
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1);
+		}
+
+		glVertexAttribPointer(instanceColorAttributeIndex, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(InstanceData, color)));
+		glEnableVertexAttribArray(instanceColorAttributeIndex);
+		glVertexAttribDivisor(instanceColorAttributeIndex, 1);
 
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
@@ -142,8 +255,14 @@ public:
 	{
 		// Delete buffer objects
 		glDisableVertexAttribArray(0);
+		MemoryTracker::instance().untrackBuffer(vbo[0]);
+		MemoryTracker::instance().untrackBuffer(ebo[0]);
 		glDeleteBuffers(1, vbo);
+		glDeleteBuffers(1, ebo);
 		glDeleteVertexArrays(1, vao);
+		vbo[0] = 0;
+		vao[0] = 0;
+		ebo[0] = 0;
 	}
 
 private:
@@ -152,6 +271,8 @@ private:
 
 	VertData* data;
 	GLuint* indices;
+	GLushort* shortIndices = nullptr;
+	GLenum indexType = GL_UNSIGNED_INT;
 
 	GLuint numVerts;
 	GLuint numIndices;
@@ -159,4 +280,56 @@ private:
 	GLuint positionAttributeIndex = 0;
 	GLuint colorAttributeIndex = 1;
 	GLuint normalAttributeIndex = 2;
+	GLuint instanceWorldAttributeIndex = 3;	// 3, 4, 5, 6
+	GLuint instanceColorAttributeIndex = 7;
+	GLuint texCoordAttributeIndex = 8;
+
+	// what this model holds on the CPU right now, for MemoryTracker
+	size_t cpuBytes() const
+	{
+		size_t bytes = 0;
+		if (data)
+			bytes += numVerts * sizeof(VertData);
+		if (indices)
+			bytes += numIndices * sizeof(GLuint);
+		if (shortIndices)
+			bytes += numIndices * sizeof(GLushort);
+		return bytes;
+	}
+
+	static GLuint packSnorm10(GLfloat v)
+	{
+		v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+		GLint i = static_cast<GLint>(v * 511.0f + (v < 0.0f ? -0.5f : 0.5f));
+		return static_cast<GLuint>(i) & 0x3ffu;
+	}
+
+	static GLubyte packUnorm8(GLfloat v)
+	{
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		return static_cast<GLubyte>(v * 255.0f + 0.5f);
+	}
+
+	static GLushort packUnorm16(GLfloat v)
+	{
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		return static_cast<GLushort>(v * 65535.0f + 0.5f);
+	}
+
+	static void packVertex(const VertData& in, PackedVertData& out)
+	{
+		out.position[0] = in.position[0];
+		out.position[1] = in.position[1];
+		out.position[2] = in.position[2];
+
+		out.color[0] = packUnorm8(in.color[0]);
+		out.color[1] = packUnorm8(in.color[1]);
+		out.color[2] = packUnorm8(in.color[2]);
+		out.color[3] = 255;
+
+		out.normal = packSnorm10(in.normal[0]) | (packSnorm10(in.normal[1]) << 10) | (packSnorm10(in.normal[2]) << 20);
+
+		out.texCoord[0] = packUnorm16(in.texCoord[0]);
+		out.texCoord[1] = packUnorm16(in.texCoord[1]);
+	}
 };
\ No newline at end of file
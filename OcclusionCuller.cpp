@@ -0,0 +1,240 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <cmath>
+#include "OcclusionCuller.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
+
+namespace {
+    // unit cube around the origin, scaled to the bounding sphere's radius it encloses the sphere
+    const GLfloat cubeVertices[] = {
+        -1, -1, -1,   1, -1, -1,   1,  1, -1,  -1,  1, -1,
+        -1, -1,  1,   1, -1,  1,   1,  1,  1,  -1,  1,  1,
+    };
+
+    const GLushort cubeIndices[] = {
+        0, 2, 1,  0, 3, 2,     // -z
+        4, 5, 6,  4, 6, 7,     // +z
+        0, 1, 5,  0, 5, 4,     // -y
+        3, 7, 6,  3, 6, 2,     // +y
+        0, 4, 7,  0, 7, 3,     // -x
+        1, 2, 6,  1, 6, 5,     // +x
+    };
+
+    uint64_t nowNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+OcclusionCuller::OcclusionCuller(const Asset& vertexSource, const Asset& fragmentSource, float nearPlane)
+    : shader(vertexSource, fragmentSource, 0), nearMargin(nearPlane)
+{
+    vpLoc = glGetUniformLocation(shader.getshaderID(), "vp");
+    boundsLoc = glGetUniformLocation(shader.getshaderID(), "bounds");
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &indexBuffer);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    MemoryTracker::instance().trackBuffer(vertexBuffer, MemoryCategory::VertexBuffer, sizeof(cubeVertices));
+    MemoryTracker::instance().trackBuffer(indexBuffer, MemoryCategory::IndexBuffer, sizeof(cubeIndices));
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    for (Object& o : objects)
+    {
+        for (GLuint& query : o.queries)
+        {
+            if (query)
+                glDeleteQueries(1, &query);
+        }
+    }
+
+    MemoryTracker::instance().untrackBuffer(vertexBuffer);
+    MemoryTracker::instance().untrackBuffer(indexBuffer);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void OcclusionCuller::set(uint32_t index, const glm::vec3& center, float radius)
+{
+    Object& o = getObject(index);
+    o.center = center;
+    o.radius = radius;
+}
+
+void OcclusionCuller::collect()
+{
+    TRACE_SCOPE("occlusionCollect");
+    frame++;
+    stats = Stats();
+
+    const uint64_t now = nowNs();
+    uint64_t latencyFrames = 0;
+    uint64_t latencyNs = 0;
+
+    for (Object& o : objects)
+    {
+        // results come back in order, stop at the first one still in flight
+        while (o.pending > 0)
+        {
+            const GLuint query = o.queries[o.first];
+            GLuint available = 0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+
+            GLuint passed = 0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+            o.visible = passed != 0;
+            o.nextTestFrame = o.visible ? frame + visibleRetestFrames : frame;
+
+            latencyFrames += frame - o.issuedFrame[o.first];
+            latencyNs += now - o.issuedNs[o.first];
+            stats.resultsRead++;
+
+            o.first = (o.first + 1) % queriesPerObject;
+            o.pending--;
+        }
+    }
+
+    if (stats.resultsRead)
+    {
+        stats.latencyFrames = static_cast<double>(latencyFrames) / stats.resultsRead;
+        stats.latencyMs = static_cast<double>(latencyNs) * 1e-6 / stats.resultsRead;
+    }
+    totalResults += stats.resultsRead;
+    totalLatencyFrames += latencyFrames;
+    totalLatencyNs += latencyNs;
+}
+
+const std::vector<uint32_t>& OcclusionCuller::filter(const std::vector<uint32_t>& candidates)
+{
+    visible.clear();
+    for (uint32_t index : candidates)
+    {
+        Object& o = getObject(index);
+
+        // back in the frustum after a while, whatever was known is stale
+        if (o.lastCandidateFrame + 1 < frame)
+        {
+            o.visible = true;
+            o.nextTestFrame = frame;
+        }
+        o.lastCandidateFrame = frame;
+
+        stats.tested++;
+        if (o.visible)
+            visible.push_back(index);
+        else
+            stats.culled++;
+    }
+
+    totalTested += stats.tested;
+    totalCulled += stats.culled;
+    return visible;
+}
+
+void OcclusionCuller::issue(const glm::mat4& viewProjection, const glm::vec3& eye,
+                            const std::vector<uint32_t>& candidates)
+{
+    TRACE_SCOPE("occlusionQueries");
+    bool started = false;
+    const uint64_t now = nowNs();
+
+    for (uint32_t index : candidates)
+    {
+        Object& o = getObject(index);
+        // a visible object needs one answer at a time, a hidden one a fresh
+        // answer every frame so it shows up again as soon as possible
+        if (frame < o.nextTestFrame || o.pending == queriesPerObject || (o.visible && o.pending > 0))
+            continue;
+
+        // with the eye inside the box (or the near plane cutting into it) the
+        // proxy gets clipped and proves nothing
+        const float reach = o.radius + nearMargin;
+        if (std::fabs(eye.x - o.center.x) <= reach && std::fabs(eye.y - o.center.y) <= reach &&
+            std::fabs(eye.z - o.center.z) <= reach)
+        {
+            o.visible = true;
+            o.nextTestFrame = frame + visibleRetestFrames;
+            continue;
+        }
+
+        if (!started)
+        {
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+            shader.UseProgram();
+            glUniformMatrix4fv(vpLoc, 1, GL_FALSE, &viewProjection[0][0]);
+            glBindVertexArray(vao);
+            started = true;
+        }
+
+        const uint32_t slot = (o.first + o.pending) % queriesPerObject;
+        if (!o.queries[slot])
+            glGenQueries(1, &o.queries[slot]);
+
+        glUniform4f(boundsLoc, o.center.x, o.center.y, o.center.z, o.radius);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, o.queries[slot]);
+        glDrawElements(GL_TRIANGLES, sizeof(cubeIndices) / sizeof(cubeIndices[0]), GL_UNSIGNED_SHORT, nullptr);
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+        o.issuedFrame[slot] = frame;
+        o.issuedNs[slot] = now;
+        o.pending++;
+        stats.queriesIssued++;
+    }
+
+    if (started)
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+void OcclusionCuller::dumpEvery(std::chrono::steady_clock::duration interval, FILE* out)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastDump < interval)
+        return;
+
+    lastDump = now;
+    if (totalTested)
+    {
+        fprintf(out, "occlusion: %llu of %llu objects culled (%.1f%%), query latency %.2f frames %.2f ms\n",
+                static_cast<unsigned long long>(totalCulled), static_cast<unsigned long long>(totalTested),
+                100.0 * static_cast<double>(totalCulled) / static_cast<double>(totalTested),
+                totalResults ? static_cast<double>(totalLatencyFrames) / static_cast<double>(totalResults) : 0.0,
+                totalResults ? static_cast<double>(totalLatencyNs) * 1e-6 / static_cast<double>(totalResults) : 0.0);
+    }
+
+    totalCulled = 0;
+    totalTested = 0;
+    totalResults = 0;
+    totalLatencyFrames = 0;
+    totalLatencyNs = 0;
+}
+
+OcclusionCuller::Object& OcclusionCuller::getObject(uint32_t index)
+{
+    if (index >= objects.size())
+        objects.resize(index + 1);
+    return objects[index];
+}
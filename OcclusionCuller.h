@@ -0,0 +1,116 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_OCCLUSIONCULLER_H
+#define PI_GAME_OCCLUSIONCULLER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <GLES3/gl3.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include "AssetLoader.h"
+#include "Shader.h"
+
+// Occlusion culling with GL_ANY_SAMPLES_PASSED_CONSERVATIVE queries. After the
+// main pass each object in the frustum gets its bounding box drawn, depth
+// tested but not written, inside a query. The results are only picked up
+// once the GPU reports them available, usually one or two frames later, so
+// nothing ever waits on the GPU. Objects keep their last known visibility in
+// the meantime, visible ones are re-tested every few frames and hidden ones
+// every frame so they come back quickly. Objects that just entered the
+// frustum or have the camera inside their box count as visible.
+// Objects are addressed with the same indices as FrustumCuller. GL thread
+// only, except set() and filter(), which touch no GL and may run in a job
+// between collect() and issue().
+class OcclusionCuller {
+public:
+    struct Stats
+    {
+        uint32_t tested = 0;        // objects filter() saw
+        uint32_t culled = 0;        // of those, dropped as hidden
+        uint32_t queriesIssued = 0;
+        uint32_t resultsRead = 0;
+        double latencyFrames = 0.0; // average from issue to result, of the results read
+        double latencyMs = 0.0;
+    };
+
+    // sources for the proxy shader, occlusion.vert and occlusion.frag,
+    // nearPlane the projection's near distance
+    OcclusionCuller(const Asset& vertexSource, const Asset& fragmentSource, float nearPlane = 0.1f);
+    ~OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    void set(uint32_t index, const glm::vec3& center, float radius);
+
+    // start of the frame, picks up every query result that is ready
+    void collect();
+
+    // the candidates (FrustumCuller::cull()) that were not found hidden
+    const std::vector<uint32_t>& filter(const std::vector<uint32_t>& candidates);
+
+    // After the main pass, into its depth buffer, with depth testing on.
+    // Pass the same candidates as filter(), the hidden ones need testing too.
+    void issue(const glm::mat4& viewProjection, const glm::vec3& eye, const std::vector<uint32_t>& candidates);
+
+    bool isVisible(uint32_t index) const
+    {
+        return index >= objects.size() || objects[index].visible;
+    }
+
+    // of the last frame
+    const Stats& getStats() const
+    {
+        return stats;
+    }
+
+    void dumpEvery(std::chrono::steady_clock::duration interval, FILE* out = stdout);
+
+private:
+    static constexpr uint32_t queriesPerObject = 3;     // most results in flight per object
+    static constexpr uint64_t visibleRetestFrames = 4;
+
+    struct Object
+    {
+        glm::vec3 center { 0.0f };
+        float radius = 0.0f;
+        GLuint queries[queriesPerObject] = {};
+        uint64_t issuedFrame[queriesPerObject] = {};
+        uint64_t issuedNs[queriesPerObject] = {};
+        uint32_t first = 0;         // oldest query in flight
+        uint32_t pending = 0;
+        bool visible = true;
+        uint64_t lastCandidateFrame = 0;
+        uint64_t nextTestFrame = 0;
+    };
+
+    Object& getObject(uint32_t index);
+
+    Shader shader;
+    float nearMargin;
+    GLint vpLoc;
+    GLint boundsLoc;
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+
+    std::vector<Object> objects;
+    std::vector<uint32_t> visible;
+    uint64_t frame = 0;
+
+    Stats stats;
+    uint64_t totalCulled = 0;
+    uint64_t totalTested = 0;
+    uint64_t totalResults = 0;
+    uint64_t totalLatencyFrames = 0;
+    uint64_t totalLatencyNs = 0;
+    std::chrono::steady_clock::time_point lastDump = std::chrono::steady_clock::now();
+};
+
+
+#endif //PI_GAME_OCCLUSIONCULLER_H
@@ -0,0 +1,276 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+#include "Model.h"
+#include "Simd.h"
+#include "MemoryTracker.h"
+
+namespace {
+    // small particles shrink to nothing over their last half second
+    constexpr float fadeRate = 2.0f;
+
+    // stateless hash so every particle gets its own random stream no matter
+    // which worker emits it
+    uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    float unitFloat(uint32_t& state)
+    {
+        state = hash(state);
+        return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    size_t roundUp4(size_t n)
+    {
+        return (n + 3) & ~static_cast<size_t>(3);
+    }
+}
+
+ParticleSystem::ParticleSystem(size_t maxParticles)
+    : capacity(roundUp4(maxParticles))
+{
+    // life stays padded with zeros past the last particle so a trailing
+    // partial batch of four reads dead lanes
+    for (auto* array : { &posX, &posY, &posZ, &velX, &velY, &velZ, &life, &colorR, &colorG, &colorB, &scale })
+        array->assign(capacity, 0.0f);
+
+    chunkLive.resize((capacity + chunkSize - 1) / chunkSize);
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    if (instanceBuffer)
+    {
+        MemoryTracker::instance().untrackBuffer(instanceBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+}
+
+size_t ParticleSystem::emit(const ParticleEmitter& emitter, size_t n, JobSystem* jobs)
+{
+    n = std::min(n, capacity - count);
+    if (n == 0)
+        return 0;
+
+    const size_t base = count;
+    const uint32_t seed = hash(++emitSerial);
+
+    auto spawn = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            uint32_t rng = seed ^ static_cast<uint32_t>(i * 0x9e3779b9u);
+
+            // uniform direction on the unit sphere
+            float z = 2.0f * unitFloat(rng) - 1.0f;
+            float phi = 6.2831853f * unitFloat(rng);
+            float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float speed = emitter.speed * (0.5f + 0.5f * unitFloat(rng));
+
+            size_t p = base + i;
+            posX[p] = emitter.position.x;
+            posY[p] = emitter.position.y;
+            posZ[p] = emitter.position.z;
+            velX[p] = ring * std::cos(phi) * speed;
+            velY[p] = ring * std::sin(phi) * speed;
+            velZ[p] = z * speed;
+            life[p] = emitter.lifetime * (0.75f + 0.25f * unitFloat(rng));
+            colorR[p] = emitter.color.x;
+            colorG[p] = emitter.color.y;
+            colorB[p] = emitter.color.z;
+            scale[p] = emitter.size;
+        }
+    };
+
+    if (jobs)
+        jobs->parallelFor(0, n, 1024, spawn);
+    else
+        spawn(0, n);
+
+    count += n;
+    return n;
+}
+
+size_t ParticleSystem::updateChunk(size_t first, size_t last, float dt)
+{
+    using namespace simd;
+
+    const Float4 dtv = set1(dt);
+    const Float4 zero = set1(0.0f);
+    const Float4 gx = set1(gravity.x * dt);
+    const Float4 gy = set1(gravity.y * dt);
+    const Float4 gz = set1(gravity.z * dt);
+
+    size_t alive = first;
+    for (size_t i = first; i < last; i += 4)
+    {
+        Float4 vx = add(load(&velX[i]), gx);
+        Float4 vy = add(load(&velY[i]), gy);
+        Float4 vz = add(load(&velZ[i]), gz);
+        Float4 px = madd(vx, dtv, load(&posX[i]));
+        Float4 py = madd(vy, dtv, load(&posY[i]));
+        Float4 pz = madd(vz, dtv, load(&posZ[i]));
+        Float4 l = sub(load(&life[i]), dtv);
+        const uint32_t keep = movemask(cmpgt(l, zero));
+
+        // the live lanes packed to the front of a whole vector stored at
+        // alive. alive never passes i, so only lanes already loaded get
+        // overwritten, and the dead tail of a store is covered by the next one
+        store(&velX[alive], compress(vx, keep));
+        store(&velY[alive], compress(vy, keep));
+        store(&velZ[alive], compress(vz, keep));
+        store(&posX[alive], compress(px, keep));
+        store(&posY[alive], compress(py, keep));
+        store(&posZ[alive], compress(pz, keep));
+        store(&life[alive], compress(l, keep));
+        store(&colorR[alive], compress(load(&colorR[i]), keep));
+        store(&colorG[alive], compress(load(&colorG[i]), keep));
+        store(&colorB[alive], compress(load(&colorB[i]), keep));
+        store(&scale[alive], compress(load(&scale[i]), keep));
+        alive += laneCount[keep];
+    }
+    return alive - first;
+}
+
+void ParticleSystem::moveParticles(size_t from, size_t to, size_t n)
+{
+    for (auto* array : { &posX, &posY, &posZ, &velX, &velY, &velZ, &life, &colorR, &colorG, &colorB, &scale })
+        std::memmove(array->data() + to, array->data() + from, n * sizeof(float));
+}
+
+void ParticleSystem::update(float dt, JobSystem* jobs)
+{
+    if (count == 0)
+        return;
+
+    const size_t end = roundUp4(count);
+    const size_t chunks = (end + chunkSize - 1) / chunkSize;
+
+    auto updateChunks = [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+            chunkLive[c] = updateChunk(c * chunkSize, std::min(end, (c + 1) * chunkSize), dt);
+    };
+
+    if (jobs)
+        jobs->parallelFor(0, chunks, 1, updateChunks);
+    else
+        updateChunks(0, chunks);
+
+    // chunks compacted themselves, close the gaps between them
+    size_t live = chunkLive[0];
+    for (size_t c = 1; c < chunks; c++)
+    {
+        if (chunkLive[c] && live != c * chunkSize)
+            moveParticles(c * chunkSize, live, chunkLive[c]);
+        live += chunkLive[c];
+    }
+
+    // restore the dead padding behind the last particle
+    std::fill(life.begin() + static_cast<std::ptrdiff_t>(live), life.begin() + static_cast<std::ptrdiff_t>(end), 0.0f);
+    count = live;
+}
+
+void ParticleSystem::writeInstances(size_t first, size_t last, void* out) const
+{
+    InstanceData* instances = static_cast<InstanceData*>(out);
+
+    for (size_t i = first; i < last; i++)
+    {
+        float s = scale[i] * std::min(life[i] * fadeRate, 1.0f);
+
+        // translate * scale, column major
+        InstanceData& d = instances[i];
+        d.world[0] = s;    d.world[1] = 0.0f; d.world[2] = 0.0f;  d.world[3] = 0.0f;
+        d.world[4] = 0.0f; d.world[5] = s;    d.world[6] = 0.0f;  d.world[7] = 0.0f;
+        d.world[8] = 0.0f; d.world[9] = 0.0f; d.world[10] = s;    d.world[11] = 0.0f;
+        d.world[12] = posX[i];
+        d.world[13] = posY[i];
+        d.world[14] = posZ[i];
+        d.world[15] = 1.0f;
+        d.color[0] = colorR[i];
+        d.color[1] = colorG[i];
+        d.color[2] = colorB[i];
+        d.color[3] = 1.0f;
+    }
+}
+
+void ParticleSystem::upload(JobSystem* jobs)
+{
+    if (!instanceBuffer)
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(InstanceData)), nullptr, GL_STREAM_DRAW);
+        MemoryTracker::instance().trackBuffer(instanceBuffer, MemoryCategory::InstanceBuffer, capacity * sizeof(InstanceData));
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    }
+
+    uploaded = count;
+    if (count == 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    // invalidating lets the driver hand out fresh memory instead of waiting
+    // for last frame's draw to finish reading
+    GLsizeiptr bytes = static_cast<GLsizeiptr>(count * sizeof(InstanceData));
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (mapped)
+    {
+        // workers only write memory here, no GL calls leave this thread
+        if (jobs)
+            jobs->parallelFor(0, count, 2048, [&](size_t first, size_t last) { writeInstances(first, last, mapped); });
+        else
+            writeInstances(0, count, mapped);
+
+        if (!glUnmapBuffer(GL_ARRAY_BUFFER))
+            uploaded = 0;   // contents were lost, skip a frame rather than draw garbage
+    }
+    else
+    {
+        if (!staging)
+            staging.reset(new InstanceData[capacity]);
+
+        InstanceData* out = staging.get();
+        if (jobs)
+            jobs->parallelFor(0, count, 2048, [&](size_t first, size_t last) { writeInstances(first, last, out); });
+        else
+            writeInstances(0, count, out);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, out);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleSystem::draw(Model& model)
+{
+    if (uploaded == 0 || !instanceBuffer)
+        return;
+
+    if (attachedVao != model.getVao())
+    {
+        model.setInstanceBuffer(instanceBuffer);
+        attachedVao = model.getVao();
+    }
+
+    glBindVertexArray(model.getVao());
+    glDrawElementsInstanced(GL_TRIANGLES, model.getNumIndices(), model.getIndexType(), nullptr,
+                            static_cast<GLsizei>(uploaded));
+}
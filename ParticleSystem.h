@@ -0,0 +1,98 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_PARTICLESYSTEM_H
+#define PI_GAME_PARTICLESYSTEM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <GLES3/gl3.h>
+#include <glm/vec3.hpp>
+
+class JobSystem;
+class Model;
+struct InstanceData;
+
+struct ParticleEmitter
+{
+    glm::vec3 position;
+    float speed;        // particles leave at 50-100% of this
+    glm::vec3 color;
+    float lifetime;     // seconds, jittered down by up to 25%
+    float size;         // scale applied to the instanced model
+};
+
+// Particles kept as structure of arrays so integration and the kill/compact
+// step run four at a time through Simd.h. Every live particle is written as
+// InstanceData straight into a mapped buffer and the lot is drawn with a
+// single glDrawElementsInstanced of a small model, pair it with a
+// SHADER_INSTANCING shader variant.
+class ParticleSystem {
+public:
+    explicit ParticleSystem(size_t capacity = 131072);
+    ~ParticleSystem();
+
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+    // Spawns up to count particles in random directions, returns how many fit.
+    // Split across the workers when a job system is given.
+    size_t emit(const ParticleEmitter& emitter, size_t count, JobSystem* jobs = nullptr);
+
+    // integrates, then drops expired particles keeping the rest packed at the front
+    void update(float dt, JobSystem* jobs = nullptr);
+
+    // GL thread only, writes the instance buffer for the live particles
+    void upload(JobSystem* jobs = nullptr);
+
+    // GL thread only, one instanced draw of model per live particle
+    void draw(Model& model);
+
+    void setGravity(const glm::vec3& g)
+    {
+        gravity = g;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+private:
+    // particles are integrated and compacted in independent chunks, this is
+    // also the unit of work handed to the job system
+    static constexpr size_t chunkSize = 4096;
+
+    size_t updateChunk(size_t first, size_t last, float dt);
+    void writeInstances(size_t first, size_t last, void* out) const;
+    void moveParticles(size_t from, size_t to, size_t n);
+
+    size_t capacity;
+    size_t count = 0;
+    uint32_t emitSerial = 0;
+    glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> life;
+    std::vector<float> colorR, colorG, colorB;
+    std::vector<float> scale;
+
+    std::vector<size_t> chunkLive;
+
+    GLuint instanceBuffer = 0;
+    GLuint attachedVao = 0;
+    size_t uploaded = 0;
+    std::unique_ptr<InstanceData[]> staging;    // capacity instances, made the first time mapping fails
+};
+
+
+#endif //PI_GAME_PARTICLESYSTEM_H
@@ -0,0 +1,164 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <dirent.h>
+#include "QualityGovernor.h"
+
+namespace {
+    const float smoothing = 0.1f;
+}
+
+QualityGovernor::QualityGovernor(std::vector<QualityLevel> qualityLevels, const QualityGovernorSettings& governorSettings)
+    : levels(std::move(qualityLevels)), settings(governorSettings),
+      framesSinceThermalStep(governorSettings.thermalFrames), upInterval(governorSettings.upFrames)
+{
+    if (levels.empty())
+        throw std::runtime_error("Quality governor needs at least one level");
+
+    cpufreqDir = settings.sysfsRoot + "/devices/system/cpu/cpu0/cpufreq/";
+    findThermalZones();
+    poll();
+}
+
+bool QualityGovernor::update(float frameMs)
+{
+    smoothedMs = samples++ ? smoothedMs + smoothing * (frameMs - smoothedMs) : frameMs;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPoll >= settings.pollInterval)
+        poll();
+
+    framesSinceChange++;
+    framesSinceThermalStep++;
+
+    const bool dropping = smoothedMs > settings.targetMs * settings.overBudget;
+    const bool onBudget = smoothedMs <= settings.targetMs * settings.onBudget;
+    const bool hot = sensors.celsius >= settings.hotCelsius;
+    const bool cool = sensors.celsius < settings.coolCelsius && !sensors.capped;
+
+    framesDropping = dropping ? framesDropping + 1 : 0;
+    framesOnBudget = onBudget && cool ? framesOnBudget + 1 : 0;
+
+    // a step up that held for a full interval is kept, the wait shrinks back
+    if (probing && framesSinceChange >= settings.upFrames)
+    {
+        probing = false;
+        upInterval = std::max(upInterval / 2, settings.upFrames);
+    }
+
+    const bool canStepDown = level + 1 < levels.size();
+    if ((hot || sensors.capped) && canStepDown && framesSinceThermalStep >= settings.thermalFrames)
+    {
+        framesSinceThermalStep = 0;
+        probing = false;
+        setLevel(level + 1);
+        return true;
+    }
+
+    // the smoothed time needs the settle period to stop showing the old level
+    if (framesDropping >= settings.downFrames && canStepDown && framesSinceChange >= settings.downFrames)
+    {
+        if (probing)
+            upInterval = std::min(upInterval * 2, settings.maxUpFrames);
+        probing = false;
+        setLevel(level + 1);
+        return true;
+    }
+
+    if (framesOnBudget >= upInterval && level > 0)
+    {
+        setLevel(level - 1);
+        probing = true;
+        return true;
+    }
+
+    return false;
+}
+
+void QualityGovernor::dumpEvery(std::chrono::steady_clock::duration interval, FILE* out)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastDump < interval)
+        return;
+
+    lastDump = now;
+    fprintf(out, "quality: level %u of %zu, %.2f ms, %u down %u up",
+            level, levels.size(), static_cast<double>(smoothedMs), stepsDown, stepsUp);
+    if (!thermalZones.empty())
+        fprintf(out, ", %.1f C", static_cast<double>(sensors.celsius));
+    if (sensors.clockKHz)
+        fprintf(out, ", %u of %u MHz%s", sensors.clockKHz / 1000, sensors.maxKHz / 1000,
+                sensors.capped ? " capped" : "");
+    fprintf(out, "\n");
+
+    stepsDown = 0;
+    stepsUp = 0;
+}
+
+void QualityGovernor::findThermalZones()
+{
+    const std::string dir = settings.sysfsRoot + "/class/thermal/";
+    DIR* thermal = opendir(dir.c_str());
+    if (!thermal)
+        return;
+
+    while (dirent* entry = readdir(thermal))
+    {
+        if (std::strncmp(entry->d_name, "thermal_zone", 12) == 0)
+            thermalZones.push_back(dir + entry->d_name + "/temp");
+    }
+    closedir(thermal);
+    std::sort(thermalZones.begin(), thermalZones.end());
+}
+
+void QualityGovernor::poll()
+{
+    lastPoll = std::chrono::steady_clock::now();
+
+    // millidegrees, the hottest zone is the one that gets throttled on
+    long long value;
+    bool anyZone = false;
+    for (const std::string& zone : thermalZones)
+    {
+        if (!readNumber(zone, value))
+            continue;
+        const float celsius = static_cast<float>(value) * 0.001f;
+        sensors.celsius = anyZone ? std::max(sensors.celsius, celsius) : celsius;
+        anyZone = true;
+    }
+
+    // kHz, thermal and power capping show up as a lowered scaling_max_freq
+    sensors.clockKHz = readNumber(cpufreqDir + "scaling_cur_freq", value) ? static_cast<uint32_t>(value) : 0;
+    sensors.maxKHz = readNumber(cpufreqDir + "cpuinfo_max_freq", value) ? static_cast<uint32_t>(value) : 0;
+    sensors.limitKHz = readNumber(cpufreqDir + "scaling_max_freq", value) ? static_cast<uint32_t>(value) : 0;
+    sensors.capped = sensors.maxKHz && sensors.limitKHz && sensors.limitKHz < sensors.maxKHz;
+}
+
+bool QualityGovernor::readNumber(const std::string& path, long long& value) const
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file)
+        return false;
+
+    const bool ok = fscanf(file, "%lld", &value) == 1;
+    fclose(file);
+    return ok;
+}
+
+void QualityGovernor::setLevel(uint32_t newLevel)
+{
+    if (newLevel > level)
+        stepsDown++;
+    else
+        stepsUp++;
+
+    level = newLevel;
+    framesSinceChange = 0;
+    framesDropping = 0;
+    framesOnBudget = 0;
+}
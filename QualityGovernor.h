@@ -0,0 +1,124 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_QUALITYGOVERNOR_H
+#define PI_GAME_QUALITYGOVERNOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// One rung of the quality ladder, what the caller applies when it changes
+struct QualityLevel
+{
+    uint32_t sphereSubdivision;
+    float renderScale;          // DynamicResolution::setScaleLimit()
+    uint32_t particleBudget;    // live particles
+    uint32_t lightBudget;       // LightSystem::setBudget()
+};
+
+struct QualityGovernorSettings
+{
+    std::string sysfsRoot = "/sys";         // point it at a fake tree to test
+    float targetMs = 1000.0f / 60.0f;       // the display interval
+    float overBudget = 1.15f;               // smoothed frame times above target * this are dropping frames
+    float onBudget = 1.05f;                 // and up to target * this are on budget
+    float hotCelsius = 75.0f;               // the Pi firmware starts throttling at 80
+    float coolCelsius = 68.0f;              // no step up at or above
+    uint32_t downFrames = 45;               // frames dropping before a step down
+    uint32_t upFrames = 600;                // frames on budget and cool before a step up
+    uint32_t maxUpFrames = 600 * 8;         // longest wait after failed step ups
+    uint32_t thermalFrames = 600;           // between steps down for heat, temperature lags behind load
+    std::chrono::milliseconds pollInterval { 500 };
+};
+
+// Walks a ladder of quality levels, best first, to keep the frame rate flat
+// instead of letting it collapse when the Pi heats up and throttles. Once per
+// frame update() takes the frame time, every pollInterval it reads the
+// hottest thermal zone from <sysfsRoot>/class/thermal and the cpu0 clock and
+// its limit from <sysfsRoot>/devices/system/cpu/cpu0/cpufreq.
+// It steps down when frames keep dropping, when the SoC is hot or when the
+// clock is capped below its maximum, and at most once per thermalFrames for
+// heat. It steps up only after a long stretch on budget while cool and
+// uncapped. A step up that starts dropping frames again is taken back and the
+// next attempt waits twice as long, so the level settles instead of
+// oscillating. Missing sysfs files count as cool and uncapped.
+class QualityGovernor {
+public:
+    struct Sensors
+    {
+        float celsius = -273.15f;   // hottest zone, absolute zero without any
+        uint32_t clockKHz = 0;      // 0 when unknown
+        uint32_t maxKHz = 0;        // what the CPU can do
+        uint32_t limitKHz = 0;      // what cpufreq currently allows
+        bool capped = false;        // limit below max, thermal or power capping
+    };
+
+    explicit QualityGovernor(std::vector<QualityLevel> qualityLevels,
+                             const QualityGovernorSettings& governorSettings = QualityGovernorSettings());
+
+    // once per frame, true when the level changed and has to be applied
+    bool update(float frameMs);
+
+    const QualityLevel& get() const
+    {
+        return levels[level];
+    }
+
+    // 0 is the best
+    uint32_t getLevel() const
+    {
+        return level;
+    }
+
+    size_t getLevelCount() const
+    {
+        return levels.size();
+    }
+
+    const Sensors& getSensors() const
+    {
+        return sensors;
+    }
+
+    float getFrameTimeMs() const
+    {
+        return smoothedMs;
+    }
+
+    void dumpEvery(std::chrono::steady_clock::duration interval, FILE* out = stdout);
+
+private:
+    void findThermalZones();
+    void poll();
+    bool readNumber(const std::string& path, long long& value) const;
+    void setLevel(uint32_t newLevel);
+
+    std::vector<QualityLevel> levels;
+    QualityGovernorSettings settings;
+    std::vector<std::string> thermalZones;  // temp files
+    std::string cpufreqDir;
+
+    uint32_t level = 0;
+    Sensors sensors;
+    std::chrono::steady_clock::time_point lastPoll;
+
+    float smoothedMs = 0.0f;
+    uint32_t samples = 0;
+    uint32_t framesSinceChange = 0;
+    uint32_t framesSinceThermalStep;
+    uint32_t framesDropping = 0;
+    uint32_t framesOnBudget = 0;
+    uint32_t upInterval;
+    bool probing = false;                   // the last change was a step up not yet proven
+
+    uint32_t stepsDown = 0;
+    uint32_t stepsUp = 0;
+    std::chrono::steady_clock::time_point lastDump = std::chrono::steady_clock::now();
+};
+
+
+#endif //PI_GAME_QUALITYGOVERNOR_H
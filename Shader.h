@@ -1,10 +1,31 @@
 #pragma once
 
 #include <GLES3/gl3.h> 
+#include <cstdint>
+#include <cstring>
 #include <string>
-#include <sstream>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include "AssetLoader.h"
+#include "Trace.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Feature flags for shader variants. Each set bit becomes a #define injected
+// right after the #version line, the GLSL compiler strips everything under
+// the #ifdefs that are left undefined. No lighting bit means unlit.
+////////////////////////////////////////////////////////////////////////////////
+enum ShaderFeature : uint32_t
+{
+	SHADER_LIGHTING_LAMBERT = 1u << 0,
+	SHADER_LIGHTING_PHONG = 1u << 1,
+	SHADER_INSTANCING = 1u << 2,
+	SHADER_PACKED_NORMALS = 1u << 3,
+	SHADER_LIGHTING_CLUSTERED = 1u << 4,	// per fragment, see LightSystem
+	SHADER_TEXTURED = 1u << 5,				// diffuseMap on unit 0, see KtxTexture
+	SHADER_IMPOSTOR = 1u << 6,				// SphereImpostor quads, with INSTANCING and LIGHTING_CLUSTERED
+};
 
 class Shader
 {
@@ -23,11 +44,34 @@ public:
 		glUseProgram(shaderProgram);
 	}
 
-	Shader()
+	Shader(uint32_t features = SHADER_LIGHTING_LAMBERT)
 	{
+		defines = BuildDefines(features);
 		Init();
 	}
 
+	// Compiles straight out of the loader's buffers, waits for them if the
+	// reads are still in flight
+	Shader(const Asset& vertexSource, const Asset& fragmentSource, uint32_t features = SHADER_LIGHTING_LAMBERT)
+	{
+		shaderProgram = glCreateProgram();
+		defines = BuildDefines(features);
+
+		if (!vertexSource.wait() || !fragmentSource.wait())
+			return;
+
+		if (!LoadVertexShader(vertexSource.data(), static_cast<GLint>(vertexSource.size())))
+			return;
+
+		if (!LoadFragmentShader(fragmentSource.data(), static_cast<GLint>(fragmentSource.size())))
+			return;
+
+		LinkShaders();
+	}
+
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
 	~Shader()
 	{
 		/* Cleanup all the things we bound and allocated */
@@ -46,16 +90,66 @@ public:
 		return shaderProgram;
 	}
 
+	bool isLinked() const
+	{
+		return linked;
+	}
+
 private:
 
+	static std::string BuildDefines(uint32_t features)
+	{
+		std::string result;
+
+		if (features & SHADER_LIGHTING_LAMBERT)
+			result += "#define LIGHTING_LAMBERT\n";
+		if (features & SHADER_LIGHTING_PHONG)
+			result += "#define LIGHTING_PHONG\n";
+		if (features & SHADER_INSTANCING)
+			result += "#define INSTANCING\n";
+		if (features & SHADER_PACKED_NORMALS)
+			result += "#define PACKED_NORMALS\n";
+		if (features & SHADER_LIGHTING_CLUSTERED)
+			result += "#define LIGHTING_CLUSTERED\n";
+		if (features & SHADER_TEXTURED)
+			result += "#define TEXTURED\n";
+		if (features & SHADER_IMPOSTOR)
+			result += "#define IMPOSTOR\n";
+
+		return result;
+	}
+
+	// Hands the source to GL as three strings, the #version line, the defines
+	// and the rest, so the body is never copied. #version has to stay first.
+	void SetShaderSource(GLuint shader, const char* src, GLint size)
+	{
+		GLint versionLength = 0;
+		if (size >= 8 && std::strncmp(src, "#version", 8) == 0)
+		{
+			while (versionLength < size && src[versionLength] != '\n')
+				versionLength++;
+			if (versionLength < size)
+				versionLength++;
+		}
+
+		const char* sources[3] = { src, defines.c_str(), src + versionLength };
+		GLint lengths[3] = { versionLength, static_cast<GLint>(defines.length()), size - versionLength };
+
+		glShaderSource(shader, 3, sources, lengths);
+	}
+
 	bool Init()
 	{
 		shaderProgram = glCreateProgram();
 
-		if (!LoadVertexShader("../tutorial2.vert"))
+		const std::string root = AssetLoader::defaultRoot();
+
+		std::string vertSrc = ReadFile((root + "tutorial2.vert").c_str());
+		if (!LoadVertexShader(vertSrc.data(), static_cast<GLint>(vertSrc.length())))
 			return false;
 
-		if (!LoadFragmentShader("../tutorial2.frag"))
+		std::string fragSrc = ReadFile((root + "tutorial2.frag").c_str());
+		if (!LoadFragmentShader(fragSrc.data(), static_cast<GLint>(fragSrc.length())))
 			return false;
 
 		return LinkShaders();
@@ -63,36 +157,30 @@ private:
 
 	std::string ReadFile(const char* file)
 	{
-		// Open file
-		std::ifstream t(file);
-		std::stringstream buffer;
+		// Open file, size the string once and read straight into it
+		std::ifstream t(file, std::ios::binary | std::ios::ate);
 		std::string fileContent;
 
 		if (t.is_open())
 		{
-			buffer << t.rdbuf();
-			fileContent = buffer.str();
+			fileContent.resize(static_cast<size_t>(t.tellg()));
+			t.seekg(0);
+			t.read(&fileContent[0], static_cast<std::streamsize>(fileContent.size()));
 		}
 
 		return fileContent;
 	}
 
-	bool LoadVertexShader(const std::string& filename)
+	bool LoadVertexShader(const char* src, GLint size)
 	{
+		TRACE_SCOPE("compileVertexShader");
 		std::cout << "Linking Vertex shader" << std::endl;
 
-		// Read file as std::string 
-		std::string str = ReadFile(filename.c_str());
-
-		// c_str() gives us a const char*, but we need a non-const one
-		char* src = const_cast<char*>(str.c_str());
-		GLint size = (GLint)str.length();
-
 		// Create an empty vertex shader handle
 		vertexShader = glCreateShader(GL_VERTEX_SHADER);
 
 		// Send the vertex shader source code to OpenGL
-		glShaderSource(vertexShader, 1, &src, &size);
+		SetShaderSource(vertexShader, src, size);
 
 		// Compile the vertex shader
 		glCompileShader(vertexShader);
@@ -110,22 +198,16 @@ private:
 		return true;
 	}
 
-	bool LoadFragmentShader(const std::string& filename)
+	bool LoadFragmentShader(const char* src, GLint size)
 	{
+		TRACE_SCOPE("compileFragmentShader");
 		std::cout << "Loading Fragment Shader" << std::endl;
 
-		// Read file as std::string 
-		std::string str = ReadFile(filename.c_str());
-
-		// c_str() gives us a const char*, but we need a non-const one
-		char* src = const_cast<char*>(str.c_str());
-		GLint size = (GLint)str.length();
-
 		// Create an empty vertex shader handle
 		fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
 
 		// Send the vertex shader source code to OpenGL
-		glShaderSource(fragmentShader, 1, &src, &size);
+		SetShaderSource(fragmentShader, src, size);
 
 		// Compile the vertex shader
 		glCompileShader(fragmentShader);
@@ -145,6 +227,8 @@ private:
 
 	bool LinkShaders()
 	{
+		TRACE_SCOPE("linkProgram");
+
 		// Link. At this point, our shaders will be inspected/optized and the binary code generated
 		// The binary code will then be uploaded to the GPU
 		glLinkProgram(shaderProgram);
@@ -156,7 +240,8 @@ private:
 		if (isLinked == false)
 			PrintShaderLinkingError(shaderProgram);
 
-		return isLinked != 0;
+		linked = isLinked != 0;
+		return linked;
 	}
 
 	void PrintShaderLinkingError(int32_t shaderId)
@@ -204,6 +289,46 @@ private:
 	}
 
 	GLuint shaderProgram;
-	GLuint vertexShader, fragmentShader;
+	GLuint vertexShader = 0, fragmentShader = 0;
+	std::string defines;
+	bool linked = false;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Compiles variants of one vertex/fragment pair on first request and keeps
+// them keyed by their ShaderFeature bitmask, so only permutations that are
+// actually drawn with ever get compiled.
+////////////////////////////////////////////////////////////////////////////////
+class ShaderCache
+{
+public:
+
+	ShaderCache(AssetHandle vertex, AssetHandle fragment)
+		: vertexSource(std::move(vertex)), fragmentSource(std::move(fragment))
+	{
+	}
+
+	Shader& get(uint32_t features)
+	{
+		auto it = variants.find(features);
+		if (it != variants.end())
+			return *it->second;
+
+		std::unique_ptr<Shader> shader(new Shader(*vertexSource, *fragmentSource, features));
+		Shader& result = *shader;
+		variants.emplace(features, std::move(shader));
+		return result;
+	}
+
+	size_t size() const
+	{
+		return variants.size();
+	}
+
+private:
 
+	AssetHandle vertexSource;
+	AssetHandle fragmentSource;
+	std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
 };
\ No newline at end of file
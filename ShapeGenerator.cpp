@@ -1,4 +1,8 @@
 #include "ShapeGenerator.h"
+#include "JobSystem.h"
+#include "IcosahedronTables.h"
+#include "Trace.h"
+#include <cstring>
 
 ///////////////////////////////////////////////////////////////////////////////
 // compute 12 vertices of icosahedron using spherical coordinates
@@ -174,15 +178,15 @@ void IcosoSphere::addNormals(float n1[3], float n2[3], float n3[3])
 ///////////////////////////////////////////////////////////////////////////////
 // add 3 texture coords to array
 ///////////////////////////////////////////////////////////////////////////////
-//void addtexcoords(float t1[2], float t2[2], float t3[2])
-//{
-//	texcoords.push_back(t1[0]); // s
-//	texcoords.push_back(t1[1]); // t
-//	texcoords.push_back(t2[0]);
-//	texcoords.push_back(t2[1]);
-//	texcoords.push_back(t3[0]);
-//	texcoords.push_back(t3[1]);
-//}
+void IcosoSphere::addTexCoords(const float t1[2], const float t2[2], const float t3[2])
+{
+	texCoords.push_back(t1[0]); // s
+	texCoords.push_back(t1[1]); // t
+	texCoords.push_back(t2[0]);
+	texCoords.push_back(t2[1]);
+	texCoords.push_back(t3[0]);
+	texCoords.push_back(t3[1]);
+}
 
 
 
@@ -198,141 +202,141 @@ void IcosoSphere::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
 
 ///////////////////////////////////////////////////////////////////////////////
 // generate interleaved vertices: V/N/T
-// stride must be 32 bytes
+// each of the 20 base faces expands into its own contiguous block of
+// 4^subdivision triangles, so the faces are independent jobs
 ///////////////////////////////////////////////////////////////////////////////
-Model IcosoSphere::buildSphere()
+Model IcosoSphere::buildSphere(JobSystem* jobs)
+{
+	TRACE_SCOPE("buildSphere");
+
+	// small spheres are baked at compile time, just copy them out
+	size_t tableVerts = 0;
+	if (const VertData* table = IcosahedronTables::vertices(subdivision, tableVerts))
+	{
+		Model baked = Model(static_cast<int>(tableVerts), static_cast<int>(tableVerts));
+		VertData* verts = baked.getDataPtr();
+		GLuint* indi = baked.getIndPtr();
+
+		std::memcpy(verts, table, tableVerts * sizeof(VertData));
+		for (size_t i = 0; i < tableVerts; i++)
+		{
+			if (radius != 1.0f)
+			{
+				verts[i].position[0] *= radius;
+				verts[i].position[1] *= radius;
+				verts[i].position[2] *= radius;
+			}
+			indi[i] = static_cast<GLuint>(i);
+		}
+		return baked;
+	}
+
+	return generate(jobs);
+}
+
+Model IcosoSphere::generate(JobSystem* jobs)
 {
 	buildVerticesFlat();
 
-	int numVerts = static_cast<int>(vertices.size() / 3);
-	int numIndi = static_cast<int>(indices.size());
+	const size_t numFaces = indices.size() / 3;
+	const size_t vertsPerFace = 3 * (size_t(1) << (2 * subdivision));
+
+	int numVerts = static_cast<int>(numFaces * vertsPerFace);
+	int numIndi = numVerts;
 	Model icosoHedron = Model(numVerts, numIndi);
 	VertData* verts = icosoHedron.getDataPtr();
 	GLuint* indi = icosoHedron.getIndPtr();
 
-	//std::size_t i, j;
-	//std::size_t count = vertices.size();
-	//for (i = 0, j = 0; i < count; i += 3, j += 2)
-	//{
-	//	/*interleavedVertices.push_back(vertices[i]);
-	//	interleavedVertices.push_back(vertices[i + 1]);
-	//	interleavedVertices.push_back(vertices[i + 2]);*/
+	auto buildFaces = [&](size_t first, size_t last)
+	{
+		for (size_t f = first; f < last; f++)
+		{
+			const float* v1 = &vertices[indices[f * 3] * 3];
+			const float* v2 = &vertices[indices[f * 3 + 1] * 3];
+			const float* v3 = &vertices[indices[f * 3 + 2] * 3];
+			const float* t1 = &texCoords[indices[f * 3] * 2];
+			const float* t2 = &texCoords[indices[f * 3 + 1] * 2];
+			const float* t3 = &texCoords[indices[f * 3 + 2] * 2];
+			subdivideFaceFlat(v1, v2, v3, t1, t2, t3, subdivision, verts + f * vertsPerFace);
+
+			// flat shading, no shared vertices
+			for (size_t i = f * vertsPerFace; i < (f + 1) * vertsPerFace; i++)
+				indi[i] = static_cast<GLuint>(i);
+		}
+	};
 
-	//	//interleavedVertices.push_back(normals[i]);
-	//	//interleavedVertices.push_back(normals[i + 1]);
-	//	//interleavedVertices.push_back(normals[i + 2]);
+	if (jobs)
+		jobs->parallelFor(0, numFaces, 1, buildFaces);
+	else
+		buildFaces(0, numFaces);
 
-	//	//interleavedVertices.push_back(texCoords[j]);
-	//	//interleavedVertices.push_back(texCoords[j + 1]);
-	//}
+	return icosoHedron;
+}
 
-	size_t index = 0;
-	for (size_t i = 0; i < numVerts; i++)
-	{
-		verts[i].position[0] = vertices[index];
-		verts[i].normal[0] = normals[index++];
 
-		verts[i].position[1] = vertices[index];
-		verts[i].normal[1] = normals[index++];
+///////////////////////////////////////////////////////////////////////////////
+// write a flat shaded triangle into 3 interleaved vertices
+///////////////////////////////////////////////////////////////////////////////
+void IcosoSphere::writeTriangle(const float v1[3], const float v2[3], const float v3[3],
+                                const float t1[2], const float t2[2], const float t3[2], VertData* out)
+{
+	float normal[3];
+	computeFaceNormal(v1, v2, v3, normal);
 
-		verts[i].position[2] = vertices[index];
-		verts[i].normal[2] = normals[index++];
+	const float* v[3] = { v1, v2, v3 };
+	const float* t[3] = { t1, t2, t3 };
+	for (size_t i = 0; i < 3; i++)
+	{
+		out[i].position[0] = v[i][0];
+		out[i].position[1] = v[i][1];
+		out[i].position[2] = v[i][2];
 
-		verts[i].color[0] = 0.4f;
-		verts[i].color[1] = 0.6f;
-		verts[i].color[2] = 0.2f;
-	}
+		out[i].normal[0] = normal[0];
+		out[i].normal[1] = normal[1];
+		out[i].normal[2] = normal[2];
 
-	for (size_t i = 0; i < numIndi; i++)
-	{
-		indi[i] = indices[i];
-	}
+		out[i].color[0] = 0.4f;
+		out[i].color[1] = 0.6f;
+		out[i].color[2] = 0.2f;
 
-	return icosoHedron;
+		out[i].texCoord[0] = t[i][0];
+		out[i].texCoord[1] = t[i][1];
+	}
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // divide a trinage into 4 sub triangles and repeat N times
-// If subdivision=0, do nothing.
+// If level=0, the triangle is written as is.
+// Depth first recursion emits the triangles in the same order as subdividing
+// the whole mesh level by level, output needs room for 3 * 4^level vertices.
 ///////////////////////////////////////////////////////////////////////////////
-void IcosoSphere::subdivideVerticesFlat()
+void IcosoSphere::subdivideFaceFlat(const float v1[3], const float v2[3], const float v3[3],
+                                    const float t1[2], const float t2[2], const float t3[2], int level, VertData* out)
 {
-	std::vector<float> tmpVertices;
-	std::vector<float> tmpTexCoords;
-	std::vector<unsigned int> tmpIndices;
-	size_t indexCount;
-	const float* v1, * v2, * v3;          // ptr to original vertices of a triangle
-	const float* t1, * t2, * t3;          // ptr to original texcoords of a triangle
+	if (level == 0)
+	{
+		writeTriangle(v1, v2, v3, t1, t2, t3, out);
+		return;
+	}
+
 	float newV1[3], newV2[3], newV3[3]; // new vertex positions
 	float newT1[2], newT2[2], newT3[2]; // new texture coords
-	float normal[3];                    // new face normal
-	unsigned int index = 0;             // new index value
-	size_t i, j;
 
-	// iteration
-	for (i = 1; i <= subdivision; ++i)
-	{
-		// copy prev arrays
-		tmpVertices = vertices;
-		//tmpTexCoords = texCoords;
-		tmpIndices = indices;
-
-		// clear prev arrays
-		vertices.clear();
-		normals.clear();
-		//texCoords.clear();
-		indices.clear();
-
-		index = 0;
-		indexCount = tmpIndices.size();
-		for (j = 0; j < indexCount; j += 3)
-		{
-			// get 3 vertice and texcoords of a triangle
-			v1 = &tmpVertices[tmpIndices[j] * 3];
-			v2 = &tmpVertices[tmpIndices[j + 1] * 3];
-			v3 = &tmpVertices[tmpIndices[j + 2] * 3];
-			//t1 = &tmpTexCoords[tmpIndices[j] * 2];
-			//t2 = &tmpTexCoords[tmpIndices[j + 1] * 2];
-			//t3 = &tmpTexCoords[tmpIndices[j + 2] * 2];
-
-			// get 3 new vertices by spliting half on each edge
-			computeHalfVertex(v1, v2, radius, newV1);
-			computeHalfVertex(v2, v3, radius, newV2);
-			computeHalfVertex(v1, v3, radius, newV3);
-			//computeHalfTexCoord(t1, t2, newT1);
-			//computeHalfTexCoord(t2, t3, newT2);
-			//computeHalfTexCoord(t1, t3, newT3);
-
-			// add 4 new triangles
-			addVertices(v1, newV1, newV3);
-			//addTexCoords(t1, newT1, newT3);
-			computeFaceNormal(v1, newV1, newV3, normal);
-			addNormals(normal, normal, normal);
-			addIndices(index, index + 1, index + 2);
-
-			addVertices(newV1, v2, newV2);
-			//addTexCoords(newT1, t2, newT2);
-			computeFaceNormal(newV1, v2, newV2, normal);
-			addNormals(normal, normal, normal);
-			addIndices(index + 3, index + 4, index + 5);
-
-			addVertices(newV1, newV2, newV3);
-			//addTexCoords(newT1, newT2, newT3);
-			computeFaceNormal(newV1, newV2, newV3, normal);
-			addNormals(normal, normal, normal);
-			addIndices(index + 6, index + 7, index + 8);
-
-			addVertices(newV3, newV2, v3);
-			//addTexCoords(newT3, newT2, t3);
-			computeFaceNormal(newV3, newV2, v3, normal);
-			addNormals(normal, normal, normal);
-			addIndices(index + 9, index + 10, index + 11);
-
-			// next index
-			index += 12;
-		}
-	}
+	// get 3 new vertices by spliting half on each edge
+	computeHalfVertex(v1, v2, radius, newV1);
+	computeHalfVertex(v2, v3, radius, newV2);
+	computeHalfVertex(v1, v3, radius, newV3);
+	computeHalfTexCoord(t1, t2, newT1);
+	computeHalfTexCoord(t2, t3, newT2);
+	computeHalfTexCoord(t1, t3, newT3);
+
+	// add 4 new triangles
+	const size_t childVerts = 3 * (size_t(1) << (2 * (level - 1)));
+	subdivideFaceFlat(v1, newV1, newV3, t1, newT1, newT3, level - 1, out);
+	subdivideFaceFlat(newV1, v2, newV2, newT1, t2, newT2, level - 1, out + childVerts);
+	subdivideFaceFlat(newV1, newV2, newV3, newT1, newT2, newT3, level - 1, out + 2 * childVerts);
+	subdivideFaceFlat(newV3, newV2, v3, newT3, newT2, t3, level - 1, out + 3 * childVerts);
 }
 
 
@@ -353,10 +357,16 @@ void IcosoSphere::buildVerticesFlat()
 	// clear memory of prev arrays
 	std::vector<float>().swap(vertices);
 	std::vector<float>().swap(normals);
-	//std::vector<float>().swap(texCoords);
+	std::vector<float>().swap(texCoords);
 	std::vector<unsigned int>().swap(indices);
 	//std::vector<unsigned int>().swap(lineIndices);
 
+	// 20 faces of 3 vertices, sized once instead of growing
+	vertices.reserve(20 * 3 * 3);
+	normals.reserve(20 * 3 * 3);
+	texCoords.reserve(20 * 3 * 2);
+	indices.reserve(20 * 3);
+
 
 	const float* v0, * v1, * v2, * v3, * v4, * v11;          // vertex positions
 	float n[3];                                         // face normal
@@ -394,33 +404,63 @@ void IcosoSphere::buildVerticesFlat()
 		computeFaceNormal(v0, v1, v2, n);
 		addVertices(v0, v1, v2);
 		addNormals(n, n, n);
-		//addTexCoords(t0, t1, t2);
+		addTexCoords(t0, t1, t2);
 		addIndices(index, index + 1, index + 2);
 
 		// add 2 triangles in 2nd row
 		computeFaceNormal(v1, v3, v2, n);
 		addVertices(v1, v3, v2);
 		addNormals(n, n, n);
-		//addTexCoords(t1, t3, t2);
+		addTexCoords(t1, t3, t2);
 		addIndices(index + 3, index + 4, index + 5);
 
 		computeFaceNormal(v2, v3, v4, n);
 		addVertices(v2, v3, v4);
 		addNormals(n, n, n);
-		//addTexCoords(t2, t3, t4);
+		addTexCoords(t2, t3, t4);
 		addIndices(index + 6, index + 7, index + 8);
 
 		// add a triangle in 3rd row
 		computeFaceNormal(v3, v11, v4, n);
 		addVertices(v3, v11, v4);
 		addNormals(n, n, n);
-		//addTexCoords(t3, t11, t4);
+		addTexCoords(t3, t11, t4);
 		addIndices(index + 9, index + 10, index + 11);
 
 
 		// next index
 		index += 12;
 	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 4 corners at (+-r, +-r, 0), the shader only reads the signs and |x|
+///////////////////////////////////////////////////////////////////////////////
+Model SphereImpostor::buildQuad()
+{
+	const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+
+	Model quad(4, 6);
+	VertData* verts = quad.getDataPtr();
+	for (int i = 0; i < 4; i++)
+	{
+		verts[i].position[0] = corners[i][0] * radius;
+		verts[i].position[1] = corners[i][1] * radius;
+		verts[i].position[2] = 0.0f;
+		verts[i].color[0] = 0.4f;
+		verts[i].color[1] = 0.6f;
+		verts[i].color[2] = 0.2f;
+		verts[i].normal[0] = 0.0f;
+		verts[i].normal[1] = 0.0f;
+		verts[i].normal[2] = 1.0f;
+		verts[i].texCoord[0] = corners[i][0] * 0.5f + 0.5f;
+		verts[i].texCoord[1] = corners[i][1] * 0.5f + 0.5f;
+	}
 
-	subdivideVerticesFlat();
+	const GLuint quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+	std::memcpy(quad.getIndPtr(), quadIndices, sizeof(quadIndices));
+	quad.shrinkIndices();
+	return quad;
 }
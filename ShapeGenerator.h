@@ -7,6 +7,8 @@
 #include <iostream>
 #include "Model.h"
 
+class JobSystem;
+
 
 class IcosoSphere
 {
@@ -16,7 +18,10 @@ public:
 		this->radius = radius;
 		subdivision = subDiv;
 	}
-	Model buildSphere();
+	// subdivides the 20 base faces in parallel when a job system is given
+	Model buildSphere(JobSystem* jobs = nullptr);
+	// same, but never takes the baked tables, pigame_tablecheck compares the two
+	Model generate(JobSystem* jobs = nullptr);
 
 private:
 	std::vector<float> computeIcosahedronVertices();
@@ -28,9 +33,13 @@ private:
 
 	void addVertices(const float v1[3], const float v2[3], const float v3[3]);
 	void addNormals(float n1[3], float n2[3], float n3[3]);
+	void addTexCoords(const float t1[2], const float t2[2], const float t3[2]);
 	void addIndices(unsigned int i1, unsigned int i2, unsigned int i3);
 
-	void subdivideVerticesFlat();
+	void subdivideFaceFlat(const float v1[3], const float v2[3], const float v3[3],
+	                       const float t1[2], const float t2[2], const float t3[2], int level, VertData* out);
+	void writeTriangle(const float v1[3], const float v2[3], const float v3[3],
+	                   const float t1[2], const float t2[2], const float t3[2], VertData* out);
 	void buildVerticesFlat();
 
 	int subdivision;
@@ -38,5 +47,24 @@ private:
 
 	std::vector<float> vertices;
 	std::vector<float> normals;
+	std::vector<float> texCoords;
 	std::vector<unsigned int> indices;
 };
+
+// A single quad standing in for a whole sphere, drawn instanced with the
+// SHADER_IMPOSTOR variant. The vertex shader turns it to face the eye and the
+// fragment shader ray-casts the sphere, so it is round and lit per pixel at any
+// size for 4 vertices. The instance matrix's translation is the center and its
+// scale multiplies the radius.
+class SphereImpostor
+{
+public:
+	SphereImpostor(float sphereRadius = 1.0f)
+	{
+		radius = sphereRadius;
+	}
+	Model buildQuad();
+
+private:
+	float radius;
+};
@@ -0,0 +1,228 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_SIMD_H
+#define PI_GAME_SIMD_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PI_GAME_SIMD_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PI_GAME_SIMD_SSE 1
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#endif
+
+// Thin 4-wide float wrapper so the hot loops can be written once and run on
+// the Pi (NEON) as well as on a desktop while developing (SSE2).
+// Comparisons return all-ones / all-zero lanes, movemask() packs them to bits.
+namespace simd {
+
+    // set lanes per movemask() value
+    constexpr uint32_t laneCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+    namespace detail {
+        // per movemask() value the source byte of every output byte for
+        // compress(), 0x80 zeroes the byte in both vtbl and pshufb
+        alignas(16) constexpr uint8_t compressBytes[16][16] = {
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x08, 0x09, 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80 },
+            { 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x04, 0x05, 0x06, 0x07, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80 },
+            { 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80 },
+            { 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80 },
+            { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+        };
+    }
+
+#if defined(PI_GAME_SIMD_NEON)
+    struct Float4 { float32x4_t v; };
+
+    inline Float4 load(const float* p) { return { vld1q_f32(p) }; }
+    inline void store(float* p, Float4 a) { vst1q_f32(p, a.v); }
+    inline Float4 set1(float s) { return { vdupq_n_f32(s) }; }
+    inline Float4 add(Float4 a, Float4 b) { return { vaddq_f32(a.v, b.v) }; }
+    inline Float4 sub(Float4 a, Float4 b) { return { vsubq_f32(a.v, b.v) }; }
+    inline Float4 mul(Float4 a, Float4 b) { return { vmulq_f32(a.v, b.v) }; }
+    inline Float4 madd(Float4 a, Float4 b, Float4 c) { return { vmlaq_f32(c.v, a.v, b.v) }; }   // a * b + c
+    inline Float4 min(Float4 a, Float4 b) { return { vminq_f32(a.v, b.v) }; }
+    inline Float4 max(Float4 a, Float4 b) { return { vmaxq_f32(a.v, b.v) }; }
+    inline Float4 cmpgt(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)) }; }
+    inline Float4 cmplt(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)) }; }
+    inline Float4 cmpge(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)) }; }
+    inline Float4 cmple(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcleq_f32(a.v, b.v)) }; }
+    inline Float4 bitAnd(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+    inline Float4 bitOr(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+    // mask ? a : b
+    inline Float4 select(Float4 mask, Float4 a, Float4 b) { return { vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v) }; }
+
+    // 1 / a, ARMv7 NEON has no divide, the estimate is refined twice to about full precision
+    inline Float4 rcp(Float4 a)
+    {
+        float32x4_t r = vrecpeq_f32(a.v);
+        r = vmulq_f32(r, vrecpsq_f32(a.v, r));
+        return { vmulq_f32(r, vrecpsq_f32(a.v, r)) };
+    }
+
+    // 1 / sqrt(a), same estimate and refine
+    inline Float4 rsqrt(Float4 a)
+    {
+        float32x4_t r = vrsqrteq_f32(a.v);
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a.v, r), r));
+        return { vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a.v, r), r)) };
+    }
+
+    inline uint32_t movemask(Float4 mask)
+    {
+        static const int32_t shifts[4] = { 0, 1, 2, 3 };
+        uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask.v), 31);
+        bits = vshlq_u32(bits, vld1q_s32(shifts));
+        uint32x2_t sum = vpadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+        return vget_lane_u32(vpadd_u32(sum, sum), 0);
+    }
+
+    // the lanes set in mask (a movemask() value) moved to the front in
+    // order, laneCount[mask] of them, don't rely on the rest
+    inline Float4 compress(Float4 a, uint32_t mask)
+    {
+        uint8x16_t bytes = vreinterpretq_u8_f32(a.v);
+        uint8x16_t index = vld1q_u8(detail::compressBytes[mask]);
+#if defined(__aarch64__)
+        return { vreinterpretq_f32_u8(vqtbl1q_u8(bytes, index)) };
+#else
+        uint8x8x2_t table = { { vget_low_u8(bytes), vget_high_u8(bytes) } };
+        return { vreinterpretq_f32_u8(vcombine_u8(vtbl2_u8(table, vget_low_u8(index)),
+                                                  vtbl2_u8(table, vget_high_u8(index)))) };
+#endif
+    }
+#elif defined(PI_GAME_SIMD_SSE)
+    struct Float4 { __m128 v; };
+
+    inline Float4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+    inline void store(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+    inline Float4 set1(float s) { return { _mm_set1_ps(s) }; }
+    inline Float4 add(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Float4 sub(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Float4 mul(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Float4 madd(Float4 a, Float4 b, Float4 c) { return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) }; }
+    inline Float4 min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline Float4 max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline Float4 cmpgt(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    inline Float4 cmplt(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline Float4 cmpge(Float4 a, Float4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+    inline Float4 cmple(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    inline Float4 bitAnd(Float4 a, Float4 b) { return { _mm_and_ps(a.v, b.v) }; }
+    inline Float4 bitOr(Float4 a, Float4 b) { return { _mm_or_ps(a.v, b.v) }; }
+    inline Float4 select(Float4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+    inline Float4 rcp(Float4 a) { return { _mm_div_ps(_mm_set1_ps(1.0f), a.v) }; }
+    inline Float4 rsqrt(Float4 a)
+    {
+        // estimate plus one Newton step, like NEON, a divide and a square root cost far more
+        __m128 r = _mm_rsqrt_ps(a.v);
+        __m128 ar2 = _mm_mul_ps(_mm_mul_ps(a.v, r), r);
+        return { _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), ar2)) };
+    }
+    inline uint32_t movemask(Float4 mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask.v)); }
+
+#if defined(__SSSE3__)
+    inline Float4 compress(Float4 a, uint32_t mask)
+    {
+        __m128i index = _mm_load_si128(reinterpret_cast<const __m128i*>(detail::compressBytes[mask]));
+        return { _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(a.v), index)) };
+    }
+#else
+    // plain SSE2 has no variable shuffle. Every table lane as a 32 bit word
+    // names its source lane by the same word as the identity row, so each
+    // source lane is broadcast and kept where the table asks for it.
+    inline Float4 compress(Float4 a, uint32_t mask)
+    {
+        const __m128i index = _mm_load_si128(reinterpret_cast<const __m128i*>(detail::compressBytes[mask]));
+        const __m128i lane0 = _mm_cmpeq_epi32(index, _mm_set1_epi32(0x03020100));
+        const __m128i lane1 = _mm_cmpeq_epi32(index, _mm_set1_epi32(0x07060504));
+        const __m128i lane2 = _mm_cmpeq_epi32(index, _mm_set1_epi32(0x0b0a0908));
+        const __m128i lane3 = _mm_cmpeq_epi32(index, _mm_set1_epi32(0x0f0e0d0c));
+        __m128 r = _mm_and_ps(_mm_castsi128_ps(lane0), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_or_ps(r, _mm_and_ps(_mm_castsi128_ps(lane1), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_or_ps(r, _mm_and_ps(_mm_castsi128_ps(lane2), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm_or_ps(r, _mm_and_ps(_mm_castsi128_ps(lane3), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3))));
+        return { r };
+    }
+#endif
+#else
+    // plain C++ fallback, the compiler is free to auto-vectorize it
+    struct Float4 { float v[4]; };
+
+    inline uint32_t bitsOf(float f)
+    {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    inline float fromBits(uint32_t u)
+    {
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    inline float maskOf(bool b) { return fromBits(b ? 0xffffffffu : 0u); }
+    inline bool isSet(float f) { return (bitsOf(f) & 0x80000000u) != 0; }
+
+    inline Float4 load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    inline void store(float* p, Float4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+    inline Float4 set1(float s) { return { { s, s, s, s } }; }
+    inline Float4 add(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+    inline Float4 sub(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+    inline Float4 mul(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+    inline Float4 madd(Float4 a, Float4 b, Float4 c) { for (int i = 0; i < 4; i++) c.v[i] += a.v[i] * b.v[i]; return c; }
+    inline Float4 min(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+    inline Float4 max(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+    inline Float4 cmpgt(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = maskOf(a.v[i] > b.v[i]); return a; }
+    inline Float4 cmplt(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = maskOf(a.v[i] < b.v[i]); return a; }
+    inline Float4 cmpge(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = maskOf(a.v[i] >= b.v[i]); return a; }
+    inline Float4 cmple(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = maskOf(a.v[i] <= b.v[i]); return a; }
+    inline Float4 bitAnd(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = fromBits(bitsOf(a.v[i]) & bitsOf(b.v[i])); return a; }
+    inline Float4 bitOr(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = fromBits(bitsOf(a.v[i]) | bitsOf(b.v[i])); return a; }
+    inline Float4 select(Float4 mask, Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = isSet(mask.v[i]) ? a.v[i] : b.v[i]; return a; }
+    inline Float4 rcp(Float4 a) { for (int i = 0; i < 4; i++) a.v[i] = 1.0f / a.v[i]; return a; }
+    inline Float4 rsqrt(Float4 a) { for (int i = 0; i < 4; i++) a.v[i] = 1.0f / std::sqrt(a.v[i]); return a; }
+
+    inline uint32_t movemask(Float4 mask)
+    {
+        uint32_t bits = 0;
+        for (uint32_t i = 0; i < 4; i++)
+            bits |= (isSet(mask.v[i]) ? 1u : 0u) << i;
+        return bits;
+    }
+
+    // four loads through the table, the byte index over four is the source
+    // lane, unused lanes get some lane of a
+    inline Float4 compress(Float4 a, uint32_t mask)
+    {
+        const uint8_t* index = detail::compressBytes[mask];
+        return { { a.v[(index[0] >> 2) & 3u], a.v[(index[4] >> 2) & 3u], a.v[(index[8] >> 2) & 3u],
+                   a.v[(index[12] >> 2) & 3u] } };
+    }
+#endif
+
+}
+
+
+#endif //PI_GAME_SIMD_H
@@ -0,0 +1,102 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include "Simulation.h"
+#include "Trace.h"
+
+SimState interpolate(const SimState& a, const SimState& b, float alpha)
+{
+    SimState out = b;
+    out.cameraEye = a.cameraEye + (b.cameraEye - a.cameraEye) * alpha;
+    out.cameraTarget = a.cameraTarget + (b.cameraTarget - a.cameraTarget) * alpha;
+    out.spin = a.spin + (b.spin - a.spin) * alpha;
+    return out;
+}
+
+Simulation::Simulation(Clock::duration stepSize, int maxSteps)
+    : step(stepSize), maxCatchUpSteps(maxSteps)
+{
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start(UpdateFn update, const SimState& initial)
+{
+    if (running.load())
+        return;
+
+    updateFn = std::move(update);
+    state = initial;
+
+    // seed the buffer so the renderer has something valid before the first tick
+    SimSnapshot& first = snapshots.writeBuffer();
+    first.previous = state;
+    first.current = state;
+    first.currentTime = Clock::now();
+    snapshots.publish();
+
+    running.store(true);
+    thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    running.store(false);
+    if (thread.joinable())
+        thread.join();
+}
+
+SimState Simulation::sample(Clock::time_point now)
+{
+    snapshots.update();
+    const SimSnapshot& snap = snapshots.readBuffer();
+
+    // the newest tick becomes the target one step after it was produced
+    float alpha = std::chrono::duration<float>(now - snap.currentTime).count()
+                  / std::chrono::duration<float>(step).count();
+    alpha = std::min(std::max(alpha, 0.0f), 1.0f);
+
+    return interpolate(snap.previous, snap.current, alpha);
+}
+
+void Simulation::run()
+{
+    TRACE_THREAD_NAME("simulation");
+
+    const float dt = std::chrono::duration<float>(step).count();
+    Clock::time_point nextTick = Clock::now() + step;
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(nextTick);
+
+        // fixed timestep: catch up on missed ticks, but drop time instead of
+        // spiralling when the update itself is slower than real time
+        int steps = 0;
+        Clock::time_point now = Clock::now();
+        while (nextTick <= now && steps < maxCatchUpSteps)
+        {
+            TRACE_SCOPE("simStep");
+            SimState previous = state;
+            updateFn(state, dt);
+            state.tick++;
+
+            SimSnapshot& snap = snapshots.writeBuffer();
+            snap.previous = previous;
+            snap.current = state;
+            snap.currentTime = nextTick;
+            snapshots.publish();
+
+            nextTick += step;
+            steps++;
+        }
+
+        if (nextTick <= now)
+            nextTick = now + step;
+    }
+}
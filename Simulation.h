@@ -0,0 +1,74 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_SIMULATION_H
+#define PI_GAME_SIMULATION_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <glm/vec3.hpp>
+#include "TripleBuffer.h"
+
+// Everything the renderer needs to know about the game world for one tick.
+// Keep it plain data, it gets copied into the triple buffer every step.
+struct SimState
+{
+    uint64_t tick = 0;
+    glm::vec3 cameraEye = glm::vec3(2.0f, 0.0f, 0.0f);
+    glm::vec3 cameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
+    float spin = 0.0f;
+};
+
+// Two consecutive ticks and the time the newer one became valid,
+// which is all the render thread needs to interpolate.
+struct SimSnapshot
+{
+    SimState previous;
+    SimState current;
+    std::chrono::steady_clock::time_point currentTime;
+};
+
+SimState interpolate(const SimState& a, const SimState& b, float alpha);
+
+// Runs the game logic at a fixed timestep on its own thread and publishes
+// every finished step through a lock-free triple buffer. The render thread
+// never waits on the simulation, a slow update only makes the interpolated
+// state lag, it can not make swapBuffers() miss a vblank.
+class Simulation {
+public:
+    using Clock = std::chrono::steady_clock;
+    using UpdateFn = std::function<void(SimState&, float)>;
+
+    explicit Simulation(Clock::duration stepSize = std::chrono::microseconds(8333), int maxSteps = 5);
+    ~Simulation();
+
+    void start(UpdateFn update, const SimState& initial = SimState());
+    void stop();
+
+    // render thread only: latest state blended between the last two ticks
+    SimState sample(Clock::time_point now);
+
+    Clock::duration getStep() const
+    {
+        return step;
+    }
+
+private:
+    void run();
+
+    Clock::duration step;
+    int maxCatchUpSteps;
+
+    UpdateFn updateFn;
+    SimState state;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    TripleBuffer<SimSnapshot> snapshots;
+};
+
+
+#endif //PI_GAME_SIMULATION_H
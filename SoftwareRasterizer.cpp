@@ -0,0 +1,465 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <glm/glm.hpp>
+#include "SoftwareRasterizer.h"
+#include "MemoryTracker.h"
+#include "Simd.h"
+#include "Trace.h"
+
+namespace {
+    // the light of tutorial2.vert's LIGHTING_LAMBERT
+    const glm::vec3 lightPosition(0.0f, 40.0f, 0.0f);
+    const float ambientStrength = 0.1f;
+
+    const float laneOffsets[4] = { 0.5f, 1.5f, 2.5f, 3.5f };    // pixel centers of a 4 pixel span
+
+    double msSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t packColor(float r, float g, float b, float a)
+    {
+        auto channel = [](float c) {
+            return static_cast<uint32_t>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+        };
+        return channel(r) | channel(g) << 8 | channel(b) << 16 | channel(a) << 24;
+    }
+
+    inline simd::Float4 edgeTest(simd::Float4 e, bool inclusive, simd::Float4 zero)
+    {
+        return inclusive ? simd::cmpge(e, zero) : simd::cmpgt(e, zero);
+    }
+}
+
+SoftwareRasterizer::SoftwareRasterizer(uint32_t framebufferWidth, uint32_t framebufferHeight, JobSystem& jobSystem)
+    : jobs(jobSystem), width(framebufferWidth), height(framebufferHeight)
+{
+    if (width == 0 || height == 0)
+        throw std::runtime_error("Software framebuffer needs a non-zero size");
+
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    pitch = tilesX * tileSize;
+
+    // padded to whole tiles, 4-wide spans never have to check the row end
+    const size_t pixels = static_cast<size_t>(pitch) * tilesY * tileSize;
+    color.assign(pixels, 0);
+    depth.assign(pixels, 1.0f);
+    MemoryTracker::instance().allocate(MemoryCategory::RenderTarget, pixels * (sizeof(uint32_t) + sizeof(float)));
+}
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+    MemoryTracker::instance().release(MemoryCategory::RenderTarget, color.size() * (sizeof(uint32_t) + sizeof(float)));
+}
+
+void SoftwareRasterizer::clear(const glm::vec4& rgba, float windowZ)
+{
+    clearPending = true;
+    clearColor = packColor(rgba.x, rgba.y, rgba.z, rgba.w);
+    clearDepth = windowZ;
+}
+
+void SoftwareRasterizer::draw(Model& model, const glm::mat4& viewProjection, const glm::mat4& world)
+{
+    TRACE_SCOPE("softwareDraw");
+    const auto start = std::chrono::steady_clock::now();
+
+    const size_t base = clipVertices.size();
+    const size_t numVerts = static_cast<size_t>(model.getNumVerts());
+    const size_t numIndices = static_cast<size_t>(model.getNumIndices()) / 3 * 3;
+    clipVertices.resize(base + numVerts);
+
+    const VertData* verts = model.getDataPtr();
+    ClipVertex* out = clipVertices.data() + base;
+    const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+
+    jobs.parallelFor(0, numVerts, 1024, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            const VertData& v = verts[i];
+            const glm::vec4 position = world * glm::vec4(v.position[0], v.position[1], v.position[2], 1.0f);
+            const glm::vec3 normal = glm::normalize(normalMatrix * glm::vec3(v.normal[0], v.normal[1], v.normal[2]));
+            const glm::vec3 lightDir = glm::normalize(lightPosition - glm::vec3(position));
+            const float lighting = ambientStrength + std::max(glm::dot(normal, lightDir), 0.0f);
+
+            out[i].position = viewProjection * position;
+            out[i].color = glm::vec3(v.color[0], v.color[1], v.color[2]) * lighting;
+        }
+    });
+
+    const size_t firstIndex = clipIndices.size();
+    clipIndices.resize(firstIndex + numIndices);
+    uint32_t* indices = clipIndices.data() + firstIndex;
+    if (model.getIndexType() == GL_UNSIGNED_SHORT)
+    {
+        const GLushort* in = model.getShortIndPtr();
+        for (size_t i = 0; i < numIndices; i++)
+            indices[i] = static_cast<uint32_t>(base + in[i]);
+    }
+    else
+    {
+        const GLuint* in = model.getIndPtr();
+        for (size_t i = 0; i < numIndices; i++)
+            indices[i] = static_cast<uint32_t>(base + in[i]);
+    }
+
+    pending.draws++;
+    pending.triangles += static_cast<uint32_t>(numIndices / 3);
+    pending.setupMs += msSince(start);
+}
+
+void SoftwareRasterizer::flush()
+{
+    auto start = std::chrono::steady_clock::now();
+    {
+        TRACE_SCOPE("softwareSetup");
+        const size_t triangles = clipIndices.size() / 3;
+        usedChunks = (triangles + chunkTriangles - 1) / chunkTriangles;
+        while (chunks.size() < usedChunks)
+        {
+            chunks.emplace_back();
+            chunks.back().bins.resize(static_cast<size_t>(tilesX) * tilesY);
+        }
+
+        jobs.parallelFor(0, usedChunks, 1, [this, triangles](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++)
+                setupChunk(chunks[c], c * chunkTriangles, std::min(triangles, (c + 1) * chunkTriangles));
+        });
+    }
+    pending.setupMs += msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    {
+        TRACE_SCOPE("softwareRaster");
+        jobs.parallelFor(0, static_cast<size_t>(tilesX) * tilesY, 1, [this](size_t first, size_t last) {
+            for (size_t tile = first; tile < last; tile++)
+                rasterizeTile(static_cast<uint32_t>(tile));
+        });
+    }
+    pending.rasterMs = msSince(start);
+
+    for (size_t c = 0; c < usedChunks; c++)
+    {
+        pending.culled += chunks[c].culled;
+        pending.tileTriangles += chunks[c].binned;
+    }
+
+    clearPending = false;
+    clipVertices.clear();
+    clipIndices.clear();
+    usedChunks = 0;
+
+    stats = pending;
+    pending = Stats();
+    totalFrames++;
+    totalTriangles += stats.triangles;
+    totalTileTriangles += stats.tileTriangles;
+    totalSetupMs += stats.setupMs;
+    totalRasterMs += stats.rasterMs;
+}
+
+void SoftwareRasterizer::writePpm(const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Failed to open " + path);
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+    bool ok = true;
+    for (uint32_t y = 0; y < height && ok; y++)
+    {
+        const uint32_t* pixels = &color[static_cast<size_t>(y) * pitch];
+        for (uint32_t x = 0; x < width; x++)
+        {
+            row[x * 3] = static_cast<unsigned char>(pixels[x]);
+            row[x * 3 + 1] = static_cast<unsigned char>(pixels[x] >> 8);
+            row[x * 3 + 2] = static_cast<unsigned char>(pixels[x] >> 16);
+        }
+        ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+    }
+
+    if (fclose(file) != 0 || !ok)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+void SoftwareRasterizer::dumpEvery(std::chrono::steady_clock::duration interval, FILE* out)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastDump < interval)
+        return;
+
+    lastDump = now;
+    if (totalFrames)
+    {
+        const double frames = static_cast<double>(totalFrames);
+        fprintf(out, "software raster: %.2f ms setup %.2f ms raster, %.0f triangles %.2f tiles each, %u workers\n",
+                totalSetupMs / frames, totalRasterMs / frames, static_cast<double>(totalTriangles) / frames,
+                totalTriangles ? static_cast<double>(totalTileTriangles) / static_cast<double>(totalTriangles) : 0.0,
+                jobs.getNumWorkers());
+    }
+
+    totalFrames = 0;
+    totalTriangles = 0;
+    totalTileTriangles = 0;
+    totalSetupMs = 0.0;
+    totalRasterMs = 0.0;
+}
+
+void SoftwareRasterizer::setupChunk(Chunk& chunk, size_t first, size_t last)
+{
+    chunk.triangles.clear();
+    for (auto& bin : chunk.bins)
+        bin.clear();
+    chunk.culled = 0;
+    chunk.binned = 0;
+
+    for (size_t t = first; t < last; t++)
+    {
+        const uint32_t* tri = &clipIndices[t * 3];
+        setupTriangle(chunk, clipVertices[tri[0]], clipVertices[tri[1]], clipVertices[tri[2]]);
+    }
+}
+
+void SoftwareRasterizer::setupTriangle(Chunk& chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+    // distance to the near plane z = -w, Sutherland-Hodgman against it alone,
+    // the other planes are handled by the screen bounds and the depth test
+    const ClipVertex* in[3] = { &v0, &v1, &v2 };
+    float distance[3];
+    uint32_t inside = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        distance[i] = in[i]->position.z + in[i]->position.w;
+        inside += distance[i] >= 0.0f ? 1u : 0u;
+    }
+
+    bool binned = false;
+    if (inside == 3)
+    {
+        binned = binTriangle(chunk, v0, v1, v2);
+    }
+    else if (inside > 0)
+    {
+        ClipVertex polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const int j = (i + 1) % 3;
+            if (distance[i] >= 0.0f)
+                polygon[count++] = *in[i];
+            if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f))
+            {
+                const float t = distance[i] / (distance[i] - distance[j]);
+                polygon[count].position = glm::mix(in[i]->position, in[j]->position, t);
+                polygon[count].color = glm::mix(in[i]->color, in[j]->color, t);
+                count++;
+            }
+        }
+
+        binned = binTriangle(chunk, polygon[0], polygon[1], polygon[2]);
+        if (count == 4)
+            binned = binTriangle(chunk, polygon[0], polygon[2], polygon[3]) || binned;
+    }
+
+    if (!binned)
+        chunk.culled++;
+}
+
+bool SoftwareRasterizer::binTriangle(Chunk& chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+    struct ScreenVertex
+    {
+        float x, y, z, invW;
+        glm::vec3 color;
+    };
+
+    // window coordinates with y down, rows are stored top first
+    const ClipVertex* in[3] = { &v0, &v1, &v2 };
+    ScreenVertex s[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec4& p = in[i]->position;
+        const float invW = 1.0f / p.w;
+        s[i].x = (p.x * invW * 0.5f + 0.5f) * static_cast<float>(width);
+        s[i].y = (0.5f - p.y * invW * 0.5f) * static_cast<float>(height);
+        s[i].z = p.z * invW * 0.5f + 0.5f;
+        s[i].invW = invW;
+        s[i].color = in[i]->color * invW;
+    }
+
+    // counter-clockwise in GL terms is negative once y points down
+    float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+    if (!(std::fabs(area) > 0.0f) || (cullBackFaces && area > 0.0f))
+        return false;
+    if (area < 0.0f)
+    {
+        std::swap(s[1], s[2]);
+        area = -area;
+    }
+
+    const float minXf = std::min(std::min(s[0].x, s[1].x), s[2].x);
+    const float maxXf = std::max(std::max(s[0].x, s[1].x), s[2].x);
+    const float minYf = std::min(std::min(s[0].y, s[1].y), s[2].y);
+    const float maxYf = std::max(std::max(s[0].y, s[1].y), s[2].y);
+    if (maxXf < 0.0f || maxYf < 0.0f || minXf >= static_cast<float>(width) || minYf >= static_cast<float>(height))
+        return false;
+
+    Triangle tri;
+    tri.minX = static_cast<int32_t>(std::floor(std::max(minXf, 0.0f)));
+    tri.minY = static_cast<int32_t>(std::floor(std::max(minYf, 0.0f)));
+    tri.maxX = static_cast<int32_t>(std::min(maxXf, static_cast<float>(width - 1)));
+    tri.maxY = static_cast<int32_t>(std::min(maxYf, static_cast<float>(height - 1)));
+
+    // edge i runs between the two vertices other than i
+    const float invArea = 1.0f / area;
+    for (int i = 0; i < 3; i++)
+    {
+        const ScreenVertex& a = s[(i + 1) % 3];
+        const ScreenVertex& b = s[(i + 2) % 3];
+        const float edgeA = a.y - b.y;
+        const float edgeB = b.x - a.x;
+
+        // neighbours share an edge in opposite directions, exactly one of them takes it
+        tri.inclusive[i] = edgeA > 0.0f || (edgeA == 0.0f && edgeB > 0.0f);
+        tri.edgeA[i] = edgeA * invArea;
+        tri.edgeB[i] = edgeB * invArea;
+        tri.edgeC[i] = -(edgeA * a.x + edgeB * a.y) * invArea;
+
+        tri.z[i] = s[i].z;
+        tri.invW[i] = s[i].invW;
+        tri.color[i][0] = s[i].color.x;
+        tri.color[i][1] = s[i].color.y;
+        tri.color[i][2] = s[i].color.z;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(chunk.triangles.size());
+    uint32_t tiles = 0;
+    for (int32_t ty = tri.minY / static_cast<int32_t>(tileSize); ty <= tri.maxY / static_cast<int32_t>(tileSize); ty++)
+    {
+        for (int32_t tx = tri.minX / static_cast<int32_t>(tileSize); tx <= tri.maxX / static_cast<int32_t>(tileSize); tx++)
+        {
+            // skip tiles the bounds overlap but the triangle misses, an edge
+            // negative at the tile corner furthest along its normal excludes it
+            const float x0 = static_cast<float>(tx * static_cast<int32_t>(tileSize)) + 0.5f;
+            const float y0 = static_cast<float>(ty * static_cast<int32_t>(tileSize)) + 0.5f;
+            const float x1 = x0 + static_cast<float>(tileSize - 1);
+            const float y1 = y0 + static_cast<float>(tileSize - 1);
+            bool overlaps = true;
+            for (int i = 0; i < 3 && overlaps; i++)
+            {
+                const float x = tri.edgeA[i] >= 0.0f ? x1 : x0;
+                const float y = tri.edgeB[i] >= 0.0f ? y1 : y0;
+                overlaps = tri.edgeA[i] * x + tri.edgeB[i] * y + tri.edgeC[i] >= 0.0f;
+            }
+            if (!overlaps)
+                continue;
+
+            chunk.bins[static_cast<size_t>(ty) * tilesX + static_cast<size_t>(tx)].push_back(index);
+            tiles++;
+        }
+    }
+
+    if (tiles == 0)
+        return false;
+
+    chunk.triangles.push_back(tri);
+    chunk.binned += tiles;
+    return true;
+}
+
+void SoftwareRasterizer::rasterizeTile(uint32_t tile)
+{
+    const int32_t x0 = static_cast<int32_t>((tile % tilesX) * tileSize);
+    const int32_t y0 = static_cast<int32_t>((tile / tilesX) * tileSize);
+    const int32_t x1 = std::min(x0 + static_cast<int32_t>(tileSize), static_cast<int32_t>(width));
+    const int32_t y1 = std::min(y0 + static_cast<int32_t>(tileSize), static_cast<int32_t>(height));
+
+    if (clearPending)
+    {
+        for (int32_t y = y0; y < y1; y++)
+        {
+            const size_t row = static_cast<size_t>(y) * pitch + static_cast<size_t>(x0);
+            std::fill_n(&color[row], tileSize, clearColor);
+            std::fill_n(&depth[row], tileSize, clearDepth);
+        }
+    }
+
+    // chunk by chunk is submission order, ties in depth resolve like GL
+    for (size_t c = 0; c < usedChunks; c++)
+    {
+        const Chunk& chunk = chunks[c];
+        for (uint32_t index : chunk.bins[tile])
+            rasterizeTriangle(chunk.triangles[index], x0, y0, x1, y1);
+    }
+}
+
+void SoftwareRasterizer::rasterizeTriangle(const Triangle& tri, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    using namespace simd;
+
+    // spans start 4-aligned, a tile is a multiple of 4 wide so they never
+    // leave it, past the right edge of the screen they land in the padding
+    const int32_t minX = std::max(tri.minX, x0) & ~3;
+    const int32_t maxX = std::min(tri.maxX, x1 - 1);
+    const int32_t minY = std::max(tri.minY, y0);
+    const int32_t maxY = std::min(tri.maxY, y1 - 1);
+
+    const Float4 zero = set1(0.0f);
+    const Float4 lanes = load(laneOffsets);
+    const Float4 a0 = set1(tri.edgeA[0]), a1 = set1(tri.edgeA[1]), a2 = set1(tri.edgeA[2]);
+    const Float4 z0 = set1(tri.z[0]), z1 = set1(tri.z[1]), z2 = set1(tri.z[2]);
+    const Float4 w0 = set1(tri.invW[0]), w1 = set1(tri.invW[1]), w2 = set1(tri.invW[2]);
+    const Float4 r0 = set1(tri.color[0][0]), r1 = set1(tri.color[1][0]), r2 = set1(tri.color[2][0]);
+    const Float4 g0 = set1(tri.color[0][1]), g1 = set1(tri.color[1][1]), g2 = set1(tri.color[2][1]);
+    const Float4 b0 = set1(tri.color[0][2]), b1 = set1(tri.color[1][2]), b2 = set1(tri.color[2][2]);
+
+    for (int32_t y = minY; y <= maxY; y++)
+    {
+        const float py = static_cast<float>(y) + 0.5f;
+        const Float4 c0 = set1(tri.edgeB[0] * py + tri.edgeC[0]);
+        const Float4 c1 = set1(tri.edgeB[1] * py + tri.edgeC[1]);
+        const Float4 c2 = set1(tri.edgeB[2] * py + tri.edgeC[2]);
+        uint32_t* colorRow = &color[static_cast<size_t>(y) * pitch];
+        float* depthRow = &depth[static_cast<size_t>(y) * pitch];
+
+        for (int32_t x = minX; x <= maxX; x += 4)
+        {
+            const Float4 px = add(set1(static_cast<float>(x)), lanes);
+            const Float4 e0 = madd(a0, px, c0);
+            const Float4 e1 = madd(a1, px, c1);
+            const Float4 e2 = madd(a2, px, c2);
+            const Float4 covered = bitAnd(bitAnd(edgeTest(e0, tri.inclusive[0], zero), edgeTest(e1, tri.inclusive[1], zero)),
+                                          edgeTest(e2, tri.inclusive[2], zero));
+            if (!movemask(covered))
+                continue;
+
+            // window z is affine in screen space, the edges are the weights
+            const Float4 z = madd(e0, z0, madd(e1, z1, mul(e2, z2)));
+            const Float4 stored = load(depthRow + x);
+            const Float4 pass = bitAnd(covered, cmplt(z, stored));
+            const uint32_t bits = movemask(pass);
+            if (!bits)
+                continue;
+            store(depthRow + x, select(pass, z, stored));
+
+            const Float4 w = rcp(madd(e0, w0, madd(e1, w1, mul(e2, w2))));
+            float r[4], g[4], b[4];
+            store(r, mul(madd(e0, r0, madd(e1, r1, mul(e2, r2))), w));
+            store(g, mul(madd(e0, g0, madd(e1, g1, mul(e2, g2))), w));
+            store(b, mul(madd(e0, b0, madd(e1, b1, mul(e2, b2))), w));
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (bits & (1u << lane))
+                    colorRow[x + lane] = packColor(r[lane], g[lane], b[lane], 1.0f);
+            }
+        }
+    }
+}
@@ -0,0 +1,174 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_SOFTWARERASTERIZER_H
+#define PI_GAME_SOFTWARERASTERIZER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "JobSystem.h"
+#include "Model.h"
+
+// Renders Models on the CPU into a memory framebuffer, for machines without
+// a usable GPU or DRM device and as a deterministic reference to compare the
+// GL output against.
+//
+// draw() transforms and lights the vertices and queues the triangles.
+// flush() clips them against the near plane and bins each into the screen
+// tiles it overlaps, then rasterizes all tiles in parallel. Every tile walks
+// its bins in submission order with 4-wide edge functions, a GL_LESS depth
+// test and perspective correct colors. Triangles are set up in fixed size
+// chunks with bins of their own, so the result does not depend on how the
+// jobs got scheduled.
+// Shading is the vertex color with the Lambert term of tutorial2.vert.
+// Everything has to be called from a thread of the JobSystem.
+class SoftwareRasterizer {
+public:
+    static constexpr uint32_t tileSize = 64;            // pixels, a multiple of 4
+    static constexpr uint32_t chunkTriangles = 1024;    // setup and binning granularity
+
+    struct Stats
+    {
+        uint32_t draws = 0;
+        uint32_t triangles = 0;         // submitted
+        uint32_t culled = 0;            // behind the near plane, off screen, back facing or degenerate
+        uint32_t tileTriangles = 0;     // bin entries, a triangle counts once per tile it touches
+        double setupMs = 0.0;           // vertex transform in draw(), clipping and binning
+        double rasterMs = 0.0;
+    };
+
+    SoftwareRasterizer(uint32_t framebufferWidth, uint32_t framebufferHeight, JobSystem& jobSystem);
+    ~SoftwareRasterizer();
+
+    SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+    // applied to every tile by the next flush(), before its triangles
+    void clear(const glm::vec4& rgba, float windowZ = 1.0f);
+
+    // GL leaves culling off by default, so does this
+    void setCullBackFaces(bool cull)
+    {
+        cullBackFaces = cull;
+    }
+
+    // Queues the model's triangles. Reads the CPU side vertex and index
+    // arrays, the model has to stay alive until flush().
+    void draw(Model& model, const glm::mat4& viewProjection, const glm::mat4& world);
+
+    // rasterizes everything queued since the last flush()
+    void flush();
+
+    uint32_t getWidth() const
+    {
+        return width;
+    }
+
+    uint32_t getHeight() const
+    {
+        return height;
+    }
+
+    // pixels per row, rows are padded to whole tiles
+    uint32_t getPitch() const
+    {
+        return pitch;
+    }
+
+    // RGBA8, top row first
+    const uint32_t* getColor() const
+    {
+        return color.data();
+    }
+
+    // window depth, 0 near to 1 far
+    const float* getDepth() const
+    {
+        return depth.data();
+    }
+
+    // binary PPM of the color buffer, throws std::runtime_error
+    void writePpm(const std::string& path) const;
+
+    // of the last flush()
+    const Stats& getStats() const
+    {
+        return stats;
+    }
+
+    void dumpEvery(std::chrono::steady_clock::duration interval, FILE* out = stdout);
+
+private:
+    struct ClipVertex
+    {
+        glm::vec4 position;
+        glm::vec3 color;
+    };
+
+    // Edge functions are scaled by 1 / area, evaluated at a pixel center they
+    // give the barycentric weight of the opposite vertex directly
+    struct Triangle
+    {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        bool inclusive[3];      // top-left rule, pixels exactly on a shared edge go to one side only
+        float z[3];
+        float invW[3];
+        float color[3][3];      // divided by w for perspective correct interpolation
+        int32_t minX, minY, maxX, maxY;
+    };
+
+    struct Chunk
+    {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;    // per tile, into triangles
+        uint32_t culled = 0;
+        uint32_t binned = 0;
+    };
+
+    void setupChunk(Chunk& chunk, size_t first, size_t last);
+    void setupTriangle(Chunk& chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+    bool binTriangle(Chunk& chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+    void rasterizeTile(uint32_t tile);
+    void rasterizeTriangle(const Triangle& tri, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+    JobSystem& jobs;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint32_t pitch;
+    std::vector<uint32_t> color;
+    std::vector<float> depth;
+
+    bool cullBackFaces = false;
+    bool clearPending = false;
+    uint32_t clearColor = 0;
+    float clearDepth = 1.0f;
+
+    // everything queued since the last flush(), indices are into clipVertices
+    std::vector<ClipVertex> clipVertices;
+    std::vector<uint32_t> clipIndices;
+    std::vector<Chunk> chunks;      // kept across frames for their capacity
+    size_t usedChunks = 0;
+
+    Stats stats;
+    Stats pending;
+    uint64_t totalFrames = 0;
+    uint64_t totalTriangles = 0;
+    uint64_t totalTileTriangles = 0;
+    double totalSetupMs = 0.0;
+    double totalRasterMs = 0.0;
+    std::chrono::steady_clock::time_point lastDump = std::chrono::steady_clock::now();
+};
+
+
+#endif //PI_GAME_SOFTWARERASTERIZER_H
@@ -0,0 +1,617 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "SpherePhysics.h"
+#include "JobSystem.h"
+#include "Model.h"
+#include "Simd.h"
+#include "MemoryTracker.h"
+
+namespace {
+    // buckets summed per prefix job
+    constexpr size_t prefixBlock = 1024;
+
+    size_t roundUp4(size_t n)
+    {
+        return (n + 3) & ~static_cast<size_t>(3);
+    }
+
+    uint32_t nextPowerOfTwo(size_t n)
+    {
+        uint32_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    float horizontalSum(simd::Float4 v)
+    {
+        float lanes[4];
+        simd::store(lanes, v);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+
+    int32_t cellOf(float x, float invCellSize)
+    {
+        return static_cast<int32_t>(std::floor(x * invCellSize));
+    }
+
+    template<typename F>
+    void forRange(JobSystem* jobs, size_t first, size_t last, size_t grain, F&& func)
+    {
+        if (jobs)
+            jobs->parallelFor(first, last, grain, func);
+        else
+            func(first, last);
+    }
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+SpherePhysics::SpherePhysics(size_t maxBodies)
+    : capacity(roundUp4(maxBodies))
+{
+    // zero radius and mass past the last body, a trailing partial batch of
+    // four integrates harmless empty lanes
+    for (auto* array : { &posX, &posY, &posZ, &velX, &velY, &velZ, &radius, &mass, &colorR, &colorG, &colorB })
+        array->assign(capacity, 0.0f);
+
+    // the narrowphase loads four candidates from any slot up to the last
+    for (auto* array : { &sortedX, &sortedY, &sortedZ, &sortedVX, &sortedVY, &sortedVZ, &sortedR, &sortedM })
+        array->assign(capacity + 4, 0.0f);
+
+    bucketOf.resize(capacity);
+    sortedBody.resize(capacity);
+    for (auto* array : { &sortedCellX, &sortedCellY, &sortedCellZ })
+        array->resize(capacity);
+}
+
+SpherePhysics::~SpherePhysics()
+{
+    if (instanceBuffer)
+    {
+        MemoryTracker::instance().untrackBuffer(instanceBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+}
+
+uint32_t SpherePhysics::add(const glm::vec3& position, const glm::vec3& velocity, float sphereRadius, const glm::vec3& color)
+{
+    if (count == capacity)
+        throw std::runtime_error("Sphere physics is full");
+    if (!(sphereRadius > 0.0f))
+        throw std::runtime_error("Sphere radius has to be positive");
+
+    const size_t i = count++;
+    posX[i] = position.x;
+    posY[i] = position.y;
+    posZ[i] = position.z;
+    velX[i] = velocity.x;
+    velY[i] = velocity.y;
+    velZ[i] = velocity.z;
+    radius[i] = sphereRadius;
+    mass[i] = sphereRadius * sphereRadius * sphereRadius;   // all the same density
+    colorR[i] = color.x;
+    colorG[i] = color.y;
+    colorB[i] = color.z;
+
+    maxRadius = std::max(maxRadius, sphereRadius);
+    return static_cast<uint32_t>(i);
+}
+
+void SpherePhysics::integrate(size_t first, size_t last, float dt)
+{
+    using namespace simd;
+
+    const Float4 dtv = set1(dt);
+    const Float4 zero = set1(0.0f);
+    const Float4 bounce = set1(restitution);
+    const Float4 gv[3] = { set1(gravity.x * dt), set1(gravity.y * dt), set1(gravity.z * dt) };
+    const Float4 lo[3] = { set1(worldMin.x), set1(worldMin.y), set1(worldMin.z) };
+    const Float4 hi[3] = { set1(worldMax.x), set1(worldMax.y), set1(worldMax.z) };
+    float* const pos[3] = { posX.data(), posY.data(), posZ.data() };
+    float* const vel[3] = { velX.data(), velY.data(), velZ.data() };
+
+    for (size_t i = first; i < last; i += 4)
+    {
+        const Float4 r = load(&radius[i]);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Float4 v = simd::add(load(vel[axis] + i), gv[axis]);
+            Float4 p = madd(v, dtv, load(pos[axis] + i));
+
+            // a wall puts the sphere back on its face and reflects the
+            // velocity into the box, losing what restitution takes
+            const Float4 speed = mul(max(v, sub(zero, v)), bounce);
+            const Float4 low = simd::add(lo[axis], r);
+            const Float4 high = sub(hi[axis], r);
+            const Float4 below = cmplt(p, low);
+            const Float4 above = cmpgt(p, high);
+            p = select(below, low, select(above, high, p));
+            v = select(below, speed, select(above, sub(zero, speed), v));
+
+            store(vel[axis] + i, v);
+            store(pos[axis] + i, p);
+        }
+    }
+}
+
+uint32_t SpherePhysics::hashRow(int32_t y, int32_t z) const
+{
+    // large primes spread neighbouring rows over the table
+    return static_cast<uint32_t>(y) * 73856093u ^ static_cast<uint32_t>(z) * 19349663u;
+}
+
+void SpherePhysics::broadphase(JobSystem* jobs)
+{
+    // twice the largest radius, anything touching is in a neighbouring cell
+    cellSize = 2.0f * maxRadius;
+    invCellSize = 1.0f / cellSize;
+
+    const uint32_t buckets = nextPowerOfTwo(std::max<size_t>(count, 64));
+    const size_t chunks = (count + chunkSize - 1) / chunkSize;
+    const size_t blocks = (buckets + prefixBlock - 1) / prefixBlock;
+    bucketMask = buckets - 1;
+    histograms.assign(chunks * buckets, 0);
+    blockOffsets.resize(blocks);
+    bucketStart.resize(buckets + 1);
+
+    // count per chunk, every chunk has histograms of its own so no atomics
+    forRange(jobs, 0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            uint32_t* histogram = &histograms[c * buckets];
+            for (size_t i = c * chunkSize, end = std::min(count, (c + 1) * chunkSize); i < end; i++)
+            {
+                uint32_t b = (hashRow(cellOf(posY[i], invCellSize), cellOf(posZ[i], invCellSize))
+                              + static_cast<uint32_t>(cellOf(posX[i], invCellSize))) & bucketMask;
+                bucketOf[i] = b;
+                histogram[b]++;
+            }
+        }
+    });
+
+    // exclusive prefix sum, bucket major and chunk minor, so every chunk
+    // writes its part of a bucket after the chunks before it. Blocks of
+    // buckets are summed in parallel, then offset by the blocks before them
+    forRange(jobs, 0, blocks, 1, [&](size_t first, size_t last) {
+        for (size_t block = first; block < last; block++)
+        {
+            uint32_t total = 0;
+            for (size_t b = block * prefixBlock, end = std::min<size_t>(buckets, (block + 1) * prefixBlock); b < end; b++)
+                for (size_t c = 0; c < chunks; c++)
+                    total += histograms[c * buckets + b];
+            blockOffsets[block] = total;
+        }
+    });
+
+    uint32_t running = 0;
+    for (uint32_t& offset : blockOffsets)
+    {
+        uint32_t total = offset;
+        offset = running;
+        running += total;
+    }
+
+    forRange(jobs, 0, blocks, 1, [&](size_t first, size_t last) {
+        for (size_t block = first; block < last; block++)
+        {
+            uint32_t slot = blockOffsets[block];
+            for (size_t b = block * prefixBlock, end = std::min<size_t>(buckets, (block + 1) * prefixBlock); b < end; b++)
+            {
+                bucketStart[b] = slot;
+                for (size_t c = 0; c < chunks; c++)
+                {
+                    uint32_t n = histograms[c * buckets + b];
+                    histograms[c * buckets + b] = slot;
+                    slot += n;
+                }
+            }
+        }
+    });
+    bucketStart[buckets] = static_cast<uint32_t>(count);
+
+    // scatter in body order, the histograms are now write cursors. The sorted
+    // copies are what the narrowphase reads, contiguous per bucket
+    forRange(jobs, 0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            uint32_t* cursor = &histograms[c * buckets];
+            for (size_t i = c * chunkSize, end = std::min(count, (c + 1) * chunkSize); i < end; i++)
+            {
+                uint32_t slot = cursor[bucketOf[i]]++;
+                sortedBody[slot] = static_cast<uint32_t>(i);
+                sortedX[slot] = posX[i];
+                sortedY[slot] = posY[i];
+                sortedZ[slot] = posZ[i];
+                sortedVX[slot] = velX[i];
+                sortedVY[slot] = velY[i];
+                sortedVZ[slot] = velZ[i];
+                sortedR[slot] = radius[i];
+                sortedM[slot] = mass[i];
+                sortedCellX[slot] = cellOf(posX[i], invCellSize);
+                sortedCellY[slot] = cellOf(posY[i], invCellSize);
+                sortedCellZ[slot] = cellOf(posZ[i], invCellSize);
+            }
+        }
+    });
+}
+
+void SpherePhysics::gather(JobSystem* jobs)
+{
+    forRange(jobs, 0, count, chunkSize, [&](size_t first, size_t last) {
+        for (size_t s = first; s < last; s++)
+        {
+            const uint32_t body = sortedBody[s];
+            sortedX[s] = posX[body];
+            sortedY[s] = posY[body];
+            sortedZ[s] = posZ[body];
+            sortedVX[s] = velX[body];
+            sortedVY[s] = velY[body];
+            sortedVZ[s] = velZ[body];
+        }
+    });
+}
+
+void SpherePhysics::collide(size_t first, size_t last, uint32_t& candidates, uint32_t& contacts)
+{
+    using namespace simd;
+
+    const Float4 zero = set1(0.0f);
+    static const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    const Float4 laneOffset = load(lanes);
+    const Float4 correctionv = set1(correction);
+    const Float4 bounce = set1(-(1.0f + restitution));
+    const Float4 tiny = set1(1e-12f);
+
+    // Cells along x share a row hash, so the three cells of a row are three
+    // consecutive buckets and one contiguous run of sorted slots. Bodies of
+    // one cell mostly follow each other in sorted order, the rows are only
+    // hashed again when the cell changes
+    uint32_t rows[9];
+    bool rowsOverlap = false;
+    int32_t cachedCell[3] = { 0, 0, 0 };
+    bool cached = false;
+    uint32_t ranges[27][2];
+    uint32_t buckets[27];
+
+    for (size_t s = first; s < last; s++)
+    {
+        // the cell the body was sorted by, later iterations may have moved it
+        const int32_t cx = sortedCellX[s];
+        const int32_t cy = sortedCellY[s];
+        const int32_t cz = sortedCellZ[s];
+        if (!cached || cx != cachedCell[0] || cy != cachedCell[1] || cz != cachedCell[2])
+        {
+            for (uint32_t r = 0; r < 9; r++)
+                rows[r] = hashRow(cy + static_cast<int32_t>(r % 3) - 1, cz + static_cast<int32_t>(r / 3) - 1)
+                          + static_cast<uint32_t>(cx);
+
+            // two rows whose buckets overlap would visit bodies twice
+            rowsOverlap = false;
+            for (uint32_t i = 0; i < 9; i++)
+                for (uint32_t j = i + 1; j < 9; j++)
+                {
+                    const uint32_t d = (rows[i] - rows[j]) & bucketMask;
+                    rowsOverlap |= d <= 2 || d >= bucketMask - 1;
+                }
+
+            cachedCell[0] = cx;
+            cachedCell[1] = cy;
+            cachedCell[2] = cz;
+            cached = true;
+        }
+
+        // Only cells closer than this radius plus the largest can hold a
+        // sphere touching it, that skips about 40% of the candidates
+        const float search = sortedR[s] + maxRadius;
+        const float reach2 = search * search;
+        float gaps[3][3];
+        const float position[3] = { sortedX[s], sortedY[s], sortedZ[s] };
+        const int32_t cell[3] = { cx, cy, cz };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float low = static_cast<float>(cell[axis]) * cellSize;
+            const float below = std::max(position[axis] - low, 0.0f);
+            const float above = std::max(low + cellSize - position[axis], 0.0f);
+            gaps[axis][0] = below * below;
+            gaps[axis][1] = 0.0f;
+            gaps[axis][2] = above * above;
+        }
+
+        uint32_t numRanges = 0;
+        if (!rowsOverlap)
+        {
+            for (uint32_t r = 0; r < 9; r++)
+            {
+                const float rowGap = gaps[1][r % 3] + gaps[2][r / 3];
+                if (rowGap >= reach2)
+                    continue;
+
+                const uint32_t low = (rows[r] - (rowGap + gaps[0][0] < reach2 ? 1u : 0u)) & bucketMask;
+                const uint32_t high = (rows[r] + (rowGap + gaps[0][2] < reach2 ? 1u : 0u)) & bucketMask;
+                if (low <= high)
+                {
+                    ranges[numRanges][0] = bucketStart[low];
+                    ranges[numRanges++][1] = bucketStart[high + 1];
+                }
+                else
+                {
+                    // the row wraps around the end of the table
+                    ranges[numRanges][0] = bucketStart[low];
+                    ranges[numRanges++][1] = bucketStart[bucketMask + 1];
+                    ranges[numRanges][0] = bucketStart[0];
+                    ranges[numRanges++][1] = bucketStart[high + 1];
+                }
+            }
+        }
+        else
+        {
+            // rare, bucket by bucket and every bucket once
+            uint32_t numBuckets = 0;
+            for (uint32_t n = 0; n < 27; n++)
+            {
+                if (gaps[0][n % 3] + gaps[1][n / 3 % 3] + gaps[2][n / 9] >= reach2)
+                    continue;
+                const uint32_t b = (rows[n / 3] + n % 3 - 1) & bucketMask;
+                if (std::find(buckets, buckets + numBuckets, b) != buckets + numBuckets)
+                    continue;
+                buckets[numBuckets++] = b;
+                ranges[numRanges][0] = bucketStart[b];
+                ranges[numRanges++][1] = bucketStart[b + 1];
+            }
+        }
+
+        const Float4 self = set1(static_cast<float>(s));
+        const Float4 xi = set1(sortedX[s]), yi = set1(sortedY[s]), zi = set1(sortedZ[s]);
+        const Float4 vxi = set1(sortedVX[s]), vyi = set1(sortedVY[s]), vzi = set1(sortedVZ[s]);
+        const Float4 ri = set1(sortedR[s]);
+        const Float4 mi = set1(sortedM[s]);
+        Float4 px = zero, py = zero, pz = zero;
+        Float4 vx = zero, vy = zero, vz = zero;
+
+        for (uint32_t n = 0; n < numRanges; n++)
+        {
+            const uint32_t begin = ranges[n][0];
+            const uint32_t end = ranges[n][1];
+            const Float4 endv = set1(static_cast<float>(end));
+
+            for (uint32_t k = begin; k < end; k += 4)
+            {
+                // slot numbers are exact in a float, lanes past the bucket
+                // and the body itself drop out
+                const Float4 slot = simd::add(set1(static_cast<float>(k)), laneOffset);
+                const Float4 valid = bitAnd(cmplt(slot, endv), bitOr(cmplt(slot, self), cmpgt(slot, self)));
+
+                const Float4 dx = sub(xi, load(&sortedX[k]));
+                const Float4 dy = sub(yi, load(&sortedY[k]));
+                const Float4 dz = sub(zi, load(&sortedZ[k]));
+                const Float4 d2 = madd(dx, dx, madd(dy, dy, mul(dz, dz)));
+                const Float4 reach = simd::add(ri, load(&sortedR[k]));
+                const Float4 touching = bitAnd(valid, cmplt(d2, mul(reach, reach)));
+
+                candidates += laneCount[movemask(valid)];
+                const uint32_t hits = movemask(touching);
+                if (!hits)
+                    continue;
+                contacts += laneCount[hits];
+
+                // normal from the other sphere to this one
+                const Float4 invD = rsqrt(max(d2, tiny));
+                const Float4 nx = mul(dx, invD), ny = mul(dy, invD), nz = mul(dz, invD);
+                const Float4 depth = sub(reach, mul(d2, invD));
+
+                // this body's part of the push and the impulse, the lighter
+                // sphere moves more, together they conserve momentum
+                const Float4 mj = load(&sortedM[k]);
+                const Float4 share = mul(mj, rcp(simd::add(mi, mj)));
+
+                const Float4 push = select(touching, mul(mul(depth, share), correctionv), zero);
+                px = madd(nx, push, px);
+                py = madd(ny, push, py);
+                pz = madd(nz, push, pz);
+
+                // only pairs closing in get an impulse, separating ones are left alone
+                const Float4 rvx = sub(vxi, load(&sortedVX[k]));
+                const Float4 rvy = sub(vyi, load(&sortedVY[k]));
+                const Float4 rvz = sub(vzi, load(&sortedVZ[k]));
+                const Float4 closing = madd(rvx, nx, madd(rvy, ny, mul(rvz, nz)));
+                const Float4 approaching = bitAnd(touching, cmplt(closing, zero));
+                const Float4 impulse = select(approaching, mul(mul(closing, bounce), share), zero);
+                vx = madd(nx, impulse, vx);
+                vy = madd(ny, impulse, vy);
+                vz = madd(nz, impulse, vz);
+            }
+        }
+
+        const uint32_t body = sortedBody[s];
+        posX[body] = sortedX[s] + horizontalSum(px);
+        posY[body] = sortedY[s] + horizontalSum(py);
+        posZ[body] = sortedZ[s] + horizontalSum(pz);
+        velX[body] = sortedVX[s] + horizontalSum(vx);
+        velY[body] = sortedVY[s] + horizontalSum(vy);
+        velZ[body] = sortedVZ[s] + horizontalSum(vz);
+    }
+}
+
+void SpherePhysics::step(float dt, JobSystem* jobs)
+{
+    dt = std::min(dt, maxStep);
+    if (count == 0 || dt <= 0.0f)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    // whole chunks per job, every batch of four stays in one
+    const size_t end = roundUp4(count);
+    forRange(jobs, 0, (end + chunkSize - 1) / chunkSize, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+            integrate(c * chunkSize, std::min(end, (c + 1) * chunkSize), dt);
+    });
+    stats.integrateMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    broadphase(jobs);
+    stats.broadphaseMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    const size_t batches = (count + contactBatch - 1) / contactBatch;
+    stats.candidates = 0;
+    stats.contacts = 0;
+    for (uint32_t iteration = 0; iteration < iterations; iteration++)
+    {
+        // the bodies moved, the buckets stay
+        if (iteration > 0)
+            gather(jobs);
+
+        batchCandidates.assign(batches, 0);
+        batchContacts.assign(batches, 0);
+        forRange(jobs, 0, batches, 1, [&](size_t first, size_t last) {
+            for (size_t b = first; b < last; b++)
+                collide(b * contactBatch, std::min(count, (b + 1) * contactBatch), batchCandidates[b], batchContacts[b]);
+        });
+
+        for (size_t b = 0; b < batches; b++)
+        {
+            stats.candidates += batchCandidates[b];
+            stats.contacts += batchContacts[b];
+        }
+    }
+    stats.narrowphaseMs = millisecondsSince(start);
+    stats.bodies = static_cast<uint32_t>(count);
+
+    totalSteps++;
+    totalMs += stats.integrateMs + stats.broadphaseMs + stats.narrowphaseMs;
+    totalBroadphaseMs += stats.broadphaseMs;
+    totalNarrowphaseMs += stats.narrowphaseMs;
+    totalContacts += stats.contacts;
+}
+
+uint32_t SpherePhysics::advance(float elapsed, JobSystem* jobs)
+{
+    unstepped += std::max(elapsed, 0.0f);
+    uint32_t steps = 0;
+    while (unstepped >= fixedStep && steps < maxSubsteps)
+    {
+        step(fixedStep, jobs);
+        unstepped -= fixedStep;
+        steps++;
+    }
+
+    if (steps == maxSubsteps)
+        unstepped = std::fmod(unstepped, fixedStep);
+    return steps;
+}
+
+void SpherePhysics::dumpEvery(std::chrono::steady_clock::duration interval, FILE* out)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastDump < interval)
+        return;
+
+    lastDump = now;
+    if (totalSteps == 0)
+        return;
+
+    const double steps = static_cast<double>(totalSteps);
+    fprintf(out, "physics: %zu spheres, %.2f ms per step (broadphase %.2f, narrowphase %.2f), %.0f contacts\n",
+            count, totalMs / steps, totalBroadphaseMs / steps, totalNarrowphaseMs / steps,
+            static_cast<double>(totalContacts) / steps);
+
+    totalSteps = 0;
+    totalMs = 0.0;
+    totalBroadphaseMs = 0.0;
+    totalNarrowphaseMs = 0.0;
+    totalContacts = 0;
+}
+
+void SpherePhysics::writeInstances(size_t first, size_t last, void* out) const
+{
+    InstanceData* instances = static_cast<InstanceData*>(out);
+
+    for (size_t i = first; i < last; i++)
+    {
+        float s = radius[i];
+
+        // translate * scale, column major
+        InstanceData& d = instances[i];
+        d.world[0] = s;    d.world[1] = 0.0f; d.world[2] = 0.0f;  d.world[3] = 0.0f;
+        d.world[4] = 0.0f; d.world[5] = s;    d.world[6] = 0.0f;  d.world[7] = 0.0f;
+        d.world[8] = 0.0f; d.world[9] = 0.0f; d.world[10] = s;    d.world[11] = 0.0f;
+        d.world[12] = posX[i];
+        d.world[13] = posY[i];
+        d.world[14] = posZ[i];
+        d.world[15] = 1.0f;
+        d.color[0] = colorR[i];
+        d.color[1] = colorG[i];
+        d.color[2] = colorB[i];
+        d.color[3] = 1.0f;
+    }
+}
+
+void SpherePhysics::upload(JobSystem* jobs)
+{
+    if (!instanceBuffer)
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(InstanceData)), nullptr, GL_STREAM_DRAW);
+        MemoryTracker::instance().trackBuffer(instanceBuffer, MemoryCategory::InstanceBuffer, capacity * sizeof(InstanceData));
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    }
+
+    uploaded = count;
+    if (count == 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    GLsizeiptr bytes = static_cast<GLsizeiptr>(count * sizeof(InstanceData));
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (mapped)
+    {
+        forRange(jobs, 0, count, 2048, [&](size_t first, size_t last) { writeInstances(first, last, mapped); });
+
+        if (!glUnmapBuffer(GL_ARRAY_BUFFER))
+            uploaded = 0;
+    }
+    else
+    {
+        if (!staging)
+            staging.reset(new InstanceData[capacity]);
+
+        InstanceData* out = staging.get();
+        forRange(jobs, 0, count, 2048, [&](size_t first, size_t last) { writeInstances(first, last, out); });
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, out);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SpherePhysics::draw(Model& model)
+{
+    if (uploaded == 0 || !instanceBuffer)
+        return;
+
+    if (attachedVao != model.getVao())
+    {
+        model.setInstanceBuffer(instanceBuffer);
+        attachedVao = model.getVao();
+    }
+
+    glBindVertexArray(model.getVao());
+    glDrawElementsInstanced(GL_TRIANGLES, model.getNumIndices(), model.getIndexType(), nullptr,
+                            static_cast<GLsizei>(uploaded));
+}
@@ -0,0 +1,194 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_SPHEREPHYSICS_H
+#define PI_GAME_SPHEREPHYSICS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <cstdio>
+#include <vector>
+#include <GLES3/gl3.h>
+#include <glm/vec3.hpp>
+
+class JobSystem;
+class Model;
+struct InstanceData;
+
+// Colliding spheres, the game world's dynamic objects. Bodies are kept as
+// structure of arrays in the order they were added, step() integrates them
+// four at a time and bounces them off the world box, then:
+//  - broadphase: every body is hashed by the grid cell of its center, cells
+//    are two of the largest radius wide, so touching spheres are at most one
+//    cell apart. Cells along x share a row hash and land in consecutive
+//    buckets. A counting sort over the buckets, per chunk histograms in
+//    parallel, gathers the bodies into sorted arrays where the three cells
+//    of a row are one contiguous run.
+//  - narrowphase: per body the rows around its cell within reach are tested
+//    four candidates at a time through Simd.h. Each body only writes its own
+//    position and velocity, computed from the sorted copies, so the bodies
+//    run in parallel without locks and the result does not depend on the
+//    order. Overlap is pushed apart and approaching contacts get an impulse,
+//    both split by mass. More iterations settle piles better.
+// The positions go straight into an instance buffer like ParticleSystem's,
+// draw it with an IcosoSphere model of radius 1 and a SHADER_INSTANCING variant.
+class SpherePhysics {
+public:
+    struct Stats
+    {
+        uint32_t bodies = 0;
+        uint32_t candidates = 0;        // pairs the narrowphase tested, both directions, all iterations
+        uint32_t contacts = 0;          // of those, overlapping
+        double integrateMs = 0.0;
+        double broadphaseMs = 0.0;
+        double narrowphaseMs = 0.0;
+    };
+
+    explicit SpherePhysics(size_t maxBodies = 16384);
+    ~SpherePhysics();
+
+    SpherePhysics(const SpherePhysics&) = delete;
+    SpherePhysics& operator=(const SpherePhysics&) = delete;
+
+    // returns the body index, throws std::runtime_error when full
+    uint32_t add(const glm::vec3& position, const glm::vec3& velocity, float sphereRadius, const glm::vec3& color);
+
+    // the box every sphere stays inside
+    void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        worldMin = boundsMin;
+        worldMax = boundsMax;
+    }
+
+    void setGravity(const glm::vec3& g)
+    {
+        gravity = g;
+    }
+
+    // 0 stops approaching spheres dead, 1 bounces them back at full speed
+    void setRestitution(float e)
+    {
+        restitution = e;
+    }
+
+    // narrowphase passes per step, every pass lets contacts push one sphere
+    // further through a pile, so stacks sink into each other less
+    void setIterations(uint32_t passes)
+    {
+        iterations = std::max(passes, 1u);
+    }
+
+    // one step of at most maxStep seconds, in parallel when a job system is given
+    void step(float dt, JobSystem* jobs = nullptr);
+
+    // Adds elapsed seconds and runs as many steps of the fixed length as
+    // that covers, the remainder carries over to the next call. At most
+    // maxSubsteps per call, a long hitch is dropped instead of catching up.
+    // Returns the number of steps run.
+    uint32_t advance(float elapsed, JobSystem* jobs = nullptr);
+
+    void setFixedStep(float seconds)
+    {
+        fixedStep = std::min(std::max(seconds, 1e-4f), maxStep);
+    }
+
+    // GL thread only, writes the instance buffer for every body
+    void upload(JobSystem* jobs = nullptr);
+
+    // GL thread only, one instanced draw of model per body
+    void draw(Model& model);
+
+    glm::vec3 getPosition(uint32_t body) const
+    {
+        return glm::vec3(posX[body], posY[body], posZ[body]);
+    }
+
+    float getRadius(uint32_t body) const
+    {
+        return radius[body];
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    // of the last step()
+    const Stats& getStats() const
+    {
+        return stats;
+    }
+
+    void dumpEvery(std::chrono::steady_clock::duration interval, FILE* out = stdout);
+
+private:
+    static constexpr float maxStep = 1.0f / 30.0f;      // longer steps let small spheres pass through
+    static constexpr float correction = 0.8f;           // share of the overlap removed per step
+    static constexpr size_t chunkSize = 2048;           // integration and counting sort granularity
+    static constexpr size_t contactBatch = 256;         // bodies per narrowphase job
+    static constexpr uint32_t maxSubsteps = 4;
+
+    void integrate(size_t first, size_t last, float dt);
+    uint32_t hashRow(int32_t y, int32_t z) const;
+    void broadphase(JobSystem* jobs);
+    void gather(JobSystem* jobs);
+    void collide(size_t first, size_t last, uint32_t& candidates, uint32_t& contacts);
+    void writeInstances(size_t first, size_t last, void* out) const;
+
+    size_t capacity;
+    size_t count = 0;
+    glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+    glm::vec3 worldMin = glm::vec3(-10.0f);
+    glm::vec3 worldMax = glm::vec3(10.0f);
+    float restitution = 0.5f;
+    uint32_t iterations = 2;
+    float fixedStep = 1.0f / 120.0f;
+    float unstepped = 0.0f;             // of what advance() was given
+    float maxRadius = 0.0f;
+
+    // bodies, padded to a multiple of 4 with zero radius
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> radius, mass;
+    std::vector<float> colorR, colorG, colorB;
+
+    // broadphase, rebuilt every step
+    float cellSize = 1.0f;
+    float invCellSize = 1.0f;
+    uint32_t bucketMask = 0;
+    std::vector<uint32_t> bucketOf;         // per body
+    std::vector<uint32_t> histograms;       // per chunk, per bucket, then the chunk's write cursors
+    std::vector<uint32_t> blockOffsets;     // prefix sum over blocks of buckets
+    std::vector<uint32_t> bucketStart;      // first sorted slot per bucket, one past the end at the back
+    std::vector<uint32_t> sortedBody;       // sorted slot -> body
+    std::vector<float> sortedX, sortedY, sortedZ;
+    std::vector<float> sortedVX, sortedVY, sortedVZ;
+    std::vector<float> sortedR, sortedM;
+    std::vector<int32_t> sortedCellX, sortedCellY, sortedCellZ;
+    std::vector<uint32_t> batchCandidates, batchContacts;
+
+    GLuint instanceBuffer = 0;
+    GLuint attachedVao = 0;
+    size_t uploaded = 0;
+    std::unique_ptr<InstanceData[]> staging;    // capacity instances, made the first time mapping fails
+
+    Stats stats;
+    uint64_t totalSteps = 0;
+    double totalMs = 0.0;
+    double totalBroadphaseMs = 0.0;
+    double totalNarrowphaseMs = 0.0;
+    uint64_t totalContacts = 0;
+    std::chrono::steady_clock::time_point lastDump = std::chrono::steady_clock::now();
+};
+
+
+#endif //PI_GAME_SPHEREPHYSICS_H
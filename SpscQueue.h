@@ -0,0 +1,66 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_SPSCQUEUE_H
+#define PI_GAME_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded single producer / single consumer ring buffer.
+// Each side owns one index and only reads the other one, so a push or a pop
+// is a relaxed load, an acquire load and a release store, no locks and no
+// read-modify-write. The indices run freely and wrap through the mask, which
+// is why the capacity has to be a power of two.
+template<typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer side, false when the queue is full
+    bool push(const T& value) noexcept
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false when the queue is empty
+    bool pop(T& value) noexcept
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // either side, only a snapshot
+    bool empty() const noexcept
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t mask = Capacity - 1;
+
+    T slots[Capacity];
+
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head { 0 };
+    alignas(64) std::atomic<size_t> tail { 0 };
+};
+
+
+#endif //PI_GAME_SPSCQUEUE_H
@@ -0,0 +1,227 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <glm/glm.hpp>
+#include "StaticBatcher.h"
+#include "Trace.h"
+
+StaticBatcher::StaticBatcher(bool packedVertices)
+    : packNormals(packedVertices)
+{
+}
+
+StaticBatcher::~StaticBatcher()
+{
+    for (Batch& batch : batches)
+    {
+        if (batch.merged)
+            batch.merged->deleteBufferObjects();
+    }
+}
+
+uint32_t StaticBatcher::add(Model& model, const glm::mat4& world, const BatchMaterial& material)
+{
+    uint32_t index;
+    if (!freeProps.empty())
+    {
+        index = freeProps.back();
+        freeProps.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(props.size());
+        props.push_back({});
+    }
+
+    const uint32_t vertices = static_cast<uint32_t>(model.getNumVerts());
+    const uint32_t batchIndex = findBatch(material, vertices);
+    Batch& batch = batches[batchIndex];
+    batch.props.push_back(index);
+    batch.vertices += vertices;
+    batch.dirty = true;
+
+    props[index] = { &model, world, batchIndex, true };
+    return index;
+}
+
+void StaticBatcher::setTransform(uint32_t prop, const glm::mat4& world)
+{
+    Prop& p = getProp(prop);
+    p.world = world;
+    batches[p.batch].dirty = true;
+}
+
+void StaticBatcher::remove(uint32_t prop)
+{
+    Prop& p = getProp(prop);
+    Batch& batch = batches[p.batch];
+    batch.props.erase(std::find(batch.props.begin(), batch.props.end(), prop));
+    batch.vertices -= static_cast<uint32_t>(p.model->getNumVerts());
+    batch.dirty = true;
+
+    p.alive = false;
+    freeProps.push_back(prop);
+}
+
+size_t StaticBatcher::update()
+{
+    size_t rebuilt = 0;
+    for (Batch& batch : batches)
+    {
+        if (!batch.dirty)
+            continue;
+
+        TRACE_SCOPE("rebuildBatch");
+        rebuild(batch);
+        batch.dirty = false;
+        rebuilt++;
+    }
+
+    if (rebuilt)
+        sortDrawOrder();
+    return rebuilt;
+}
+
+void StaticBatcher::record(CommandBuffer& commands) const
+{
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    for (uint32_t index : drawOrder)
+    {
+        const Batch& batch = batches[index];
+        Model& merged = *batch.merged;
+
+        commands.setProgram(batch.material.program);
+        if (batch.material.modelLocation >= 0)
+            commands.setMatrix(batch.material.modelLocation, identity);
+        if (batch.material.texture)
+            commands.setTexture(0, batch.material.texture);
+        commands.setVertexArray(merged.getVao());
+        commands.drawIndexed(0, static_cast<uint32_t>(merged.getNumIndices()),
+                             merged.getIndexType() == GL_UNSIGNED_SHORT ? IndexType::UInt16 : IndexType::UInt32);
+    }
+}
+
+uint32_t StaticBatcher::findBatch(const BatchMaterial& material, uint32_t vertices)
+{
+    // first fit among the open batches of the material
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        const Batch& batch = batches[i];
+        if (!batch.props.empty() && batch.material == material && batch.vertices + vertices <= maxBatchVertices)
+            return static_cast<uint32_t>(i);
+    }
+
+    // then a batch that was emptied, whatever it was used for before
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        if (batches[i].props.empty())
+        {
+            batches[i].material = material;
+            return static_cast<uint32_t>(i);
+        }
+    }
+
+    batches.emplace_back();
+    batches.back().material = material;
+    return static_cast<uint32_t>(batches.size() - 1);
+}
+
+StaticBatcher::Prop& StaticBatcher::getProp(uint32_t prop)
+{
+    if (prop >= props.size() || !props[prop].alive)
+        throw std::runtime_error("Invalid static prop " + std::to_string(prop));
+    return props[prop];
+}
+
+void StaticBatcher::rebuild(Batch& batch)
+{
+    if (batch.merged)
+    {
+        batch.merged->deleteBufferObjects();
+        batch.merged.reset();
+    }
+    if (batch.props.empty())
+        return;
+
+    int numVerts = 0;
+    int numIndices = 0;
+    for (uint32_t index : batch.props)
+    {
+        numVerts += props[index].model->getNumVerts();
+        numIndices += props[index].model->getNumIndices();
+    }
+
+    std::unique_ptr<Model> merged(new Model(numVerts, numIndices));
+    VertData* outVerts = merged->getDataPtr();
+    GLuint* outIndices = merged->getIndPtr();
+    GLuint base = 0;
+
+    for (uint32_t index : batch.props)
+    {
+        const Prop& prop = props[index];
+        Model& model = *prop.model;
+        const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(prop.world)));
+
+        const VertData* verts = model.getDataPtr();
+        const int count = model.getNumVerts();
+        for (int i = 0; i < count; i++)
+        {
+            VertData v = verts[i];
+            glm::vec4 p = prop.world * glm::vec4(v.position[0], v.position[1], v.position[2], 1.0f);
+            glm::vec3 n = normalMatrix * glm::vec3(v.normal[0], v.normal[1], v.normal[2]);
+            float len = glm::length(n);
+            if (len > 0.0f)
+                n = n / len;
+
+            v.position[0] = p.x;
+            v.position[1] = p.y;
+            v.position[2] = p.z;
+            v.normal[0] = n.x;
+            v.normal[1] = n.y;
+            v.normal[2] = n.z;
+            *outVerts++ = v;
+        }
+
+        const int indexCount = model.getNumIndices();
+        if (model.getIndexType() == GL_UNSIGNED_SHORT)
+        {
+            const GLushort* in = model.getShortIndPtr();
+            for (int i = 0; i < indexCount; i++)
+                *outIndices++ = base + in[i];
+        }
+        else
+        {
+            const GLuint* in = model.getIndPtr();
+            for (int i = 0; i < indexCount; i++)
+                *outIndices++ = base + in[i];
+        }
+        base += static_cast<GLuint>(count);
+    }
+
+    merged->shrinkIndices();
+    merged->genBufferObjects(packNormals);
+    batch.merged = std::move(merged);
+}
+
+void StaticBatcher::sortDrawOrder()
+{
+    drawOrder.clear();
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        if (batches[i].merged)
+            drawOrder.push_back(static_cast<uint32_t>(i));
+    }
+
+    std::sort(drawOrder.begin(), drawOrder.end(), [this](uint32_t a, uint32_t b) {
+        const BatchMaterial& ma = batches[a].material;
+        const BatchMaterial& mb = batches[b].material;
+        if (ma.program != mb.program)
+            return ma.program < mb.program;
+        return ma.texture < mb.texture;
+    });
+}
@@ -0,0 +1,101 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_STATICBATCHER_H
+#define PI_GAME_STATICBATCHER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include "CommandBuffer.h"
+#include "Model.h"
+
+// What a batch is drawn with. Props only end up in the same batch when all
+// of it matches. modelLocation >= 0 gets an identity matrix before the draw,
+// batched vertices are already in world space.
+struct BatchMaterial
+{
+    uint32_t program = 0;
+    uint32_t texture = 0;       // unit 0, 0 leaves whatever is bound
+    int32_t modelLocation = -1;
+
+    bool operator==(const BatchMaterial& other) const
+    {
+        return program == other.program && texture == other.texture && modelLocation == other.modelLocation;
+    }
+};
+
+// Merges static props into a few large Models, one draw each. Props are
+// pre-transformed into world space and packed into batches per material,
+// a batch is closed at 65536 vertices so its indices stay 16 bit. A prop
+// keeps its batch for its whole life, so adding, moving or removing one
+// rebuilds only that batch on the next update(). A single prop over the
+// limit gets a batch of its own with 32 bit indices.
+// The source Models are read on every rebuild of their batch and have to
+// outlive the batcher. GL thread only, except record(), which touches no GL
+// and may run in a job as long as nothing changes the batcher meanwhile.
+class StaticBatcher {
+public:
+    static constexpr uint32_t maxBatchVertices = 65536;
+
+    // packNormals as in Model::genBufferObjects, pick the matching shader variant
+    explicit StaticBatcher(bool packedVertices = true);
+    ~StaticBatcher();
+
+    StaticBatcher(const StaticBatcher&) = delete;
+    StaticBatcher& operator=(const StaticBatcher&) = delete;
+
+    uint32_t add(Model& model, const glm::mat4& world, const BatchMaterial& material);
+    void setTransform(uint32_t prop, const glm::mat4& world);
+    void remove(uint32_t prop);
+
+    // Rebuilds the batches that changed, returns how many
+    size_t update();
+
+    // one draw per batch, grouped by material
+    void record(CommandBuffer& commands) const;
+
+    size_t getBatchCount() const
+    {
+        return drawOrder.size();
+    }
+
+    size_t getPropCount() const
+    {
+        return props.size() - freeProps.size();
+    }
+
+private:
+    struct Prop
+    {
+        Model* model;
+        glm::mat4 world;
+        uint32_t batch;
+        bool alive;
+    };
+
+    struct Batch
+    {
+        BatchMaterial material;
+        std::vector<uint32_t> props;
+        uint32_t vertices = 0;
+        bool dirty = false;
+        std::unique_ptr<Model> merged;
+    };
+
+    uint32_t findBatch(const BatchMaterial& material, uint32_t vertices);
+    Prop& getProp(uint32_t prop);
+    void rebuild(Batch& batch);
+    void sortDrawOrder();
+
+    bool packNormals;
+    std::vector<Prop> props;
+    std::vector<uint32_t> freeProps;
+    std::vector<Batch> batches;
+    std::vector<uint32_t> drawOrder;    // batches with geometry, by material
+};
+
+
+#endif //PI_GAME_STATICBATCHER_H
@@ -0,0 +1,93 @@
+//
+// Created by APel on 19/10/26.
+//
+
+// pigame_tablecheck: the baked IcosahedronTables against the runtime sphere
+// generator. Builds every baked level with IcosoSphere::generate() and
+// compares the vertex count and every position, normal and texture
+// coordinate with the table, the colors are the same constant on both sides.
+//
+//   pigame_tablecheck [--epsilon E]
+//
+// Prints the largest difference per level and fails when one is above
+// epsilon, rerun it whenever the generator or the tables change.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "IcosahedronTables.h"
+#include "ShapeGenerator.h"
+
+namespace {
+    void usage()
+    {
+        fprintf(stderr, "usage: pigame_tablecheck [--epsilon E]\n");
+    }
+
+    float maxDifference(const GLfloat* a, const GLfloat* b, size_t n)
+    {
+        float worst = 0.0f;
+        for (size_t i = 0; i < n; i++)
+            worst = std::max(worst, std::fabs(a[i] - b[i]));
+        return worst;
+    }
+
+    bool checkLevel(int level, float epsilon)
+    {
+        size_t bakedCount = 0;
+        const VertData* baked = IcosahedronTables::vertices(level, bakedCount);
+        if (!baked)
+        {
+            printf("level %d: no table\n", level);
+            return false;
+        }
+
+        IcosoSphere sphere(1.0f, level);
+        Model model = sphere.generate();
+        const VertData* generated = model.getDataPtr();
+        size_t generatedCount = static_cast<size_t>(model.getNumVerts());
+        if (generatedCount != bakedCount)
+        {
+            printf("level %d: %zu generated vertices, %zu baked\n", level, generatedCount, bakedCount);
+            return false;
+        }
+
+        float position = 0.0f, normal = 0.0f, texCoord = 0.0f;
+        for (size_t i = 0; i < bakedCount; i++)
+        {
+            position = std::max(position, maxDifference(generated[i].position, baked[i].position, 3));
+            normal = std::max(normal, maxDifference(generated[i].normal, baked[i].normal, 3));
+            texCoord = std::max(texCoord, maxDifference(generated[i].texCoord, baked[i].texCoord, 2));
+        }
+
+        bool match = position <= epsilon && normal <= epsilon && texCoord <= epsilon;
+        printf("level %d: %6zu vertices, max difference position %g, normal %g, uv %g %s\n", level, bakedCount,
+               static_cast<double>(position), static_cast<double>(normal), static_cast<double>(texCoord),
+               match ? "ok" : "MISMATCH");
+        return match;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    float epsilon = 1e-5f;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--epsilon" && i + 1 < argc)
+            epsilon = strtof(argv[++i], nullptr);
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool match = true;
+    for (int level = 0; level <= IcosahedronTables::maxLevel; level++)
+        match = checkLevel(level, epsilon) && match;
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,207 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SpscQueue.h"
+#include "Trace.h"
+
+namespace {
+    constexpr size_t eventsPerThread = 16384;
+    constexpr uint64_t instantDuration = UINT64_MAX;
+    constexpr auto flushInterval = std::chrono::milliseconds(50);
+
+    struct TraceEvent
+    {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+    };
+
+    struct ThreadBuffer
+    {
+        SpscQueue<TraceEvent, eventsPerThread> events;
+        uint32_t tid = 0;
+        std::string name;
+        bool nameWritten = false;
+    };
+
+    // Buffers are never freed, a thread that exits leaves its buffer to be
+    // drained and reused by nobody. There are only a handful of threads.
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    thread_local ThreadBuffer* localBuffer = nullptr;
+
+    // setThreadName() before the thread has a buffer, copied in when it gets one
+    thread_local char localName[32] = {};
+
+    std::mutex flushMutex;
+    std::condition_variable flushWake;
+    std::thread flusher;
+    bool stopping = false;
+
+    FILE* file = nullptr;
+    bool firstEvent = true;
+    std::atomic<uint64_t> dropped { 0 };
+
+    ThreadBuffer& getBuffer()
+    {
+        if (!localBuffer)
+        {
+            std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+            buffer->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+            buffer->name = localName;
+            localBuffer = buffer.get();
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+            buffers.push_back(std::move(buffer));
+        }
+        return *localBuffer;
+    }
+
+    void writeSeparator()
+    {
+        fputs(firstEvent ? "\n" : ",\n", file);
+        firstEvent = false;
+    }
+
+    // flusher thread, or the thread calling start()/stop() while the flusher is down
+    void drain(bool write)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& buffer : buffers)
+        {
+            TraceEvent e;
+            while (buffer->events.pop(e))
+            {
+                if (!write)
+                    continue;
+
+                // name the track once it has something on it, threads that
+                // are long gone do not show up as empty tracks
+                if (!buffer->nameWritten && !buffer->name.empty())
+                {
+                    writeSeparator();
+                    fprintf(file, R"({"name":"thread_name","ph":"M","pid":1,"tid":%u,"args":{"name":"%s"}})",
+                            buffer->tid, buffer->name.c_str());
+                    buffer->nameWritten = true;
+                }
+
+                writeSeparator();
+                const double ts = static_cast<double>(e.startNs) * 1e-3;
+                if (e.durationNs == instantDuration)
+                    fprintf(file, R"({"name":"%s","ph":"i","s":"t","ts":%.3f,"pid":1,"tid":%u})",
+                            e.name, ts, buffer->tid);
+                else
+                    fprintf(file, R"({"name":"%s","ph":"X","ts":%.3f,"dur":%.3f,"pid":1,"tid":%u})",
+                            e.name, ts, static_cast<double>(e.durationNs) * 1e-3, buffer->tid);
+            }
+        }
+    }
+
+    void flusherMain()
+    {
+        TRACE_THREAD_NAME("trace flush");
+
+        std::unique_lock<std::mutex> lock(flushMutex);
+        while (!stopping)
+        {
+            flushWake.wait_for(lock, flushInterval);
+            drain(true);
+        }
+    }
+}
+
+std::atomic<bool> Trace::enabled { false };
+
+bool Trace::start(const std::string& path)
+{
+    if (file)
+        return false;
+
+    file = fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+
+    // leftovers from an earlier session would land in the wrong file
+    drain(false);
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& buffer : buffers)
+            buffer->nameWritten = false;
+    }
+
+    fputs(R"({"displayTimeUnit":"ms","traceEvents":[)", file);
+    firstEvent = true;
+    dropped.store(0, std::memory_order_relaxed);
+
+    stopping = false;
+    flusher = std::thread(flusherMain);
+    enabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void Trace::stop()
+{
+    if (!file)
+        return;
+
+    enabled.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        stopping = true;
+    }
+    flushWake.notify_one();
+    flusher.join();
+
+    // scopes that were open when tracing went off still land here
+    drain(true);
+    fputs("\n]}\n", file);
+    fclose(file);
+    file = nullptr;
+}
+
+void Trace::setThreadName(const std::string& name)
+{
+    snprintf(localName, sizeof(localName), "%s", name.c_str());
+    if (!localBuffer)
+        return;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    localBuffer->name = localName;
+    localBuffer->nameWritten = false;
+}
+
+uint64_t Trace::now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Trace::record(const char* name, uint64_t startNs, uint64_t durationNs)
+{
+    // a scope that outlived stop(), not worth a buffer on a thread without one
+    if (!localBuffer && !isEnabled())
+        return;
+
+    if (!getBuffer().events.push({ name, startNs, durationNs }))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Trace::instant(const char* name)
+{
+    record(name, now(), instantDuration);
+}
+
+uint64_t Trace::getDropped()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,88 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_TRACE_H
+#define PI_GAME_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped timing events written as Chrome Trace Event JSON, which Perfetto and
+// chrome://tracing open directly.
+// Every thread records into its own lock-free ring, made by its first event
+// while tracing is on, so a thread that is never traced costs no memory. A
+// background thread drains the rings into the file a few times per second.
+// While tracing is off a TRACE_SCOPE costs one relaxed atomic load, building
+// without PIGAME_TRACING removes the macros altogether.
+// Event names are not escaped and not copied, pass string literals.
+namespace Trace {
+    extern std::atomic<bool> enabled;
+
+    inline bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // starts writing to path, false if tracing is already on or the file
+    // can not be created
+    bool start(const std::string& path);
+
+    // flushes what is left and closes the file
+    void stop();
+
+    // shows up as the track name, call once from the thread itself. Only
+    // remembered until the thread records something, cut at 31 characters
+    void setThreadName(const std::string& name);
+
+    // steady clock (CLOCK_MONOTONIC) in nanoseconds
+    uint64_t now();
+
+    void record(const char* name, uint64_t startNs, uint64_t durationNs);
+    void instant(const char* name);
+
+    // events lost because a thread outran the flusher
+    uint64_t getDropped();
+}
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* eventName)
+    {
+        if (Trace::isEnabled())
+        {
+            name = eventName;
+            start = Trace::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (name)
+            Trace::record(name, start, Trace::now() - start);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name = nullptr;
+    uint64_t start = 0;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#ifdef PIGAME_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_INSTANT(name) do { if (Trace::isEnabled()) Trace::instant(name); } while (0)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) do { } while (0)
+#define TRACE_INSTANT(name) do { } while (0)
+#define TRACE_THREAD_NAME(name) do { } while (0)
+#endif
+
+
+#endif //PI_GAME_TRACE_H
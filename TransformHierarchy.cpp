@@ -0,0 +1,63 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include "TransformHierarchy.h"
+
+uint32_t TransformHierarchy::create(const glm::mat4& localMatrix, uint32_t parentIndex)
+{
+    uint32_t index = static_cast<uint32_t>(local.size());
+    if (parentIndex != noParent && parentIndex >= index)
+        throw std::runtime_error("Transform parent has to be created before its children");
+
+    local.push_back(localMatrix);
+    world.push_back(localMatrix);
+    parent.push_back(parentIndex);
+    dirty.push_back(1);
+
+    firstDirty = std::min(firstDirty, index);
+    return index;
+}
+
+void TransformHierarchy::setLocal(uint32_t index, const glm::mat4& localMatrix)
+{
+    local[index] = localMatrix;
+    dirty[index] = 1;
+    firstDirty = std::min(firstDirty, index);
+}
+
+size_t TransformHierarchy::update()
+{
+    changedBegin = changedEnd = 0;
+    if (firstDirty == noParent)
+        return 0;
+
+    const uint32_t count = static_cast<uint32_t>(local.size());
+    size_t updated = 0;
+    uint32_t lastChanged = firstDirty;
+
+    // parents always come first, so a single forward sweep sees every parent's
+    // final state and its flag before any of its children
+    for (uint32_t i = firstDirty; i < count; i++)
+    {
+        uint32_t p = parent[i];
+        if (p != noParent && dirty[p])
+            dirty[i] = 1;
+
+        if (!dirty[i])
+            continue;
+
+        world[i] = (p == noParent) ? local[i] : world[p] * local[i];
+        lastChanged = i;
+        updated++;
+    }
+
+    std::fill(dirty.begin() + firstDirty, dirty.begin() + lastChanged + 1, 0);
+
+    changedBegin = firstDirty;
+    changedEnd = lastChanged + 1;
+    firstDirty = noParent;
+    return updated;
+}
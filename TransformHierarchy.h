@@ -0,0 +1,78 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_TRANSFORMHIERARCHY_H
+#define PI_GAME_TRANSFORMHIERARCHY_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+// Scene transforms stored as parallel arrays (local, world, parent, dirty).
+// A node can only be created under an already existing parent, so the arrays
+// are always sorted parent-before-child and one forward pass is enough to
+// propagate changes. Only nodes that were touched, and their descendants,
+// get their world matrix recomputed; static scenery costs a byte compare.
+class TransformHierarchy {
+public:
+    static constexpr uint32_t noParent = UINT32_MAX;
+
+    uint32_t create(const glm::mat4& localMatrix, uint32_t parentIndex = noParent);
+    void setLocal(uint32_t index, const glm::mat4& localMatrix);
+
+    // Recomputes world matrices of dirty subtrees, returns how many changed
+    size_t update();
+
+    const glm::mat4& getLocal(uint32_t index) const
+    {
+        return local[index];
+    }
+
+    const glm::mat4& getWorld(uint32_t index) const
+    {
+        return world[index];
+    }
+
+    uint32_t getParent(uint32_t index) const
+    {
+        return parent[index];
+    }
+
+    size_t size() const
+    {
+        return local.size();
+    }
+
+    // World matrices are tightly packed column major floats, in node order,
+    // so they can go straight into an instance buffer
+    const float* getWorldData() const
+    {
+        return world.empty() ? nullptr : &world[0][0][0];
+    }
+
+    // [begin, end) range of nodes whose world matrix changed in the last
+    // update(), empty when nothing moved. Use it for a partial buffer upload.
+    uint32_t getChangedBegin() const
+    {
+        return changedBegin;
+    }
+
+    uint32_t getChangedEnd() const
+    {
+        return changedEnd;
+    }
+
+private:
+    std::vector<glm::mat4> local;
+    std::vector<glm::mat4> world;
+    std::vector<uint32_t> parent;
+    std::vector<uint8_t> dirty;
+
+    uint32_t firstDirty = noParent;
+    uint32_t changedBegin = 0;
+    uint32_t changedEnd = 0;
+};
+
+
+#endif //PI_GAME_TRANSFORMHIERARCHY_H
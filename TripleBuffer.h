@@ -0,0 +1,64 @@
+//
+// Created by APel on 19/10/26.
+//
+
+#ifndef PI_GAME_TRIPLEBUFFER_H
+#define PI_GAME_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Single producer / single consumer triple buffer.
+// The producer always owns one slot, the consumer always owns one slot and the
+// third one is parked in an atomic "shared" index. Publishing and consuming are
+// a single atomic exchange each, so neither side ever blocks the other: the
+// consumer simply sees the most recent complete value that was published.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // producer side: fill in writeBuffer() then publish() it
+    T& writeBuffer() noexcept
+    {
+        return buffers[writeIndex];
+    }
+
+    void publish() noexcept
+    {
+        uint8_t prev = shared.exchange(static_cast<uint8_t>(writeIndex | freshBit), std::memory_order_acq_rel);
+        writeIndex = prev & indexMask;
+    }
+
+    // consumer side: returns true when a newer value was swapped into readBuffer()
+    bool update() noexcept
+    {
+        if ((shared.load(std::memory_order_relaxed) & freshBit) == 0)
+            return false;
+
+        uint8_t prev = shared.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = prev & indexMask;
+        return true;
+    }
+
+    const T& readBuffer() const noexcept
+    {
+        return buffers[readIndex];
+    }
+
+private:
+    static constexpr uint8_t indexMask = 0x3;
+    static constexpr uint8_t freshBit = 0x4;
+
+    T buffers[3];
+
+    // keep the producer, consumer and shared indices on separate cache lines
+    alignas(64) uint8_t writeIndex = 0;
+    alignas(64) std::atomic<uint8_t> shared{1};
+    alignas(64) uint8_t readIndex = 2;
+};
+
+
+#endif //PI_GAME_TRIPLEBUFFER_H
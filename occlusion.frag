@@ -0,0 +1,11 @@
+#version 300 es
+
+precision mediump float;
+
+// color writes are masked off while the proxies are drawn
+out vec3 color;
+
+void main(void)
+{
+	color = vec3(1.0);
+}
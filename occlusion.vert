@@ -0,0 +1,14 @@
+#version 300 es
+
+// Bounding box proxy for OcclusionCuller, a unit cube scaled and moved onto
+// the object's bounding sphere. Only depth matters, nothing is written.
+
+uniform mat4 vp;
+uniform vec4 bounds;	// center, radius
+
+layout(location = 0) in vec3 in_Position;
+
+void main(void)
+{
+	gl_Position = vp * vec4(bounds.xyz + in_Position * bounds.w, 1.0);
+}
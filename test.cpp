@@ -13,13 +13,38 @@
 #include <EGL/egl.h>
 #include <GLES3/gl3.h>
 #include <stdlib.h>
+#include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <cmath>
+#include <memory>
 #include "Shader.h"
 #include "Model.h"
 #include "GraphicsContext.h"
 #include "ShapeGenerator.h"
+#include "Simulation.h"
+#include "JobSystem.h"
+#include "FrustumCuller.h"
+#include "TransformHierarchy.h"
+#include "AssetLoader.h"
+#include "MeshOptimizer.h"
+#include "Meshlets.h"
+#include "CommandBuffer.h"
+#include "StaticBatcher.h"
+#include "OcclusionCuller.h"
+#include "SoftwareRasterizer.h"
+#include "QualityGovernor.h"
+#include "LightSystem.h"
+#include "DynamicResolution.h"
+#include "ParticleSystem.h"
+#include "SpherePhysics.h"
+#include "KtxTexture.h"
+#include "MemoryTracker.h"
+#include "FrameArena.h"
+#include "InputThread.h"
+#include "Trace.h"
+#include "GLRecorder.h"
 #include <glm/mat4x4.hpp> 
 #include <glm/gtc/matrix_transform.hpp> 
 #include <glm/gtc/quaternion.hpp>
@@ -144,97 +169,732 @@ static int match_config_to_visual(EGLDisplay egl_display, EGLint visual_id, EGLC
     return -1;
 }
 
-void Render(Model &m)
+// F12 starts and stops a trace, written to $PIGAME_TRACE or pigame-trace.json
+static void toggleTrace()
 {
+    if (Trace::isEnabled())
+    {
+        Trace::stop();
+        printf("trace stopped, %llu events dropped\n", static_cast<unsigned long long>(Trace::getDropped()));
+        return;
+    }
+
+    const char* path = getenv("PIGAME_TRACE");
+    if (!path)
+        path = "pigame-trace.json";
+    if (Trace::start(path))
+        printf("tracing to %s\n", path);
+}
+
+// Mouse look on top of the simulated orbit, fed by the input thread
+struct CameraInput
+{
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    uint64_t newestEventNs = 0;     // timestamp of the newest event folded in
+};
+
+static void drainInput(InputThread &input, CameraInput &camera)
+{
+    const float radiansPerCount = 0.004f;
+    const float pitchLimit = 1.5f;
+
+    InputEvent e;
+    while (input.pop(e))
+    {
+        if (e.type == EV_KEY && e.code == KEY_F12 && e.value == 1)
+            toggleTrace();
+        if (e.type != EV_REL)
+            continue;
+
+        if (e.code == REL_X)
+            camera.yaw -= static_cast<float>(e.value) * radiansPerCount;
+        else if (e.code == REL_Y)
+            camera.pitch = std::min(std::max(camera.pitch - static_cast<float>(e.value) * radiansPerCount,
+                                             -pitchLimit), pitchLimit);
+        else
+            continue;
+        camera.newestEventNs = e.timeNs;
+    }
+}
+
+static glm::mat4 cameraView(const SimState &state, const CameraInput &camera)
+{
+    glm::vec3 offset = state.cameraEye - state.cameraTarget;
+    glm::vec3 right = glm::normalize(glm::cross(glm::vec3(0, 1, 0), offset));
+    glm::mat4 look = glm::rotate(glm::mat4(1.0f), camera.yaw, glm::vec3(0, 1, 0));
+    look = glm::rotate(look, camera.pitch, right);
+
+    return glm::lookAt(
+        state.cameraTarget + glm::vec3(look * glm::vec4(offset, 0.0f)),
+        state.cameraTarget,
+        glm::vec3(0, 1, 0)  // Head is up (set to 0,-1,0 to look upside-down)
+    );
+}
+
+// Picks up input and simulation once more right before the draws are
+// submitted and re-uploads the view-projection, so the frame shows the camera
+// as of submission rather than as of the top of the loop. Culling and light
+// binning keep the earlier view, the latch only moves the camera by the few
+// milliseconds in between.
+struct LateLatch
+{
+    Simulation &sim;
+    InputThread &input;
+    CameraInput &camera;
+    const glm::mat4 &projection;
+    Shader &sphereShader;
+    GLint sphereVpLoc;
+    Shader &particleShader;
+    GLint particleVpLoc;
+    GLint particleEyeLoc;       // -1 unless the particles are impostors
+    Shader &ballShader;
+    GLint ballVpLoc;
+
+    // what the frame ends up drawn with
+    glm::mat4 viewProjection { 1.0f };
+    glm::vec3 eye { 0.0f };
+
+    void apply()
+    {
+        TRACE_SCOPE("lateLatch");
+        drainInput(input, camera);
+        SimState state = sim.sample(Simulation::Clock::now());
+        glm::mat4 view = cameraView(state, camera);
+        viewProjection = projection * view;
+        eye = glm::vec3(glm::inverse(view)[3]);
+
+        sphereShader.UseProgram();
+        glUniformMatrix4fv(sphereVpLoc, 1, GL_FALSE, &viewProjection[0][0]);
+        particleShader.UseProgram();
+        glUniformMatrix4fv(particleVpLoc, 1, GL_FALSE, &viewProjection[0][0]);
+        if (particleEyeLoc >= 0)
+            glUniform3f(particleEyeLoc, eye.x, eye.y, eye.z);
+        ballShader.UseProgram();
+        glUniformMatrix4fv(ballVpLoc, 1, GL_FALSE, &viewProjection[0][0]);
+    }
+};
+
+// Input-to-flip latency, the time from the kernel stamping the newest input
+// event a frame shows to the page flip that put that frame on screen.
+struct LatencyStats
+{
+    uint64_t measuredEventNs = 0;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t maxNs = 0;
+    uint64_t sumNs = 0;
+    uint64_t samples = 0;
+    Simulation::Clock::time_point lastReport = Simulation::Clock::now();
+
+    void add(const CameraInput &camera, uint64_t flipNs)
+    {
+        if (camera.newestEventNs == measuredEventNs || flipNs < camera.newestEventNs)
+            return;
+
+        measuredEventNs = camera.newestEventNs;
+        uint64_t latency = flipNs - camera.newestEventNs;
+        minNs = std::min(minNs, latency);
+        maxNs = std::max(maxNs, latency);
+        sumNs += latency;
+        samples++;
+    }
+
+    void reportEvery(Simulation::Clock::duration interval)
+    {
+        auto now = Simulation::Clock::now();
+        if (now - lastReport < interval || samples == 0)
+            return;
+
+        printf("input to flip: %llu frames, min %.2f avg %.2f max %.2f ms\n", static_cast<unsigned long long>(samples),
+               static_cast<double>(minNs) * 1e-6, static_cast<double>(sumNs) * 1e-6 / static_cast<double>(samples),
+               static_cast<double>(maxNs) * 1e-6);
+        minNs = UINT64_MAX;
+        maxNs = 0;
+        sumNs = 0;
+        samples = 0;
+        lastReport = now;
+    }
+};
+
+// The CPU side of a frame: scene transforms, culling, light binning, the
+// particle simulation, the fixed physics steps and recording every draw into
+// the worker's CommandBuffer. start() runs it as jobs and returns at once,
+// the GL thread keeps streaming textures and waits on the returned job before
+// it uploads what they produced and submits the draws. The per frame inputs
+// are set before start(), the outputs are only read after the wait.
+struct FrameJobs
+{
+    JobSystem &jobs;
+    CommandQueue &commands;
+    TransformHierarchy &scene;
+    uint32_t sphereNode;
+    FrustumCuller &culler;
+    OcclusionCuller &occlusion;
+    LightSystem &lights;
+    ParticleSystem &particles;
+    SpherePhysics &spheres;
+    const ParticleEmitter &emitter;
+    float particlesPerSecond;
+    const StaticBatcher &rocks;
+    std::vector<Model> &sphereLods;
+    const std::vector<MeshletSet> &sphereMeshlets;
+    uint32_t program;
+    GLint modelLoc;
+    const glm::mat4 &projection;
+    size_t meshletsPerJob;
+
+    // per frame, before start()
+    glm::mat4 view { 1.0f };
+    float spin = 0.0f;
+    float frameTime = 0.0f;
+    uint32_t lod = 0;
+    size_t particleBudget = 0;
+
+    // written by the jobs
+    glm::mat4 world { 1.0f };
+    glm::mat4 viewProjection { 1.0f };
+    const std::vector<uint32_t> *inFrustum = nullptr;
+    float emitDebt = 0.0f;
+
+    Job *start()
+    {
+        FrameJobs *self = this;
+        Job *root = jobs.createJob(&rootJob);
+        jobs.run(jobs.createChildJob(root, &sceneJob, self));
+        jobs.run(jobs.createChildJob(root, &lightsJob, self));
+        jobs.run(jobs.createChildJob(root, &particlesJob, self));
+        jobs.run(jobs.createChildJob(root, &physicsJob, self));
+        jobs.run(root);
+        return root;
+    }
+
+    void recordScene()
+    {
+        TRACE_SCOPE("scene");
+        scene.setLocal(sphereNode, glm::rotate(glm::mat4(1.0f), spin, glm::vec3(0, 1, 0)));
+        scene.update();
+
+        world = scene.getWorld(sphereNode);
+        culler.set(sphereNode, glm::vec3(world[3]), 1.0f);
+        occlusion.set(sphereNode, glm::vec3(world[3]), 1.0f);
+        viewProjection = projection * view;
+        const glm::mat4 mvp = viewProjection * world;
+
+        // only what survived culling gets recorded, and of that only the
+        // meshlets facing the camera
+        inFrustum = &culler.cull(viewProjection);
+        const std::vector<uint32_t> &visible = occlusion.filter(*inFrustum);
+        rocks.record(commands.local());
+        if (visible.empty())
+            return;
+
+        TRACE_SCOPE("meshletCull");
+        // the eye with mouse look applied, not the simulated one
+        glm::vec3 eyeInModel = glm::vec3(glm::inverse(world * glm::inverse(view)) * glm::vec4(0, 0, 0, 1.0f));
+        Model &m = sphereLods[lod];
+        const MeshletSet &meshlets = sphereMeshlets[lod];
+        const uint32_t vao = m.getVao();
+        const IndexType indexType = m.getIndexType() == GL_UNSIGNED_SHORT ? IndexType::UInt16 : IndexType::UInt32;
+        commands.record(meshlets.getMeshlets().size(), meshletsPerJob,
+                        [&](CommandBuffer &out, size_t first, size_t last) {
+            out.setProgram(program);
+            out.setMatrix(modelLoc, &world[0][0]);
+            out.setVertexArray(vao);
+            meshlets.record(out, indexType, mvp, eyeInModel, first, last);
+        });
+    }
+
+    void updateLights()
+    {
+        TRACE_SCOPE("lights");
+        lights.update(view, projection, 0.1f, 100.0f, &jobs);
+    }
+
+    void updateParticles()
+    {
+        TRACE_SCOPE("particles");
+        emitDebt += particlesPerSecond * frameTime;
+        size_t toEmit = static_cast<size_t>(emitDebt);
+        emitDebt -= static_cast<float>(toEmit);
+        toEmit = std::min(toEmit, particleBudget > particles.size() ? particleBudget - particles.size() : 0);
+        particles.update(frameTime, &jobs);
+        particles.emit(emitter, toEmit, &jobs);
+    }
+
+    // as many fixed steps as the frame took, the draw shows the latest one
+    void stepPhysics()
+    {
+        TRACE_SCOPE("physics");
+        spheres.advance(frameTime, &jobs);
+    }
+
+    static void rootJob(Job *, const void *)
+    {
+    }
+
+    static void sceneJob(Job *, const void *data)
+    {
+        (*static_cast<FrameJobs *const *>(data))->recordScene();
+    }
+
+    static void lightsJob(Job *, const void *data)
+    {
+        (*static_cast<FrameJobs *const *>(data))->updateLights();
+    }
+
+    static void particlesJob(Job *, const void *data)
+    {
+        (*static_cast<FrameJobs *const *>(data))->updateParticles();
+    }
+
+    static void physicsJob(Job *, const void *data)
+    {
+        (*static_cast<FrameJobs *const *>(data))->stepPhysics();
+    }
+};
+
+// GL calls only, the draws were recorded into commands by the jobs beforehand
+void Render(GraphicsContext &gfx, DynamicResolution &resolution, LateLatch &latch, CommandQueue &commands,
+            ParticleSystem &particles, Model &particleModel, Shader &particleShader, SpherePhysics &spheres,
+            Model &ballModel, OcclusionCuller &occlusion, const std::vector<uint32_t> &inFrustum)
+{
+    TRACE_SCOPE("render");
+    resolution.beginFrame();
+
     // First, render a square without any colors ( all vertexes will be black )
     // ===================
     // Make our background grey
     glClearColor(0.5, 0.5, 0.5, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glDrawElements(GL_TRIANGLES, m.getNumIndices(), GL_UNSIGNED_INT, 0);
+    // last moment to move the camera before the draws go out
+    latch.apply();
 
-    swap_buffers();
+    // the meshlets that survived culling, recorded in parallel
+    commands.submit();
+
+    // every particle in one instanced draw
+    particleShader.UseProgram();
+    particles.draw(particleModel);
+
+    // and every physics sphere in another
+    latch.ballShader.UseProgram();
+    spheres.draw(ballModel);
+
+    // against this frame's depth, read back a frame or two from now
+    occlusion.issue(latch.viewProjection, latch.eye, inFrustum);
+
+    resolution.endFrame();
+    gfx.swapBuffers();
+}
+
+// Game logic, runs on the simulation thread at a fixed timestep
+static void stepGame(SimState &state, float dt)
+{
+    const float orbitSpeed = 0.5f;  // radians per second
+    const float spinSpeed = 1.0f;
+
+    float angle = orbitSpeed * static_cast<float>(state.tick + 1) * dt;
+    state.cameraEye = glm::vec3(2.0f * cosf(angle), 0.0f, 2.0f * sinf(angle));
+    state.spin += spinSpeed * dt;
+}
+
+// the n-th of total rocks scattered on the ground around the sphere
+static glm::mat4 rockTransform(uint32_t n, uint32_t total)
+{
+    float angle = 2.39996f * static_cast<float>(n);
+    float radius = 1.5f + 3.0f * std::sqrt((static_cast<float>(n) + 0.5f) / static_cast<float>(total));
+    glm::vec3 position(radius * std::cos(angle), -1.2f, radius * std::sin(angle));
+    float size = 0.01f + 0.0002f * static_cast<float>((n * 7919u) % 100u);
+    return glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(size));
+}
+
+// PIGAME_SOFTWARE=1 draws the sphere and the rocks with SoftwareRasterizer,
+// no GPU, DRM device or display needed. Runs a fixed number of simulation
+// steps so every run renders the same frames. PIGAME_SOFTWARE_THREADS sets
+// the worker count for scaling runs, PIGAME_SOFTWARE_FRAMES the frame count,
+// PIGAME_SOFTWARE_OUTPUT=path.ppm keeps the last frame.
+static int runSoftware()
+{
+    int result = 0;
+    try {
+        const char* threads = getenv("PIGAME_SOFTWARE_THREADS");
+        const char* frames = getenv("PIGAME_SOFTWARE_FRAMES");
+        const char* output = getenv("PIGAME_SOFTWARE_OUTPUT");
+        const uint32_t frameCount = frames ? static_cast<uint32_t>(strtoul(frames, nullptr, 10)) : 300;
+
+        JobSystem jobs(threads ? static_cast<unsigned>(strtoul(threads, nullptr, 10)) : 0);
+        SoftwareRasterizer raster(1920, 1080, jobs);
+
+        IcosoSphere s(1.0f, 2);
+        Model sphere = s.buildSphere(&jobs);
+        IcosoSphere debrisShape(1.0f, 0);
+        Model debris = debrisShape.buildSphere();
+
+        const uint32_t rockCount = 6000;
+        std::vector<glm::mat4> rocks(rockCount);
+        for (uint32_t n = 0; n < rockCount; n++)
+            rocks[n] = rockTransform(n, rockCount);
+
+        glm::mat4 Projection = glm::perspective(glm::radians(160.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+        SimState state;
+        CameraInput camera;
+        const float dt = 1.0f / 60.0f;
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            TRACE_SCOPE("frame");
+            stepGame(state, dt);
+            state.tick++;
+
+            glm::mat4 vp = Projection * cameraView(state, camera);
+            glm::mat4 World = glm::rotate(glm::mat4(1.0f), state.spin, glm::vec3(0, 1, 0));
+
+            raster.clear(glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+            raster.draw(sphere, vp, World);
+            for (const glm::mat4& rock : rocks)
+                raster.draw(debris, vp, rock);
+            raster.flush();
+
+            raster.dumpEvery(std::chrono::seconds(2));
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("software: %u frames in %.2f s, %.1f fps on %u workers\n", frameCount, seconds,
+               seconds > 0.0 ? frameCount / seconds : 0.0, jobs.getNumWorkers());
+
+        if (output)
+        {
+            raster.writePpm(output);
+            std::cout << "Last frame written to " << output << '\n';
+        }
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << '\n';
+        result = 1;
+    }
+
+    Trace::stop();
+    return result;
 }
 
 int main()
 {
+    TRACE_THREAD_NAME("render");
+    if (getenv("PIGAME_TRACE"))
+        toggleTrace();
+
+    // no GPU or display, GraphicsContext would only throw
+    if (getenv("PIGAME_SOFTWARE"))
+        return runSoftware();
+
+    // kick off the file reads first, they complete while DRM/EGL come up
+    AssetLoader assets;
+    AssetHandle vertSource = assets.load("tutorial2.vert");
+    AssetHandle fragSource = assets.load("tutorial2.frag");
+    AssetHandle occlusionVert = assets.load("occlusion.vert");
+    AssetHandle occlusionFrag = assets.load("occlusion.frag");
+
     DispmanCapture dispman = DispmanCapture();
 
+    // GPU carve-out and heap share the Pi's RAM, keep both under one number
+    MemoryTracker& memory = MemoryTracker::instance();
+    memory.setBudget(size_t(192) << 20);
+
     try{
         GraphicsContext gfx;
-    } catch (const std::runtime_error& e) {
-        std::cout << e.what() << '\n';
-    }
 
-/*
-    drmDeviceFd = open("/dev/dri/card1", O_RDWR);
-    resources = drmModeGetResources(drmDeviceFd);
-    connector = find_connector(resources);
-    connectorId = connector->connectorId;
-    modeInfo = connector->modes[0];
-    encoder = find_encoder(resources, connector);
-    crtc = drmModeGetCrtc(drmDeviceFd, encoder->crtc_id);
-    drmModeFreeEncoder(encoder);
-    drmModeFreeConnector(connector);
-    drmModeFreeResources(resources);
-    gbmDevice = gbm_create_device(drmDeviceFd);
-    gbmSurface = gbm_surface_create(gbmDevice, modeInfo.hdisplay, modeInfo.vdisplay, GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
-    eglDisplay = eglGetDisplay(gbmDevice);
-    eglInitialize(eglDisplay, NULL, NULL);
-    eglBindAPI(EGL_OPENGL_ES_API);
-    eglGetConfigs(eglDisplay, NULL, 0, &count);
-    configs = (EGLConfig*)malloc(count * sizeof(*configs));
-    eglChooseConfig(eglDisplay, attributes, configs, count, &num_config);
-    config_index = match_config_to_visual(eglDisplay, GBM_FORMAT_XRGB8888, configs, num_config);
-    context = eglCreateContext(eglDisplay, configs[config_index], EGL_NO_CONTEXT, context_attribs);
-    eglSurface = eglCreateWindowSurface(eglDisplay, configs[config_index], gbmSurface, NULL);
-    free(configs);
-    eglMakeCurrent(eglDisplay, eglSurface, eglSurface, context);
-    printf("%s \n", glGetString(GL_RENDERER));
-    printf("%s \n", glGetString(GL_VERSION));
-
-    Shader shader;
-    shader.UseProgram();
-
-    glm::mat4 Projection = glm::perspective(glm::radians(160.0f), (float)1920 / (float)1080, 0.1f, 100.0f);
-
-	glm::mat4 View = glm::lookAt(
-		glm::vec3(2, 0, 0), // Camera is at (4,3,3), in World Space
-		glm::vec3(0, 0, 0), // and looks at the origin
-		glm::vec3(0, 1, 0)  // Head is up (set to 0,-1,0 to look upside-down)
-	);
-
-	glm::mat4 mvp = Projection * View;
-
-    GLint uniformLoc = glGetUniformLocation(shader.getshaderID(), "vp");
-	glUniformMatrix4fv(uniformLoc, 1, GL_FALSE, &mvp[0][0]);
-
-    IcosoSphere s(1.0f, 2);
-    Model m = s.buildSphere();
-    m.genBufferObjects();
-
-    Render(m);
-
-    sleep(10);
-
-    drmModeSetCrtc(drmDeviceFd, crtc->crtc_id, crtc->buffer_id, crtc->x, crtc->y, &connectorId, 1, &crtc->mode);
-    drmModeFreeCrtc(crtc);
+        // $PIGAME_GL_RECORD captures the GL stream for pigame_replay, before any GL object exists
+        if (const char* recordPath = getenv("PIGAME_GL_RECORD"))
+        {
+            const char* frames = getenv("PIGAME_GL_RECORD_FRAMES");
+            uint32_t maxFrames = frames ? static_cast<uint32_t>(strtoul(frames, nullptr, 10)) : 120;
+            if (GLRecorder::start(recordPath, gfx.getWidth(), gfx.getHeight(), maxFrames))
+                std::cout << "Recording GL commands to " << recordPath << '\n';
+            else if (!GLRecorder::isAvailable())
+                std::cout << "GL recording needs a PIGAME_GL_RECORDER build\n";
+            else
+                std::cout << "Failed to open " << recordPath << " for GL recording\n";
+        }
 
-    if (previous_bo)
-    {
-        drmModeRmFB(drmDeviceFd, previous_fb);
-        gbm_surface_release_buffer(gbmSurface, previous_bo);
-    }
+        // created on the thread that owns the GL context, which makes it worker 0
+        JobSystem jobs;
+
+        // lit per fragment by the clustered lights, normals come in as 2_10_10_10
+        ShaderCache shaders(vertSource, fragSource);
+        std::unique_ptr<KtxTexture> sphereTexture;
+        try {
+            sphereTexture.reset(new KtxTexture(AssetLoader::defaultRoot() + "icosphere.ktx"));
+        } catch (const std::runtime_error& e) {
+            std::cout << e.what() << ", drawing the sphere untextured\n";
+        }
+
+        uint32_t sphereFeatures = SHADER_LIGHTING_CLUSTERED | SHADER_PACKED_NORMALS;
+        if (sphereTexture)
+            sphereFeatures |= SHADER_TEXTURED;
+        Shader& shader = shaders.get(sphereFeatures);
+        shader.UseProgram();
+
+        glm::mat4 Projection = glm::perspective(glm::radians(160.0f), (float)1920 / (float)1080, 0.1f, 100.0f);
+        GLint uniformLoc = glGetUniformLocation(shader.getshaderID(), "vp");
+        GLint modelLoc = glGetUniformLocation(shader.getshaderID(), "model");
 
-    eglDestroySurface(eglDisplay, eglSurface);
-    gbm_surface_destroy(gbmSurface);
-    eglDestroyContext(eglDisplay, context);
-    eglTerminate(eglDisplay);
-    //gbm_device_destroy(gbmDevice);
+        // a shell of small coloured lights spread evenly around the sphere
+        LightSystem lights(gfx.getWidth(), gfx.getHeight());
+        for (uint32_t n = 0; n < 200; n++)
+        {
+            float y = 1.0f - 2.0f * (static_cast<float>(n) + 0.5f) / 200.0f;
+            float ring = std::sqrt(1.0f - y * y);
+            float angle = 2.39996f * static_cast<float>(n);
+            glm::vec3 dir(ring * std::cos(angle), y, ring * std::sin(angle));
+            glm::vec3 color(std::fabs(dir.x), std::fabs(dir.y), std::fabs(dir.z));
+            lights.add({ dir * 1.3f, 0.6f, color, 1.0f });
+        }
+
+        // the sphere at every subdivision level the quality governor can pick
+        const uint32_t sphereLevels = 3;
+        std::vector<Model> sphereLods;
+        std::vector<MeshletSet> sphereMeshlets(sphereLevels);
+        sphereLods.reserve(sphereLevels);
+        for (uint32_t level = 0; level < sphereLevels; level++)
+        {
+            IcosoSphere s(1.0f, static_cast<int>(level));
+            sphereLods.push_back(s.buildSphere(&jobs));
+            MeshOptimizer::Stats optimized = MeshOptimizer::optimize(sphereLods.back());
+            if (optimized.unsharedVertices)
+                std::cout << "Sphere level " << level << " shares no vertices, renumbered only, "
+                          << (optimized.shortIndices ? 16 : 32) << " bit indices\n";
+            else
+                std::cout << "Sphere level " << level << " optimized, ACMR " << optimized.acmrBefore << " -> "
+                          << optimized.acmrAfter << " (" << optimized.clusters << " clusters, "
+                          << (optimized.shortIndices ? 16 : 32) << " bit indices)\n";
+            sphereMeshlets[level].build(sphereLods.back());
+            sphereLods.back().genBufferObjects(true);
+        }
+
+        // debris: a bare icosahedron per particle, lit per vertex, or with
+        // PIGAME_IMPOSTORS=1 a ray-cast sphere on a quad, round and lit per pixel
+        const bool impostors = getenv("PIGAME_IMPOSTORS") != nullptr;
+        Shader& particleShader = impostors
+                ? shaders.get(SHADER_LIGHTING_CLUSTERED | SHADER_INSTANCING | SHADER_IMPOSTOR)
+                : shaders.get(SHADER_LIGHTING_LAMBERT | SHADER_INSTANCING);
+        GLint particleVpLoc = glGetUniformLocation(particleShader.getshaderID(), "vp");
+        GLint particleEyeLoc = impostors ? glGetUniformLocation(particleShader.getshaderID(), "eye") : -1;
+
+        IcosoSphere debrisShape(1.0f, 0);
+        Model debris = debrisShape.buildSphere();
+        debris.genBufferObjects();
+
+        Model impostorQuad = SphereImpostor(1.0f).buildQuad();
+        impostorQuad.genBufferObjects();
+        Model& particleModel = impostors ? impostorQuad : debris;
+
+        // rocks scattered on the ground that never move, merged into batches of
+        // 65536 vertices: 60 per flat shaded icosahedron, 1092 rocks per batch,
+        // so 6000 rocks are 6 draws
+        StaticBatcher rocks;
+        BatchMaterial rockMaterial;
+        rockMaterial.program = shader.getshaderID();
+        rockMaterial.modelLocation = modelLoc;
+        const uint32_t rockCount = 6000;
+        for (uint32_t n = 0; n < rockCount; n++)
+            rocks.add(debris, rockTransform(n, rockCount), rockMaterial);
+
+        // PIGAME_SPHERES=n colliding spheres dropped onto the ground, 2000 by
+        // default. A model and VAO of their own, the particles' instance
+        // buffer stays attached to debris
+        Shader& ballShader = shaders.get(SHADER_LIGHTING_LAMBERT | SHADER_INSTANCING);
+        GLint ballVpLoc = glGetUniformLocation(ballShader.getshaderID(), "vp");
+        IcosoSphere ballShape(1.0f, 1);
+        Model balls = ballShape.buildSphere();
+        balls.genBufferObjects();
+
+        const char* sphereCountEnv = getenv("PIGAME_SPHERES");
+        const size_t sphereCount = sphereCountEnv ? strtoul(sphereCountEnv, nullptr, 10) : 2000;
+        SpherePhysics spheres(std::max<size_t>(sphereCount, 1));
+        spheres.setBounds(glm::vec3(-4.0f, -1.2f, -4.0f), glm::vec3(4.0f, 3.0f, 4.0f));
+        for (size_t n = 0; n < sphereCount; n++)
+        {
+            // golden angle spiral over the floor, heights and sizes from cheap hashes
+            const uint32_t h = static_cast<uint32_t>(n) * 2654435761u;
+            float angle = 2.39996f * static_cast<float>(n);
+            float ring = 3.8f * std::sqrt((static_cast<float>(n) + 0.5f) / static_cast<float>(sphereCount));
+            float height = -1.0f + 3.9f * static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+            float size = 0.04f + 0.0004f * static_cast<float>((h >> 4) % 100u);
+            glm::vec3 position(ring * std::cos(angle), height, ring * std::sin(angle));
+            glm::vec3 velocity(-std::sin(angle), 0.0f, std::cos(angle));
+            glm::vec3 color(0.4f + 0.6f * std::fabs(std::cos(angle)), 0.5f, 0.4f + 0.6f * std::fabs(std::sin(angle)));
+            spheres.add(position, velocity, size, color);
+        }
+
+        ParticleSystem particles;
+        ParticleEmitter emitter { glm::vec3(0.0f, 0.0f, 0.0f), 2.0f, glm::vec3(0.9f, 0.6f, 0.3f), 3.0f, 0.02f };
+        const float particlesPerSecond = 40000.0f;
+
+        TransformHierarchy scene;
+        uint32_t sphereNode = scene.create(glm::mat4(1.0f));
+
+        FrustumCuller culler;
+        culler.add(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
+
+        // whatever survives the frustum is also checked against last frames' depth
+        glEnable(GL_DEPTH_TEST);
+        OcclusionCuller occlusion(*occlusionVert, *occlusionFrag, 0.1f);
+
+        // The simulation publishes fixed steps from its own thread, the loop below
+        // only samples the newest pair of states and interpolates, so it never waits
+        // on game logic and keeps up with the display.
+        Simulation sim;
+        sim.start(stepGame);
+        spheres.setFixedStep(std::chrono::duration<float>(sim.getStep()).count());
+
+        // mouse look, read on its own thread and applied at the last moment
+        InputThread input;
+        input.start();
+        if (input.getDeviceCount() == 0)
+            std::cout << "No readable input devices, mouse look disabled\n";
+        CameraInput camera;
+        LateLatch latch { sim, input, camera, Projection, shader, uniformLoc, particleShader, particleVpLoc,
+                          particleEyeLoc, ballShader, ballVpLoc };
+
+        // PIGAME_MEASURE_LATENCY=1 prints how long input takes to reach the screen
+        const bool measureLatency = getenv("PIGAME_MEASURE_LATENCY") != nullptr;
+        LatencyStats latency;
+
+        // the scene renders offscreen at whatever size keeps the GPU inside its budget
+        DynamicResolution resolution(gfx.getWidth(), gfx.getHeight());
+
+        // Best first, stepped through when the Pi heats up or frames drop.
+        // PIGAME_SYSFS_ROOT points the sensors at a fake sysfs tree.
+        const std::vector<QualityLevel> qualityLevels = {
+            { 2, 1.0f, 131072, 200 },
+            { 2, 0.85f, 65536, 128 },
+            { 1, 0.7f, 32768, 64 },
+            { 0, 0.5f, 16384, 32 },
+        };
+        QualityGovernorSettings governorSettings;
+        if (const char* sysfs = getenv("PIGAME_SYSFS_ROOT"))
+            governorSettings.sysfsRoot = sysfs;
+        QualityGovernor governor(qualityLevels, governorSettings);
+
+        // draw packets recorded by the workers, submitted by this thread
+        CommandQueue commands(jobs);
+        const size_t meshletsPerJob = 16;
+        FrameJobs frame { jobs, commands, scene, sphereNode, culler, occlusion, lights, particles, spheres, emitter,
+                          particlesPerSecond, rocks, sphereLods, sphereMeshlets, shader.getshaderID(), modelLoc,
+                          Projection, meshletsPerJob };
+
+        // transient per-frame data, recycled every other frame
+        DoubleFrameArena frameArenas;
+        const uint64_t warmupFrames = 120;
+        uint64_t frameNumber = 0;
+
+        auto runUntil = Simulation::Clock::now() + std::chrono::seconds(10);
+        auto lastFrame = Simulation::Clock::now();
+        while (Simulation::Clock::now() < runUntil)
+        {
+            const uint64_t heapBefore = HeapCounter::getAllocations();
+            TRACE_SCOPE("frame");
+            auto now = Simulation::Clock::now();
+            float frameTime = std::chrono::duration<float>(now - lastFrame).count();
+            lastFrame = now;
+
+            SimState state = sim.sample(now);
+            occlusion.collect();
+
+            if (governor.update(frameTime * 1000.0f))
+            {
+                const QualityLevel& quality = governor.get();
+                resolution.setScaleLimit(quality.renderScale);
+                lights.setBudget(quality.lightBudget);
+                printf("quality level %u: subdivision %u, scale %.2f, %u particles, %u lights\n",
+                       governor.getLevel(), quality.sphereSubdivision, static_cast<double>(quality.renderScale),
+                       quality.particleBudget, quality.lightBudget);
+            }
+
+            drainInput(input, camera);
+            frame.view = cameraView(state, camera);
+            frame.spin = state.spin;
+            frame.frameTime = frameTime;
+            frame.lod = std::min(governor.get().sphereSubdivision, sphereLevels - 1);
+            frame.particleBudget = governor.get().particleBudget;
+
+            // rebuilding a batch uploads it, so that stays on this thread
+            rocks.update();
+            commands.reset();
+            Job* cpuWork = frame.start();
+
+            // a few more mip levels per frame, coarsest first, while the jobs run
+            if (sphereTexture)
+            {
+                sphereTexture->streamNext();
+                sphereTexture->bind(0);
+            }
+
+            jobs.wait(cpuWork);
+
+            // from here on only uploads of what the jobs produced
+            shader.UseProgram();
+            glUniformMatrix4fv(uniformLoc, 1, GL_FALSE, &frame.viewProjection[0][0]);
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &frame.world[0][0]);
+
+            {
+                TRACE_SCOPE("lights");
+                lights.upload(&frameArenas.current());
+                lights.setViewport(resolution.getRenderWidth(), resolution.getRenderHeight());
+                lights.bind(shader.getshaderID());
+            }
+
+            {
+                TRACE_SCOPE("instances");
+                particles.upload(&jobs);
+                spheres.upload(&jobs);
+            }
+
+            particleShader.UseProgram();
+            glUniformMatrix4fv(particleVpLoc, 1, GL_FALSE, &frame.viewProjection[0][0]);
+            if (impostors)
+                lights.bind(particleShader.getshaderID());
+            ballShader.UseProgram();
+            glUniformMatrix4fv(ballVpLoc, 1, GL_FALSE, &frame.viewProjection[0][0]);
+
+            Render(gfx, resolution, latch, commands, particles, particleModel, particleShader, spheres, balls,
+                   occlusion, *frame.inFrustum);
+            if (measureLatency)
+            {
+                latency.add(camera, gfx.getLastFlipTime());
+                latency.reportEvery(std::chrono::seconds(2));
+            }
+            jobs.pumpGLJobs();
+            memory.dumpEvery(std::chrono::seconds(2));
+            occlusion.dumpEvery(std::chrono::seconds(2));
+            governor.dumpEvery(std::chrono::seconds(2));
+            spheres.dumpEvery(std::chrono::seconds(2));
+
+            frameArenas.swap();
+
+            // steady state is supposed to stay off the heap entirely
+            const uint64_t frameAllocations = HeapCounter::getAllocations() - heapBefore;
+            if (HeapCounter::isEnabled() && ++frameNumber > warmupFrames && frameAllocations)
+                printf("frame %llu: %llu heap allocations\n", static_cast<unsigned long long>(frameNumber),
+                       static_cast<unsigned long long>(frameAllocations));
+        }
+
+        input.stop();
+        sim.stop();
+        for (Model& lod : sphereLods)
+            lod.deleteBufferObjects();
+        debris.deleteBufferObjects();
+        balls.deleteBufferObjects();
+        impostorQuad.deleteBufferObjects();
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << '\n';
+    }
 
-    close(drmDeviceFd);
+    // everything above is out of scope, whatever is still counted leaked
+    memory.reportLeaks();
+    GLRecorder::stop();
+    Trace::stop();
 
-*/
     return 0;
 }
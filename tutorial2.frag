@@ -3,9 +3,123 @@
 precision mediump float; 
 in vec3 ex_Color;
 
+#ifdef TEXTURED
+in vec2 ex_TexCoord;
+uniform sampler2D diffuseMap;
+#endif
+
+#if defined(LIGHTING_CLUSTERED) || defined(IMPOSTOR)
+in highp vec3 ex_WorldPos;
+#endif
+
+#ifdef LIGHTING_CLUSTERED
+precision highp int;
+
+// must match the constants in LightSystem.h
+#define MAX_LIGHTS 256
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define INDEX_TEXTURE_SHIFT 10u	// indexTextureWidth 1024
+
+in vec3 ex_Normal;
+
+layout(std140) uniform Lights
+{
+	highp vec4 lightPosRadius[MAX_LIGHTS];
+	vec4 lightColor[MAX_LIGHTS];
+};
+
+uniform highp usampler2D clusterGrid;	// (offset, count) per cluster
+uniform highp usampler2D lightIndices;
+uniform highp vec4 clusterParams;		// tile width, tile height, slice scale, slice bias
+uniform highp vec2 clusterDepth;		// near, far
+
+// windowZ is the fragment's depth buffer value, gl_FragCoord.z unless it was overridden
+vec3 clusteredLighting(highp vec3 worldPos, vec3 normal, highp float windowZ)
+{
+	float ambientStrength = 0.1f;
+	vec3 result = vec3(ambientStrength);
+
+	// linear view depth back out of the depth buffer value
+	highp float n = clusterDepth.x;
+	highp float f = clusterDepth.y;
+	highp float zNdc = windowZ * 2.0f - 1.0f;
+	highp float depth = 2.0f * n * f / (f + n - zNdc * (f - n));
+
+	int slice = clamp(int(log(depth) * clusterParams.z + clusterParams.w), 0, CLUSTER_SLICES - 1);
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterParams.xy), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+
+	uvec2 cluster = texelFetch(clusterGrid, ivec2(tile.y * CLUSTER_TILES_X + tile.x, slice), 0).rg;
+
+	for (uint i = 0u; i < cluster.y; i++)
+	{
+		uint index = cluster.x + i;
+		uint light = texelFetch(lightIndices, ivec2(index & ((1u << INDEX_TEXTURE_SHIFT) - 1u), index >> INDEX_TEXTURE_SHIFT), 0).r;
+
+		highp vec4 posRadius = lightPosRadius[light];
+		highp vec3 toLight = posRadius.xyz - worldPos;
+		highp float dist = length(toLight);
+
+		float falloff = clamp(1.0f - dist / posRadius.w, 0.0f, 1.0f);
+		float diff = max(dot(normal, toLight / dist), 0.0f);
+		result += lightColor[light].rgb * (diff * falloff * falloff);
+	}
+
+	return result;
+}
+#endif
+
+#ifdef IMPOSTOR
+uniform highp mat4 vp;
+uniform highp vec3 eye;
+flat in highp vec4 ex_Sphere;
+#endif
+
 out vec3 color;
 
 void main(void) 
 {
     color = ex_Color;
-}
\ No newline at end of file
+
+#ifdef IMPOSTOR
+    // the eye ray through this pixel of the quad against the exact sphere,
+    // depth and normal come from the hit so impostors intersect like meshes
+    highp vec3 dir = normalize(ex_WorldPos - eye);
+    highp vec3 toEye = eye - ex_Sphere.xyz;
+    highp float b = dot(toEye, dir);
+    highp float h = b * b - dot(toEye, toEye) + ex_Sphere.w * ex_Sphere.w;
+    if (h < 0.0f)
+        discard;
+    highp float t = -b - sqrt(h);
+    if (t < 0.0f)
+        discard;
+
+    highp vec3 worldPos = eye + dir * t;
+    vec3 normal = (worldPos - ex_Sphere.xyz) / ex_Sphere.w;
+    highp vec4 clip = vp * vec4(worldPos, 1.0f);
+    highp float windowZ = clip.z / clip.w * 0.5f + 0.5f;
+    gl_FragDepth = windowZ;
+#ifdef TEXTURED
+    // equirectangular, there are no vertices to carry coordinates
+    vec2 texCoord = vec2(atan(normal.z, normal.x) * 0.1591549f + 0.5f, asin(clamp(normal.y, -1.0f, 1.0f)) * 0.3183099f + 0.5f);
+#endif
+#else
+#ifdef LIGHTING_CLUSTERED
+    highp vec3 worldPos = ex_WorldPos;
+    vec3 normal = normalize(ex_Normal);
+    highp float windowZ = gl_FragCoord.z;
+#endif
+#ifdef TEXTURED
+    vec2 texCoord = ex_TexCoord;
+#endif
+#endif
+
+#ifdef TEXTURED
+    color *= texture(diffuseMap, texCoord).rgb;
+#endif
+
+#ifdef LIGHTING_CLUSTERED
+    color *= clusteredLighting(worldPos, normal, windowZ);
+#endif
+}
@@ -1,43 +1,152 @@
 #version 300 es
 
+// Feature flags are injected by Shader after the #version line, see
+// ShaderFeature in Shader.h. With no LIGHTING_* defined the vertex color is
+// passed through unlit. LIGHTING_CLUSTERED lights per fragment, this stage
+// only hands over world space position and normal.
+// IMPOSTOR turns each instance into a camera facing quad around the sphere
+// the instance matrix places, the fragment stage ray-casts the sphere.
+
+#if defined(LIGHTING_LAMBERT) || defined(LIGHTING_PHONG) || defined(LIGHTING_CLUSTERED)
+#define HAS_NORMALS
+#endif
+
 uniform mat4 vp;
 
+#if defined(LIGHTING_CLUSTERED) && !defined(INSTANCING)
+// lights are in world space, vp is then Projection * View only
+uniform mat4 model;
+#endif
+
 layout(location = 0) in vec3 in_Position;
 layout(location = 1) in vec3 in_Color;
 layout(location = 2) in vec3 in_Normal;
 
+#ifdef TEXTURED
+layout(location = 8) in vec2 in_TexCoord;
+out vec2 ex_TexCoord;
+#endif
+
+#ifdef INSTANCING
+layout(location = 3) in mat4 in_World;
+layout(location = 7) in vec4 in_InstanceColor;
+#endif
+
 out vec3 ex_Color;
 
-vec3 lighting()
+#if defined(LIGHTING_CLUSTERED) || defined(IMPOSTOR)
+out highp vec3 ex_WorldPos;
+#endif
+
+#ifdef LIGHTING_CLUSTERED
+out vec3 ex_Normal;
+#endif
+
+#ifdef IMPOSTOR
+uniform highp vec3 eye;
+flat out highp vec4 ex_Sphere;		// world space center, radius
+
+// The quad sits in the plane through the center facing the eye, sized to the
+// cone of rays that touch the sphere. in_Position.xy is a corner at +-radius.
+void impostor()
+{
+    highp vec3 center = in_World[3].xyz;
+    highp float radius = abs(in_Position.x) * length(in_World[0].xyz);
+
+    highp vec3 toCenter = center - eye;
+    highp float dist2 = dot(toCenter, toCenter);
+    highp vec3 forward = toCenter * inversesqrt(dist2);
+    highp vec3 right = normalize(cross(forward, abs(forward.y) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f)));
+    highp vec3 up = cross(right, forward);
+    highp float halfSize = radius * sqrt(dist2 / max(dist2 - radius * radius, 1e-6f));
+
+    highp vec3 corner = center + (right * sign(in_Position.x) + up * sign(in_Position.y)) * halfSize;
+    gl_Position = vp * vec4(corner, 1.0f);
+
+    ex_WorldPos = corner;
+    ex_Sphere = vec4(center, radius);
+    ex_Color = in_Color * in_InstanceColor.rgb;
+}
+#endif
+
+#if defined(LIGHTING_LAMBERT) || defined(LIGHTING_PHONG)
+vec3 lighting(vec3 position, vec3 normal)
 {
 	vec3 lightPos = vec3(0.0f, 40.0f, 0.0f);
-	vec3 viewPos = vec3(0.0f, 0.0f, 1.0f);
 
 	vec3 lightColor = vec3(1.0f, 1.0f, 1.0f);
 	float ambientStrength = 0.1f;
-	float specularStrength = 0.5f;
 
 	// ambient
     vec3 ambient = ambientStrength * lightColor;
 
-	// diffuse	
-	//vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - in_Position);
-    float diff = max(dot(in_Normal, lightDir), 0.0f);
+	// diffuse
+    vec3 lightDir = normalize(lightPos - position);
+    float diff = max(dot(normal, lightDir), 0.0f);
     vec3 diffuse = diff * lightColor;
 
+#ifdef LIGHTING_PHONG
+	vec3 viewPos = vec3(0.0f, 0.0f, 1.0f);
+	float specularStrength = 0.5f;
+
 	// specular
-    vec3 viewDir = normalize(viewPos - in_Position);
-    vec3 reflectDir = reflect(-lightDir, in_Normal);  
+    vec3 viewDir = normalize(viewPos - position);
+    vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0f), 32.0f);
-    vec3 specular = specularStrength * spec * lightColor; 
+    vec3 specular = specularStrength * spec * lightColor;
 
+	return ambient + diffuse + specular;
+#else
 	return ambient + diffuse;
+#endif
 }
+#endif
 
 void main(void) 
 {
-    gl_Position = vp * vec4(in_Position.x, in_Position.y, in_Position.z, 1.0f);
+#ifdef IMPOSTOR
+    impostor();
+    return;
+#endif
+
+    vec4 position = vec4(in_Position, 1.0f);
+    vec3 color = in_Color;
+
+#ifdef INSTANCING
+    position = in_World * position;
+    color *= in_InstanceColor.rgb;
+#elif defined(LIGHTING_CLUSTERED)
+    position = model * position;
+#endif
 
-    ex_Color = in_Color * lighting();
-}
\ No newline at end of file
+    gl_Position = vp * position;
+
+#ifdef HAS_NORMALS
+#ifdef PACKED_NORMALS
+    // 10 bit normals lose unit length
+    vec3 normal = normalize(in_Normal);
+#else
+    vec3 normal = in_Normal;
+#endif
+#ifdef INSTANCING
+    normal = normalize(mat3(in_World) * normal);
+#elif defined(LIGHTING_CLUSTERED)
+    normal = mat3(model) * normal;
+#endif
+#endif
+
+#if defined(LIGHTING_LAMBERT) || defined(LIGHTING_PHONG)
+    color *= lighting(position.xyz, normal);
+#endif
+
+#ifdef LIGHTING_CLUSTERED
+    ex_WorldPos = position.xyz;
+    ex_Normal = normal;
+#endif
+
+#ifdef TEXTURED
+    ex_TexCoord = in_TexCoord;
+#endif
+
+    ex_Color = color;
+}